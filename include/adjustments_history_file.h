@@ -0,0 +1,94 @@
+#ifndef STOCK_EXCHANGE_TOOLS_ADJUSTMENTS_HISTORY_FILE_H
+#define STOCK_EXCHANGE_TOOLS_ADJUSTMENTS_HISTORY_FILE_H
+
+#include "error.h"
+#include "stock_index.h"
+
+#include <cstdint>
+#include <expected.hpp>
+#include <string>
+#include <string_view>
+
+// Binary form of the adjustments history of an index. The values are stored
+// by columns, so a history is loaded with a few bulk copies instead of
+// parsing text. All the numbers are in native byte order. The magic does not
+// depend on it, a file written with the other byte order is rejected by the
+// version check instead, as its swapped version is out of range.
+//
+//   header     magic, version, number of adjustments and of strings, size of
+//              the characters of the strings
+//   strings    the offset of every string (plus the end of the last one),
+//              then the characters. Every distinct name, date, reason and
+//              symbol is stored once. Padded to 8 bytes.
+//   directory  for every adjustment the ids of its name, date and reason, the
+//              number of companies and the offset of its block
+//   blocks     for every adjustment a BlockHeader, then either a snapshot or a
+//              delta. A snapshot has one column per Company field, holding
+//              the field of all its companies. A delta has for every company
+//              its position in the base adjustment (or none if it is new), a
+//              mask of the fields which differ from it and their values. The
+//              companies of the base which are not referred are removed.
+//
+// Consecutive adjustments of an index mostly repeat the same companies, so
+// every adjustment is a delta against the previous one except for one
+// snapshot every snapshot interval, which bounds the deltas to apply in order
+// to get a single adjustment. The first version of the format had only
+// snapshots, without a block header, and is still read.
+class AdjustmentsHistoryFile {
+public:
+    static constexpr std::string_view kMagic    = "SETADJH";
+    static constexpr uint32_t kVersion          = 2;
+    static constexpr uint32_t kSnapshotsVersion = 1;
+    static constexpr size_t kSnapshotInterval   = 16;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t adjustments;
+        uint32_t strings;
+        uint32_t stringsSize;
+    };
+
+    struct DirectoryEntry
+    {
+        uint32_t name;
+        uint32_t date;
+        uint32_t reason;
+        uint32_t companies;
+        uint64_t blockOffset;
+    };
+
+    enum class BlockKind : uint32_t
+    {
+        Snapshot,
+        Delta,
+    };
+
+    struct BlockHeader
+    {
+        BlockKind kind;
+        // the adjustment the delta applies to, always an earlier one. A
+        // snapshot refers to itself.
+        uint32_t base;
+    };
+
+    // The size of the snapshot columns of one company: symbol and name ids,
+    // shares and the six double fields.
+    static constexpr size_t kCompanyColumnsSize =
+        2 * sizeof(uint32_t) + sizeof(uint64_t) + 6 * sizeof(double);
+
+    // snapshotInterval 1 (or 0) stores every adjustment as a snapshot.
+    static std::string Encode(
+        const Indexes& indexes,
+        size_t snapshotInterval = kSnapshotInterval);
+    static tl::expected<Indexes, Error> Decode(std::string_view data);
+    // Decodes only the adjustment with date and reason, found through the
+    // directory. Returns Error::InvalidArg if there is no such adjustment.
+    static tl::expected<Index, Error> DecodeAdjustment(
+        std::string_view data,
+        std::string_view date,
+        std::string_view reason);
+};
+
+#endif // STOCK_EXCHANGE_TOOLS_ADJUSTMENTS_HISTORY_FILE_H
@@ -5,34 +5,53 @@
 #include "error.h"
 #include "expected.hpp"
 #include "html_parser.h"
+#include "http_cache.h"
 #include "noncopyable.h"
 #include "nonmovable.h"
+#include "session_archive.h"
 #include "stock_index.h"
 
+#include <array>
+#include <chrono>
+#include <filesystem>
 #include <functional>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 class BvbScraper : private noncopyable, private nonmovable {
 private:
     friend class BvbScraperTest;
-
-    using TableValueValidator = std::function<bool(const std::string&)>;
-    template <typename Entry>
-    using TableValueSetter = std::function<void(Entry&, const std::string&)>;
+    friend class BvbScraperBenchmark;
 
     template <typename Table, typename Entry>
     using AddEntryToTable = std::function<void(Table&, Entry&&)>;
 
-    template <typename Entry>
-    struct TableColumnDetails
+    // A table column known at compile time: the cell value (or the value of
+    // innerTag inside the cell) is validated and converted by decoder in one
+    // go and the result is stored in field. The decoder returns std::nullopt
+    // if the value is not valid.
+    template <typename Entry, typename Field, typename Decoder>
+    struct TableColumn
     {
         std::string_view name;
-        TableValueValidator validator;
-        TableValueSetter<Entry> setter;
+        Field Entry::*field;
+        Decoder decoder;
         HtmlTag innerTag = HtmlTag::None;
     };
 
+    // The columns of a table in the order they appear in the page.
+    template <typename... Columns>
+    using TableSchema = std::tuple<Columns...>;
+
+    // Produces the body of a http response chunk by chunk.
+    using HttpBodySource = std::function<Error(const HttpBodyCallback&)>;
+
     struct IndexesDetails
     {
         IndexesNames names;
@@ -50,11 +69,53 @@ private:
         std::string viewStateEncrypted;
     };
 
+    // The pages of an index which are opened from the indices profiles page.
+    enum class IndexPage
+    {
+        Constituents,
+        AdjustmentsHistory,
+        TradingData,
+    };
+
+    // The state of the indices profiles page kept by the server for the
+    // requests of the scraper: the landing page, the indexes in it, the index
+    // selected by the last postback and the form state for the next one.
+    struct Session
+    {
+        bool valid = false;
+        std::string mainPage;
+        IndexesDetails details;
+        IndexName selected;
+        RequestData reqData;
+    };
+
+    // The hidden form field ids and the RequestData members holding them.
+    using RequestDataFields =
+        std::array<std::pair<std::string_view, std::string*>, 7>;
+
     static constexpr std::string_view kDataDirPath = "data/bvb";
     static constexpr std::string_view kAdjustmentsHistoryFileName =
         "_adjustments_history.txt";
+    static constexpr std::string_view kAdjustmentsHistoryBinaryFileName =
+        "_adjustments_history.bin";
+    static constexpr std::string_view kHttpCacheDirPath = "data/http_cache";
 
 public:
+    // The formats of the adjustments history files, see
+    // AdjustmentsHistoryFile for the binary one.
+    enum class HistoryFileFormat
+    {
+        Text,
+        Binary,
+    };
+
+    // An adjustments history loaded from file and how long loading it took.
+    struct LoadedAdjustmentsHistory
+    {
+        tl::expected<Indexes, Error> indexes;
+        std::chrono::microseconds duration{0};
+    };
+
     BvbScraper()  = default;
     ~BvbScraper() = default;
 
@@ -65,70 +126,196 @@ public:
     tl::expected<Indexes, Error> GetAdjustmentsHistory(const IndexName& name);
     tl::expected<IndexTradingData, Error> GetTradingData(const IndexName& name);
 
+    // Same as above but the indexes are downloaded concurrently, over at most
+    // maxConnections connections. The results are in the order of names.
+    std::vector<tl::expected<Index, Error>> GetConstituents(
+        const IndexesNames& names,
+        size_t maxConnections);
+    std::vector<tl::expected<Indexes, Error>> GetAdjustmentsHistory(
+        const IndexesNames& names,
+        size_t maxConnections);
+    std::vector<tl::expected<IndexTradingData, Error>> GetTradingData(
+        const IndexesNames& names,
+        size_t maxConnections);
+
+    // Decodes the rows of the large tables (e.g. adjustments history) on up
+    // to count threads. The rows keep their order in the page. By default the
+    // rows are decoded sequentially.
+    void SetParseThreads(size_t count);
+
+    // Keeps the downloaded pages in dirPath and reuses them, in this and the
+    // next runs, for as long as each kind of page is expected to be current.
+    void EnableHttpCache(
+        const std::filesystem::path& dirPath = kHttpCacheDirPath);
+    // Sends all the requests to baseUrl (e.g. "http://127.0.0.1:8080")
+    // instead of the BVB servers, keeping their paths. An empty baseUrl goes
+    // back to the BVB servers.
+    void SetBaseUrl(std::string baseUrl);
+    // Records the responses of the session in archive, or replays them from
+    // it with no network access. nullptr goes back to the network.
+    void SetSessionArchive(SessionArchive* archive);
+
+    // Saves the history in format and removes the file of the other format,
+    // so the history of an index is kept in a single file.
     Error SaveAdjustmentsHistoryToFile(
         const IndexName& name,
-        const Indexes& indexes);
+        const Indexes& indexes,
+        HistoryFileFormat format = HistoryFileFormat::Text);
+    // Loads the binary file of the index if there is one, the text file
+    // otherwise.
     tl::expected<Indexes, Error> LoadAdjustmentsHistoryFromFile(
         const IndexName& name);
+    // Loads the histories of names on up to threads threads, every file is
+    // read and decoded by a single thread.
+    std::map<IndexName, LoadedAdjustmentsHistory>
+    LoadAdjustmentsHistoryFromFiles(const IndexesNames& names, size_t threads);
+    // Returns the names of the indexes which have an adjustments history
+    // file, in either format.
+    static IndexesNames GetAdjustmentsHistoryFilesNames();
+    // Loads only the adjustment of the index with date and reason. From the
+    // binary file just that adjustment is decoded, without reading the rest
+    // of the history. Returns Error::InvalidArg if there is no such
+    // adjustment.
+    tl::expected<Index, Error> LoadAdjustmentFromFile(
+        const IndexName& name,
+        std::string_view date,
+        std::string_view reason);
 
 private:
-    bool IsValidIndexName(const std::string& name);
-    bool IsValidCompanySymbol(const std::string& name);
-    bool IsValidCompanyName(const std::string& name);
-    bool IsValidInt(const std::string& value, bool allowNbsp);
-    bool IsValidDouble(
-        const std::string& val,
+    static std::filesystem::path GetAdjustmentsHistoryFilePath(
+        const IndexName& name,
+        HistoryFileFormat format);
+
+    bool IsValidIndexName(std::string_view name);
+    bool IsValidCompanySymbol(std::string_view name);
+    bool IsValidCompanyName(std::string_view name);
+
+    // The Parse* functions below check the BVB number/date formats and
+    // convert the value in a single pass. If allowNbsp is true then "&nbsp;"
+    // is accepted and decoded as 0 (or as tomorrow for dates).
+    std::optional<uint64_t> ParseInt(std::string_view value, bool allowNbsp);
+    std::optional<double> ParseDouble(
+        std::string_view val,
         size_t decimals,
         bool allowNegative,
         bool hasSeparators,
         bool allowNbsp);
-    bool IsValidNumber(const std::string& val);
-    bool IsValidDate(const std::string& val, bool allowNbsp);
+    std::optional<double> ParseNumber(std::string_view val);
+    std::optional<uint16_t> ParseYear(std::string_view val);
+    std::optional<std::chrono::year_month_day> ParseDate(
+        std::string_view val,
+        bool allowNbsp);
 
     tl::expected<HttpResponse, Error> SendHttpRequest(
-        const char* url,
-        const CurlHeaders& headers,
-        HttpMethod method        = HttpMethod::get,
-        HttpVersion version      = HttpVersion::http1_1,
-        const PostData& postData = {});
-
-    tl::expected<HttpResponse, Error> GetInfoDividendPage();
-    tl::expected<HttpResponse, Error> GetIndicesProfilesPage();
-    tl::expected<HttpResponse, Error> SelectIndex(
+        const HttpRequest& req,
+        const HttpBodyCallback& bodyCallback = {});
+
+    // Returns url with its scheme and host replaced by the base url, if set.
+    std::string GetUrl(std::string_view url) const;
+    HttpRequest GetInfoDividendPageRequest() const;
+    HttpRequest GetIndicesProfilesPageRequest() const;
+    HttpRequest GetSelectIndexRequest(
         const IndexName& name,
-        const RequestData& reqData);
-    tl::expected<HttpResponse, Error> SelectAdjustmentsHistory(
+        const RequestData& reqData) const;
+    HttpRequest GetSelectAdjustmentsHistoryRequest(
         const IndexName& name,
-        const RequestData& reqData);
-    tl::expected<HttpResponse, Error> SelectTradingData(
+        const RequestData& reqData) const;
+    HttpRequest GetSelectTradingDataRequest(
         const IndexName& name,
-        const RequestData& reqData);
+        const RequestData& reqData) const;
 
-    tl::expected<std::string_view, Error> ParseRequestDataFieldFromMainPage(
-        const std::string& data,
-        std::string_view id);
+    // Downloads the landing page into the session of the scraper, unless it
+    // is there already.
+    Error LoadSession();
+    Error LoadSession(std::string&& mainPage, Session& session);
+    // Opens page of the index name continuing from the session of the
+    // scraper, so the requests known to be redundant are skipped. If that
+    // fails, the page is opened once more from a landing page downloaded
+    // afresh, bypassing the http cache. The http cache key of the page is
+    // stored in cacheKey.
+    Error PerformIndexPageChain(
+        const IndexName& name,
+        IndexPage page,
+        std::string& body,
+        std::string& cacheKey);
+    // Returns the chain of requests which opens page of the index name. The
+    // body of the last response is moved to body and its http cache key to
+    // cacheKey, if it is given. The chain continues from session and updates
+    // it, if it is given.
+    HttpRequestChain GetIndexPageChain(
+        const IndexName& name,
+        IndexPage page,
+        std::string& body,
+        Session* session      = nullptr,
+        std::string* cacheKey = nullptr);
+    // Downloads page of every index concurrently and decodes it with parse.
+    template <typename Result, typename Parse>
+    std::vector<tl::expected<Result, Error>> GetIndexesPages(
+        const IndexesNames& names,
+        IndexPage page,
+        size_t maxConnections,
+        const Parse& parse);
+
+    // Removes a response which failed to parse from the http cache, so it is
+    // downloaded again instead of being reused until it expires.
+    void RemoveCachedResponse(const std::string& cacheKey);
+
+    static RequestDataFields GetRequestDataFields(RequestData& reqData);
+    static tl::expected<std::string_view, Error> GetInputAttribute(
+        std::string_view beginTag,
+        std::string_view name);
+    // Both extract all the RequestData fields in a single forward pass over
+    // the page, respectively over the AJAX response of a postback.
     tl::expected<RequestData, Error> ParseRequestDataFromMainPage(
         const std::string& data);
-    tl::expected<std::string_view, Error> ParseRequestDataFieldFromPostRsp(
-        const std::string& data,
-        std::string_view id);
     tl::expected<RequestData, Error> ParseRequestDataFromPostRsp(
         const std::string& data);
 
     tl::expected<std::string_view, Error> ParseTradingDataTime(
         const std::string& data);
 
-    template <typename Table, typename Entry>
+    template <typename Table, typename Entry, typename... Columns>
     tl::expected<Table, Error> ParseTable(
-        const std::vector<TableColumnDetails<Entry>>& columns,
+        const TableSchema<Columns...>& columns,
+        HtmlParser& html,
         const std::string& data,
         ClosedInterval ci,
         HtmlAttribute attr,
         std::string_view attrValue,
         AddEntryToTable<Table, Entry> addFunc);
+    template <typename... Columns>
+    Error CheckTableHeader(
+        const TableSchema<Columns...>& columns,
+        HtmlParser& html,
+        const std::string& data,
+        ClosedInterval ci);
+    template <typename Entry, typename... Columns>
+    tl::expected<Entry, Error> ParseTableRow(
+        const TableSchema<Columns...>& columns,
+        HtmlParser& html,
+        const std::string& data,
+        ClosedInterval ci);
+    // Decodes every row with decoder, splitting the rows across the parse
+    // threads when there are at least minRowsPerThread rows for each of them.
+    template <typename Row, typename Decoder>
+    tl::expected<std::vector<Row>, Error> DecodeRows(
+        const HtmlElementLocations& rows,
+        size_t minRowsPerThread,
+        const Decoder& decoder);
+    template <typename Entry, typename Column>
+    Error ParseTableCell(
+        const Column& column,
+        HtmlParser& html,
+        const std::string& data,
+        ClosedInterval ci,
+        Entry& entry);
 
+    auto GetDividendActivitiesColumns();
     tl::expected<DividendActivities, Error> ParseDividendActivities(
         const std::string& data);
+    // Decodes the table rows while the page is being received.
+    tl::expected<DividendActivities, Error> ParseDividendActivities(
+        const HttpBodySource& source);
     tl::expected<IndexesDetails, Error> ParseIndexesNames(
         const std::string& data);
     tl::expected<IndexesPerformance, Error> ParseIndexesPerformance(
@@ -137,6 +324,7 @@ private:
         const std::string& data,
         const IndexName& indexName);
     tl::expected<Index, Error> ParseAdjustmentsHistoryEntry(
+        HtmlParser& html,
         const std::string& data,
         ClosedInterval ci);
     tl::expected<Indexes, Error> ParseAdjustmentsHistory(
@@ -145,6 +333,14 @@ private:
     tl::expected<IndexTradingData, Error> ParseTradingData(
         const std::string& data,
         const IndexName& indexName);
+
+private:
+    size_t m_parseThreads = 1;
+    ScopedCurl m_curl;
+    std::unique_ptr<HttpCache> m_cache;
+    SessionArchive* m_archive = nullptr;
+    std::string m_baseUrl;
+    Session m_session;
 };
 
 #endif // BVB_SCRAPER_H
@@ -2,13 +2,19 @@
 #define CURL_UTILS_H
 
 #include "error.h"
+#include "http_cache.h"
 #include "noncopyable.h"
 #include "nonmovable.h"
 #include "scoped_ptr.h"
+#include "session_archive.h"
 
 #include <curl/curl.h>
+#include <chrono>
 #include <expected.hpp>
+#include <functional>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -32,8 +38,40 @@ struct HttpResponse
     long code = 0;
     std::string headers;
     std::string body;
+    // The key of the http cache entry holding the response, empty if it is
+    // not cached. A response found invalid is removed from the cache with it.
+    std::string cacheKey;
 };
 
+// A http request described by value, so it can be built before the handle
+// which sends it is available.
+struct HttpRequest
+{
+    std::string url;
+    std::vector<const char*> headers;
+    HttpMethod method    = HttpMethod::get;
+    HttpVersion version  = HttpVersion::http1_1;
+    const char* encoding = nullptr;
+    PostData postData;
+    // How long the response is reused from the http cache of the handle
+    // before it is revalidated. Zero means the response is not cached.
+    std::chrono::seconds cacheTtl{0};
+    // The cached response is not used, the one downloaded replaces it.
+    bool refreshCache = false;
+};
+
+// Returns the next request of a chain of dependent requests given the
+// response of the previous one (nullptr for the first request). The chain
+// is complete when std::nullopt is returned. A response which makes the
+// chain fail is removed from the http cache.
+using HttpRequestChain =
+    std::function<tl::expected<std::optional<HttpRequest>, Error>(
+        HttpResponse* rsp)>;
+
+// Receives the body of a http response chunk by chunk. Returning an error
+// aborts the transfer.
+using HttpBodyCallback = std::function<Error(std::string_view chunk)>;
+
 class CurlHeaders : private noncopyable, private nonmovable {
 public:
     CurlHeaders() = default;
@@ -49,12 +87,17 @@ public:
 
     Error Add(const char* header);
     Error Add(std::initializer_list<const char*> list);
+    Error Add(const std::vector<const char*>& list);
+    void Clear();
 
 private:
     mutable curl_slist* m_headers = NULL;
 };
 
 class ScopedCurl : private noncopyable, private nonmovable {
+private:
+    friend class CurlMulti;
+
 public:
     ScopedCurl()  = default;
     ~ScopedCurl() = default;
@@ -64,17 +107,107 @@ public:
         return m_curl;
     }
 
+    // Clears the options of the previous request. The live connections and
+    // the DNS and TLS session caches of the handle are kept, so the next
+    // request to the same host skips the lookup and the handshakes.
+    void Reset();
+
     Error SetHttpMethod(HttpMethod method);
     Error SetHttpVersion(HttpVersion version);
     Error SetUrl(const char* url);
     Error SetEncoding(const char* encoding);
     Error SetHeaders(const CurlHeaders& headers);
     Error SetPostData(const PostData& data);
+    Error SetKeepAlive(bool enable);
+    // Resets the handle and sets all the options of req.
+    Error SetRequest(const HttpRequest& req);
+
+    // Responses of the requests with a cache TTL are served from cache while
+    // they are fresh. Once stale they are revalidated with If-None-Match or
+    // If-Modified-Since and reused if the server answers 304. The cache is
+    // kept by Reset(), the TTL has to be set for every request.
+    void SetCache(const HttpCache* cache);
+    void SetCacheTtl(std::chrono::seconds ttl);
+    void SetCacheRefresh(bool refresh);
+    // Records every response in archive, or serves the recorded responses
+    // without sending anything, depending on the archive mode. The http cache
+    // is not used while an archive is set. Kept by Reset().
+    void SetArchive(SessionArchive* archive);
 
     tl::expected<HttpResponse, Error> Perform();
+    // Same as Perform() but the body is not stored in the response, every
+    // chunk is passed to bodyCallback as soon as it is received.
+    tl::expected<HttpResponse, Error> Perform(
+        const HttpBodyCallback& bodyCallback);
+    // Sends the requests of chain one after another.
+    Error PerformChain(const HttpRequestChain& chain);
+
+private:
+    Error SetBodyBuffer(std::string& body);
+    Error SetHeadersBuffer(std::string& headers);
+    void GetResponseCode(HttpResponse& rsp);
+    Error PerformRequest(HttpResponse& rsp);
+
+    // Returns true if rsp was loaded from a fresh cache entry or replayed
+    // from the archive. Otherwise a stale entry is kept for revalidation and
+    // the conditional headers are added to the request.
+    tl::expected<bool, Error> LoadCachedResponse(HttpResponse& rsp);
+    // Stores rsp in the cache, or records it in the archive. Returns true if
+    // the response is a 304 and it was replaced by the revalidated cache
+    // entry.
+    bool StoreCachedResponse(HttpResponse& rsp);
 
 private:
     ScopedPtr<CURL, curl_easy_init, curl_easy_cleanup> m_curl;
+    // the request is kept to build the cache key and to add the conditional
+    // headers when revalidating
+    CurlHeaders m_headers;
+    HttpMethod m_method = HttpMethod::get;
+    std::string m_url;
+    std::string m_postData;
+    const HttpCache* m_cache = nullptr;
+    std::chrono::seconds m_cacheTtl{0};
+    bool m_cacheRefresh = false;
+    std::optional<HttpCacheEntry> m_staleEntry;
+    SessionArchive* m_archive = nullptr;
+    std::string m_archiveKey;
+};
+
+// Runs several request chains concurrently on the calling thread. The
+// requests of a chain are sent one after another, each chain waiting only for
+// its own responses.
+class CurlMulti : private noncopyable, private nonmovable {
+public:
+    CurlMulti();
+    ~CurlMulti();
+
+    operator bool() const
+    {
+        return m_multi != nullptr;
+    }
+
+    void Add(HttpRequestChain chain);
+    void SetCache(const HttpCache* cache);
+    void SetArchive(SessionArchive* archive);
+
+    // Runs the chains added so far with at most maxTransfers requests in
+    // flight. Returns the result of every chain in the order they were added.
+    std::vector<Error> Perform(size_t maxTransfers);
+
+private:
+    struct Transfer;
+
+    // Sends the next request of the chain of transfer. Returns false if the
+    // chain is complete.
+    tl::expected<bool, Error> StartRequest(
+        Transfer& transfer,
+        HttpResponse* rsp);
+
+private:
+    CURLM* m_multi = nullptr;
+    std::vector<HttpRequestChain> m_chains;
+    const HttpCache* m_cache  = nullptr;
+    SessionArchive* m_archive = nullptr;
 };
 
 #endif // CURL_UTILS_H
@@ -63,6 +63,8 @@ enum class Error : uint32_t
     WebsocketReadFailed,
     FileNotFound,
     AlreadyExists,
+    NotRecorded,
+    DaemonNotRunning,
 };
 
 #endif // STOCK_EXCHANGE_TOOLS_ERROR_H
@@ -6,7 +6,10 @@
 #include "noncopyable.h"
 #include "nonmovable.h"
 
+#include <cstdint>
 #include <expected.hpp>
+#include <functional>
+#include <map>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -70,12 +73,47 @@ private:
         size_t beginStopPos;
     };
 
+    struct HtmlBeginTagRecord
+    {
+        size_t beginPos;
+        size_t beginStopPos;
+        size_t endPos;        // position of the matching end tag mark
+        size_t nextSearchPos; // where a sequential search resumes after it
+    };
+
+    using HtmlTagIndex = std::vector<HtmlBeginTagRecord>;
+
+    // one bit per page byte, set when the byte is the given character
+    using HtmlCharBitmap = std::vector<uint64_t>;
+
+    // the implementations of the '<' and '>' scan, the fastest one supported
+    // by the CPU is used
+    enum class ScanVariant
+    {
+        Scalar,
+        Sse2,
+        Avx2,
+    };
+
 public:
     HtmlParser(const std::string& htmlPage) : m_htmlPage(htmlPage)
     {
     }
     ~HtmlParser() = default;
 
+    // Tokenizes the whole page once into a position-sorted index of begin and
+    // end tag marks. After this call FindElement and FindAllElements answer
+    // queries by binary search over the index instead of rescanning the page.
+    // Tags whose marks are not well-formed in the page (e.g. "<th" inside
+    // "<thead") are left out of the index and keep being searched in the page,
+    // so the results are identical with or without the index.
+    // The '<' and '>' positions are collected in a single vectorized sweep and
+    // are also used by the searches of the tags left out of the index.
+    void BuildTagIndex();
+
+    // The searches below only read the parser state, so once the index is
+    // built they can be run from several threads at once.
+
     tl::expected<HtmlElementLocation, Error> FindElement(
         HtmlTag tag,
         ClosedInterval ci          = {},
@@ -87,10 +125,40 @@ public:
         ClosedInterval ci          = {},
         HtmlAttribute attr         = HtmlAttribute::None,
         std::string_view attrValue = {});
+    // Same as above, but the locations are written to a caller supplied
+    // vector, so its capacity can be reused from one search to the next.
+    Error FindAllElements(
+        HtmlElementLocations& locations,
+        HtmlTag tag,
+        ClosedInterval ci          = {},
+        HtmlAttribute attr         = HtmlAttribute::None,
+        std::string_view attrValue = {});
 
 private:
     size_t FindInInterval(std::string_view val, ClosedInterval ci);
 
+    void ScanTagBoundaries();
+    static ScanVariant GetFastestScanVariant();
+    // Returns false if the variant is not supported by the CPU.
+    static bool ScanTagBoundaries(
+        ScanVariant variant,
+        std::string_view data,
+        HtmlCharBitmap& lt,
+        HtmlCharBitmap& gt);
+    size_t FindTagBoundary(std::string_view val, ClosedInterval ci);
+
+    const HtmlTagIndex* GetTagIndex(HtmlTag tag) const;
+    bool FillTagIndex(
+        const HtmlTagMarks& tagMarks,
+        const std::vector<size_t>& beginPositions,
+        const std::vector<size_t>& endPositions,
+        HtmlTagIndex& index);
+    tl::expected<HtmlElementLocation, Error> FindIndexedElement(
+        const HtmlTagIndex& index,
+        const HtmlTagMarks& tagMarks,
+        std::string_view attrMark,
+        ClosedInterval& ci);
+
     tl::expected<HtmlBeginTagPosition, Error> FindBeginTagMark(
         const HtmlTagMarks& tagMarks,
         ClosedInterval& ci);
@@ -98,13 +166,65 @@ private:
         const HtmlTagMarks& tagMarks,
         ClosedInterval ci);
 
-    tl::expected<HtmlTagMarks, Error> GetTagMarks(HtmlTag tag);
-    tl::expected<std::string, Error> GetAttributeMark(
+    static tl::expected<HtmlTagMarks, Error> GetTagMarks(HtmlTag tag);
+    static tl::expected<std::string, Error> GetAttributeMark(
         HtmlAttribute attr,
         std::string_view value);
 
 private:
+    friend class HtmlStreamParser;
+    friend class HtmlParserTest;
+
     const std::string& m_htmlPage;
+    std::map<HtmlTag, HtmlTagIndex> m_tagIndexes;
+    HtmlCharBitmap m_ltBitmap;
+    HtmlCharBitmap m_gtBitmap;
+};
+
+// Parses a page received in chunks, e.g. straight from the http write
+// callback. It looks for the first scope element having the given attribute
+// and reports every row element found in it as soon as the row is complete.
+// Only the data that was not yet reported is kept in memory and the chunks
+// following the end of the scope element are ignored.
+class HtmlStreamParser : private noncopyable, private nonmovable {
+public:
+    // data holds the unprocessed part of the page, row is relative to it
+    using RowCallback = std::function<
+        Error(const std::string& data, const HtmlElementLocation& row)>;
+
+    HtmlStreamParser(
+        HtmlTag scopeTag,
+        HtmlAttribute attr,
+        std::string_view attrValue,
+        HtmlTag rowTag,
+        RowCallback rowCallback);
+    ~HtmlStreamParser() = default;
+
+    Error Feed(std::string_view chunk);
+    // Checks that the whole scope element was received.
+    Error Finish();
+
+private:
+    enum class State
+    {
+        SearchingScope,
+        InScope,
+        Done,
+    };
+
+    Error FindScope();
+    Error ParseRows();
+    void Discard(size_t size);
+
+private:
+    HtmlTag m_scopeTag;
+    HtmlTag m_rowTag;
+    HtmlAttribute m_attr;
+    std::string m_attrValue;
+    RowCallback m_rowCallback;
+    State m_state = State::SearchingScope;
+    std::string m_buffer;
+    size_t m_pos = 0;
 };
 
 #endif // STOCK_EXCHANGE_TOOLS_HTML_PARSER_H
@@ -0,0 +1,49 @@
+#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include "error.h"
+#include "noncopyable.h"
+#include "nonmovable.h"
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+struct HttpCacheEntry
+{
+    std::chrono::system_clock::time_point storedAt;
+    long code = 0;
+    // validators sent back by the revalidation requests
+    std::string etag;
+    std::string lastModified;
+    std::string headers;
+    std::string body;
+};
+
+// Keeps http responses on disk, one file per request. The file name is a hash
+// of the request key (method, url and body), the key itself is stored in the
+// file as well so a hash collision is a miss.
+class HttpCache : private noncopyable, private nonmovable {
+public:
+    explicit HttpCache(std::filesystem::path dirPath);
+    ~HttpCache() = default;
+
+    std::optional<HttpCacheEntry> Load(std::string_view key) const;
+    // Returns true if there may be an entry for key, without reading it.
+    bool Contains(std::string_view key) const;
+    Error Store(std::string_view key, const HttpCacheEntry& entry) const;
+    void Remove(std::string_view key) const;
+
+    // Fills the validators of entry from the headers of the response.
+    static void ParseValidators(HttpCacheEntry& entry);
+
+private:
+    std::filesystem::path GetFilePath(std::string_view key) const;
+
+private:
+    std::filesystem::path m_dirPath;
+};
+
+#endif // HTTP_CACHE_H
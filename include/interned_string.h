@@ -0,0 +1,99 @@
+#ifndef STOCK_EXCHANGE_TOOLS_INTERNED_STRING_H
+#define STOCK_EXCHANGE_TOOLS_INTERNED_STRING_H
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// A string kept once per process in a table which is never shrunk, so every
+// copy of it is just a pointer to the same characters. Equal strings have
+// the same pointer, which makes the equality a pointer comparison. The order
+// is the one of the characters, so sorted containers keep their order.
+//
+// Interning takes a lock, it is meant for the symbols and names loaded in
+// bulk, not for the strings built while parsing.
+class InternedString {
+public:
+    InternedString();
+    InternedString(std::string_view str);
+    InternedString(const std::string& str)
+        : InternedString(std::string_view(str))
+    {
+    }
+    InternedString(const char* str)
+        : InternedString(std::string_view(str))
+    {
+    }
+
+    const std::string& Get() const
+    {
+        return *m_str;
+    }
+
+    operator const std::string&() const
+    {
+        return *m_str;
+    }
+    operator std::string_view() const
+    {
+        return *m_str;
+    }
+
+    // the std::string members the callers of the symbols and names use
+    const char* c_str() const
+    {
+        return m_str->c_str();
+    }
+    size_t size() const
+    {
+        return m_str->size();
+    }
+    bool empty() const
+    {
+        return m_str->empty();
+    }
+
+    friend bool operator==(InternedString a, InternedString b)
+    {
+        return a.m_str == b.m_str;
+    }
+    friend bool operator==(InternedString a, std::string_view b)
+    {
+        return *a.m_str == b;
+    }
+    friend bool operator==(InternedString a, const std::string& b)
+    {
+        return *a.m_str == b;
+    }
+    friend bool operator==(InternedString a, const char* b)
+    {
+        return *a.m_str == b;
+    }
+    friend bool operator<(InternedString a, InternedString b)
+    {
+        return a.m_str != b.m_str && *a.m_str < *b.m_str;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, InternedString str)
+    {
+        return os << *str.m_str;
+    }
+
+private:
+    friend struct std::hash<InternedString>;
+
+    const std::string* m_str;
+};
+
+template <>
+struct std::hash<InternedString>
+{
+    size_t operator()(InternedString str) const
+    {
+        return std::hash<const std::string*>()(str.m_str);
+    }
+};
+
+#endif // STOCK_EXCHANGE_TOOLS_INTERNED_STRING_H
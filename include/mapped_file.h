@@ -0,0 +1,29 @@
+#ifndef STOCK_EXCHANGE_TOOLS_MAPPED_FILE_H
+#define STOCK_EXCHANGE_TOOLS_MAPPED_FILE_H
+
+#include "error.h"
+#include "noncopyable.h"
+#include "nonmovable.h"
+
+#include <filesystem>
+#include <string_view>
+
+// Maps a whole file read-only in memory, so only the pages which are used are
+// read from the disk.
+class MappedFile : private noncopyable, private nonmovable {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    // Returns Error::InvalidArg if the file can't be opened or mapped.
+    Error Open(const std::filesystem::path& path);
+    void Close();
+
+    std::string_view GetData() const;
+
+private:
+    void* m_addr  = nullptr;
+    size_t m_size = 0;
+};
+
+#endif // STOCK_EXCHANGE_TOOLS_MAPPED_FILE_H
@@ -0,0 +1,53 @@
+#ifndef SESSION_ARCHIVE_H
+#define SESSION_ARCHIVE_H
+
+#include "error.h"
+#include "http_cache.h"
+#include "noncopyable.h"
+#include "nonmovable.h"
+
+#include <expected.hpp>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Keeps the exchanges (http responses, websocket request/response pairs) of a
+// session on disk, so the session can later be replayed without any network
+// access. A request sent several times gets a response for every time it was
+// sent, the last one is repeated if the replay sends it more often.
+class SessionArchive : private noncopyable, private nonmovable {
+public:
+    enum class Mode
+    {
+        Record,
+        Replay
+    };
+
+    SessionArchive(std::filesystem::path dirPath, Mode mode);
+    ~SessionArchive() = default;
+
+    Mode GetMode() const
+    {
+        return m_mode;
+    }
+
+    // Returns the key under which the next exchange of request is kept.
+    std::string NextKey(std::string_view request);
+
+    Error Record(std::string_view key, const HttpCacheEntry& entry) const;
+    tl::expected<HttpCacheEntry, Error> Replay(std::string_view key) const;
+
+    // Returns the archive of the process set by the SET_SESSION_ARCHIVE
+    // environment variable ("record:<dir>" or "replay:<dir>"), or nullptr.
+    static SessionArchive* FromEnvironment();
+
+private:
+    Mode m_mode;
+    HttpCache m_store;
+    std::mutex m_mutex;
+    std::unordered_map<std::string, size_t> m_sent;
+};
+
+#endif // SESSION_ARCHIVE_H
@@ -1,13 +1,17 @@
 #ifndef STOCK_EXCHANGE_TOOLS_STOCK_INDEX_H
 #define STOCK_EXCHANGE_TOOLS_STOCK_INDEX_H
 
+#include "interned_string.h"
+
 #include <chrono>
 #include <string>
 #include <vector>
 
+// The symbols and names repeat across the indexes, the activities and the
+// portfolio, so they are interned.
 using IndexName     = std::string;
-using CompanyName   = std::string;
-using CompanySymbol = std::string;
+using CompanyName   = InternedString;
+using CompanySymbol = InternedString;
 using IndexesNames  = std::vector<IndexName>;
 
 struct Company
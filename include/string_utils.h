@@ -3,6 +3,7 @@
 
 #include <chrono>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -28,7 +29,7 @@ std::vector<std::string> split_string(
     const std::string& delim);
 
 bool parse_mdy_date(
-    const std::string& str,
+    std::string_view str,
     uint8_t& month,
     uint8_t& day,
     uint16_t& year);
@@ -11,6 +11,8 @@
 #include "websocket_connection.h"
 
 #include <expected.hpp>
+#include <filesystem>
+#include <future>
 #include <map>
 #include <optional>
 #include <string>
@@ -157,11 +159,10 @@ private:
     static constexpr const char* kProto  = "apitv";
     static constexpr uint16_t kPort      = 443;
 
+    static constexpr const char* kActivityStoreDirPath = "data/tradeville";
+
 public:
-    Tradeville(const std::string& user, const std::string& pass)
-        : m_username(user), m_password(pass), m_wsConn(kHost, kPort)
-    {
-    }
+    Tradeville(const std::string& user, const std::string& pass);
 
     tl::expected<Portfolio, Error> GetPortfolio();
     tl::expected<Activities, Error> GetActivity(
@@ -169,17 +170,55 @@ public:
         uint64_t startYear,
         uint64_t endYear);
 
+    // Same as above but the request is sent right away and the response is
+    // awaited and parsed by get(), so several requests can be in flight and
+    // other work can be done meanwhile. Only the login waits for the server.
+    std::future<tl::expected<Portfolio, Error>> GetPortfolioAsync();
+    std::future<tl::expected<Activities, Error>> GetActivityAsync(
+        std::optional<std::string> symbol,
+        uint64_t startYear,
+        uint64_t endYear);
+
     Error SavePortfolioToFile();
     Error SaveActivityToFile(uint64_t year);
 
+    // Records the session in archive, or replays it from archive without
+    // connecting to Tradeville. Has to be set before the first request.
+    void SetSessionArchive(SessionArchive* archive);
+
+    // Keeps the activity of the past years, which does not change anymore, in
+    // a subdirectory of dirPath named after the user and reuses it in the next
+    // runs, so only the years missing from it and the current one are
+    // downloaded. Every year is kept in its own file as SaveActivityToFile
+    // writes it. Applies to the activity of all the symbols only.
+    void EnableActivityStore(
+        const std::filesystem::path& dirPath = kActivityStoreDirPath);
+
+    // Sends the requests through the daemon listening on socketPath instead of
+    // connecting to Tradeville, if one is running. Not used while a session
+    // archive is set.
+    void SetDaemonSocket(std::filesystem::path socketPath);
+
 private:
+    friend class TradevilleDaemon;
+    friend class TradevilleTest;
+
+    // Returns the key which matches a response to its request: the "cmd" and
+    // the parameters which tell apart the requests of the same command.
+    static std::string GetMessageKey(std::string_view msg);
+
     Error InitConnection();
+    // Sends req through the daemon or, without one, on the own connection.
+    std::future<WebsocketConnection::Response> SendRequestAsync(
+        const std::string& req);
 
     std::string GetLoginRequest();
     bool VerifyLoginResponse(const std::string& data);
 
+    // The Validate*Json functions parse data in place, so the document
+    // refers to data and data is not valid json anymore.
     tl::expected<rapidjson::Document, Error> ValidatePortfolioJson(
-        const std::string& data);
+        std::string& data);
     tl::expected<Portfolio, Error> ParsePortfolio(
         const rapidjson::Document& doc);
     Error ParsePortfolioAccount(
@@ -204,12 +243,22 @@ private:
         const rapidjson::Value& doc,
         Portfolio& portfolio);
 
+    static std::string GetActivityFileName(uint64_t year);
+    // Sends the request of every year of the interval, or loads it from the
+    // activity store, and merges the responses.
+    std::future<tl::expected<Activities, Error>> GetActivityFromStoreAsync(
+        uint64_t startYear,
+        uint64_t endYear);
+    // Keeps the response of a past year in the activity store, a failure
+    // only means the year is downloaded again next time.
+    void StoreActivity(uint64_t year, const std::string& data);
+
     std::string GetActivityRequest(
         const std::optional<std::string>& symbol,
         uint64_t startYear,
         uint64_t endYear);
     tl::expected<rapidjson::Document, Error> ValidateActivityJson(
-        const std::string& data,
+        std::string& data,
         const std::optional<std::string>& symbol,
         uint64_t startYear,
         uint64_t endYear);
@@ -286,6 +335,9 @@ private:
     std::string m_username;
     std::string m_password;
     WebsocketConnection m_wsConn;
+    SessionArchive* m_archive = nullptr;
+    std::filesystem::path m_daemonSocket;
+    std::optional<std::filesystem::path> m_activityStore;
 };
 
 #endif // STOCK_EXCHANGE_TOOLS_TRADEVILLE_H
@@ -0,0 +1,71 @@
+#ifndef STOCK_EXCHANGE_TOOLS_TRADEVILLE_DAEMON_H
+#define STOCK_EXCHANGE_TOOLS_TRADEVILLE_DAEMON_H
+
+#include "error.h"
+#include "noncopyable.h"
+#include "nonmovable.h"
+#include "websocket_connection.h"
+
+#include <atomic>
+#include <chrono>
+#include <expected.hpp>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <string>
+
+class Tradeville;
+
+// Keeps a logged in Tradeville session in the background and serves the
+// requests of the tool invocations over a unix domain socket, so they skip the
+// connection and the login. The websocket is pinged while idle and is
+// connected and logged in again once it drops.
+//
+// Every request uses its own connection to the socket. The client writes
+// "<user> <size>\n<request>" and the daemon answers
+// "<error> <size>\n<response>", with the numeric value of the Error.
+class TradevilleDaemon : private noncopyable, private nonmovable {
+public:
+    static constexpr std::chrono::seconds kHeartbeatInterval{30};
+
+    TradevilleDaemon(Tradeville& tradeville, std::filesystem::path socketPath);
+    ~TradevilleDaemon();
+
+    // Serves the clients until Stop() is called, which is safe to do from a
+    // signal handler.
+    Error Run();
+    void Stop();
+
+    // Returns the socket of the current user in XDG_RUNTIME_DIR or, if it is
+    // not set, in a directory of the user in the temp directory. The daemon
+    // and its clients only talk to processes of the same user.
+    static std::filesystem::path GetDefaultSocketPath();
+
+    // Sends req on behalf of user to the daemon listening on socketPath.
+    // Returns Error::DaemonNotRunning right away if there is no daemon.
+    static tl::expected<std::future<WebsocketConnection::Response>, Error>
+    SendRequestAsync(
+        const std::filesystem::path& socketPath,
+        const std::string& user,
+        const std::string& req);
+
+private:
+    Error Listen();
+    void Unlisten();
+    void ServeClient(int fd);
+    // Sends req on the session, which is reconnected and req sent again once
+    // if the connection dropped.
+    WebsocketConnection::Response Forward(const std::string& req);
+    // Connects and logs in again if the connection dropped meanwhile.
+    Error KeepConnected();
+
+private:
+    Tradeville& m_tradeville;
+    std::filesystem::path m_socketPath;
+    int m_listenFd = -1;
+    std::atomic<bool> m_stop = false;
+    // serializes the reconnects and the sends to the session
+    std::mutex m_mutex;
+};
+
+#endif // STOCK_EXCHANGE_TOOLS_TRADEVILLE_DAEMON_H
@@ -4,10 +4,19 @@
 #include "error.h"
 #include "noncopyable.h"
 #include "nonmovable.h"
+#include "session_archive.h"
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <expected.hpp>
+#include <functional>
+#include <future>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
 
 // boost
 #include <boost/asio/connect.hpp>
@@ -24,28 +33,98 @@ namespace http      = boost::beast::http;
 namespace ssl       = boost::asio::ssl;
 using tcp           = boost::asio::ip::tcp;
 
+// Several requests can be in flight on the connection at the same time. They
+// are written in order and every response is matched to the oldest pending
+// request with the same message key, so the server may answer them in any
+// order. The I/O runs on a thread of the connection.
 class WebsocketConnection : private noncopyable, private nonmovable {
 public:
+    using Response = tl::expected<std::string, Error>;
+    // Returns the key which matches a response to its request, e.g. the name
+    // of the command both of them carry.
+    using MessageKey = std::function<std::string(std::string_view msg)>;
+
     WebsocketConnection(const std::string& host, uint16_t port);
     ~WebsocketConnection();
 
+    // Closes the previous session first, if any, so a dropped connection can
+    // be connected again.
     Error Connect(const std::string& target, const std::string& subprotocol);
     void Close();
 
     bool IsConnected()
     {
-        return m_wss.is_open();
+        return m_replaying || m_connected;
     }
 
-    tl::expected<std::string, Error> SendRequest(const std::string& req);
+    // Without a message key the responses are matched to the requests in the
+    // order they were sent. Has to be set before connecting.
+    void SetMessageKey(MessageKey messageKey);
+
+    // Pings the server whenever the connection is idle for interval and drops
+    // the connection if nothing is received for twice as long. The connection
+    // is read all the time, the messages nobody waits for are discarded. Has
+    // to be set before connecting.
+    void SetKeepAlive(std::chrono::seconds interval);
+
+    // Records every request/response pair in archive, or serves the recorded
+    // responses without connecting, depending on the archive mode.
+    void SetSessionArchive(SessionArchive* archive);
+
+    // Sends req and returns right away, the response is received in the
+    // background. archivedReq replaces req in the archive, e.g. to keep
+    // credentials out of it.
+    std::future<Response> SendRequestAsync(
+        const std::string& req,
+        const std::optional<std::string>& archivedReq = std::nullopt);
+    // Same as above but waits for the response.
+    Response SendRequest(
+        const std::string& req,
+        const std::optional<std::string>& archivedReq = std::nullopt);
+
+private:
+    struct PendingRequest
+    {
+        std::string key;
+        std::string archiveKey;
+        std::promise<Response> promise;
+    };
+
+    // The functions below run on the I/O thread only.
+    void Write();
+    void Read();
+    void OnResponse(std::string rsp);
+    void Fail(Error err);
 
 private:
     net::io_context m_ioCtx;
     ssl::context m_sslCtx;
     tcp::resolver m_tcpResolver;
-    websocket::stream<boost::beast::ssl_stream<tcp::socket>> m_wss;
+    // recreated by every connect, a closed stream can't be reused
+    std::optional<websocket::stream<boost::beast::ssl_stream<tcp::socket>>>
+        m_wss;
     std::string m_host;
     uint16_t m_port;
+    SessionArchive* m_archive = nullptr;
+    bool m_replaying          = false;
+    MessageKey m_messageKey;
+    std::optional<std::chrono::seconds> m_keepAlive;
+    std::atomic<bool> m_connected = false;
+    std::optional<net::executor_work_guard<net::io_context::executor_type>>
+        m_work;
+    std::thread m_ioThread;
+    // owned by the I/O thread
+    std::deque<std::string> m_writeQueue;
+    std::deque<PendingRequest> m_pending;
+    // the message is read straight into the string handed to the request
+    std::string m_readMessage;
+    std::optional<net::dynamic_string_buffer<
+        char,
+        std::char_traits<char>,
+        std::allocator<char>>>
+        m_readBuffer;
+    bool m_writing = false;
+    bool m_reading = false;
 };
 
 #endif // STOCK_EXCHANGE_TOOLS_WEBSOCKET_CONNECTION_H
@@ -0,0 +1,630 @@
+#include "adjustments_history_file.h"
+
+#include <cstring>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+static constexpr size_t kAlignment = 8;
+
+// The fields of a company which changed since the adjustment a delta block
+// refers to. Only these are stored in the block.
+enum ChangedField : uint32_t
+{
+    kSymbolChanged                = 1 << 0,
+    kNameChanged                  = 1 << 1,
+    kSharesChanged                = 1 << 2,
+    kReferencePriceChanged        = 1 << 3,
+    kFreeFloatFactorChanged       = 1 << 4,
+    kRepresentationFactorChanged  = 1 << 5,
+    kPriceCorrectionFactorChanged = 1 << 6,
+    kLiquidityFactorChanged       = 1 << 7,
+    kWeightChanged                = 1 << 8,
+    kAllChanged                   = (1 << 9) - 1,
+};
+
+// the source of a company which is not in the base adjustment
+static constexpr uint32_t kNewCompany = UINT32_MAX;
+
+static size_t Align(size_t size)
+{
+    return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+template <typename T>
+static void Append(std::string& out, const T& value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Appends field of every company as one column.
+template <typename T>
+static void AppendColumn(
+    std::string& out,
+    const std::vector<Company>& companies,
+    T Company::*field)
+{
+    for (const auto& comp : companies) {
+        Append(out, comp.*field);
+    }
+}
+
+// Copies the column at pos into field of every company and moves pos past it.
+template <typename T>
+static void ReadColumn(
+    const char*& pos,
+    std::vector<Company>& companies,
+    T Company::*field)
+{
+    for (auto& comp : companies) {
+        std::memcpy(&(comp.*field), pos, sizeof(T));
+        pos += sizeof(T);
+    }
+}
+
+// Reads the values of a block, which have no fixed size in a delta, without
+// going past the end of the data.
+struct Cursor
+{
+    const char* pos;
+    const char* end;
+
+    template <typename T>
+    bool Read(T& value)
+    {
+        if (static_cast<size_t>(end - pos) < sizeof(T)) {
+            return false;
+        }
+
+        std::memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+
+        return true;
+    }
+};
+
+// Appends for every company of index its position in base (matched by
+// symbol), the fields which differ from it and their values.
+template <typename Intern>
+static void AppendDelta(
+    std::string& out,
+    const Index& index,
+    const Index& base,
+    Intern& intern)
+{
+    std::unordered_map<std::string_view, uint32_t> basePositions;
+    for (size_t i = 0; i < base.companies.size(); i++) {
+        basePositions.emplace(
+            base.companies[i].symbol, static_cast<uint32_t>(i));
+    }
+
+    std::string values;
+    for (const auto& comp : index.companies) {
+        auto it             = basePositions.find(comp.symbol);
+        const Company* prev = nullptr;
+        uint32_t source     = kNewCompany;
+        uint32_t changed    = 0;
+
+        if (it != basePositions.end()) {
+            source = it->second;
+            prev   = &base.companies[source];
+        }
+
+        values.clear();
+        auto appendString = [&](auto field, ChangedField bit) {
+            if (prev == nullptr || prev->*field != comp.*field) {
+                changed |= bit;
+                Append(values, intern(comp.*field));
+            }
+        };
+        auto appendValue = [&](auto field, ChangedField bit) {
+            if (prev == nullptr || prev->*field != comp.*field) {
+                changed |= bit;
+                Append(values, comp.*field);
+            }
+        };
+
+        appendString(&Company::symbol, kSymbolChanged);
+        appendString(&Company::name, kNameChanged);
+        appendValue(&Company::shares, kSharesChanged);
+        appendValue(&Company::reference_price, kReferencePriceChanged);
+        appendValue(&Company::free_float_factor, kFreeFloatFactorChanged);
+        appendValue(
+            &Company::representation_factor, kRepresentationFactorChanged);
+        appendValue(
+            &Company::price_correction_factor, kPriceCorrectionFactorChanged);
+        appendValue(&Company::liquidity_factor, kLiquidityFactorChanged);
+        appendValue(&Company::weight, kWeightChanged);
+
+        Append(out, source);
+        Append(out, changed);
+        out += values;
+    }
+}
+
+std::string AdjustmentsHistoryFile::Encode(
+    const Indexes& indexes,
+    size_t snapshotInterval)
+{
+    std::vector<std::string_view> strings;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    size_t stringsSize = 0;
+
+    auto intern = [&](std::string_view str) {
+        auto it = ids.emplace(str, static_cast<uint32_t>(strings.size()));
+        if (it.second) {
+            strings.push_back(str);
+            stringsSize += str.size();
+        }
+        return it.first->second;
+    };
+
+    // the blocks are built first, their offsets are known only once the size
+    // of the strings is
+    std::vector<DirectoryEntry> directory;
+    std::string blocks;
+    directory.reserve(indexes.size());
+    for (size_t i = 0; i < indexes.size(); i++) {
+        const Index& index   = indexes[i];
+        DirectoryEntry entry = {};
+
+        entry.name        = intern(index.name);
+        entry.date        = intern(index.date);
+        entry.reason      = intern(index.reason);
+        entry.companies   = static_cast<uint32_t>(index.companies.size());
+        entry.blockOffset = blocks.size();
+
+        // an adjustment of another index has little in common with the
+        // previous one
+        BlockHeader block = {BlockKind::Snapshot, static_cast<uint32_t>(i)};
+        if (snapshotInterval > 1 && i % snapshotInterval != 0 &&
+            indexes[i - 1].name == index.name) {
+            block = {BlockKind::Delta, static_cast<uint32_t>(i - 1)};
+        }
+        Append(blocks, block);
+
+        if (block.kind == BlockKind::Delta) {
+            AppendDelta(blocks, index, indexes[i - 1], intern);
+        } else {
+            for (const auto& comp : index.companies) {
+                Append(blocks, intern(comp.symbol));
+            }
+            for (const auto& comp : index.companies) {
+                Append(blocks, intern(comp.name));
+            }
+            AppendColumn(blocks, index.companies, &Company::shares);
+            AppendColumn(blocks, index.companies, &Company::reference_price);
+            AppendColumn(blocks, index.companies, &Company::free_float_factor);
+            AppendColumn(
+                blocks, index.companies, &Company::representation_factor);
+            AppendColumn(
+                blocks, index.companies, &Company::price_correction_factor);
+            AppendColumn(blocks, index.companies, &Company::liquidity_factor);
+            AppendColumn(blocks, index.companies, &Company::weight);
+        }
+
+        directory.push_back(entry);
+    }
+
+    Header header      = {};
+    header.version     = kVersion;
+    header.adjustments = static_cast<uint32_t>(indexes.size());
+    header.strings     = static_cast<uint32_t>(strings.size());
+    header.stringsSize = static_cast<uint32_t>(stringsSize);
+    kMagic.copy(header.magic, kMagic.size());
+
+    size_t stringsEnd   = sizeof(Header) +
+        (strings.size() + 1) * sizeof(uint32_t) + stringsSize;
+    size_t blocksOffset =
+        Align(stringsEnd) + directory.size() * sizeof(DirectoryEntry);
+    for (auto& entry : directory) {
+        entry.blockOffset += blocksOffset;
+    }
+
+    std::string out;
+    out.reserve(blocksOffset + blocks.size());
+
+    Append(out, header);
+    uint32_t offset = 0;
+    for (auto str : strings) {
+        Append(out, offset);
+        offset += static_cast<uint32_t>(str.size());
+    }
+    Append(out, offset);
+    for (auto str : strings) {
+        out.append(str);
+    }
+    out.resize(Align(out.size()), '\0');
+
+    for (const auto& entry : directory) {
+        Append(out, entry);
+    }
+    out += blocks;
+
+    return out;
+}
+
+// The parts of an encoded history, checked against its size. The strings and
+// the directory entries are read from the data when they are used.
+struct Layout
+{
+    std::string_view data;
+    AdjustmentsHistoryFile::Header header;
+    const char* offsets;
+    const char* chars;
+    const char* directory;
+    // the symbols and names interned so far, by string id
+    mutable std::vector<std::optional<InternedString>> interned;
+
+    // the first version has only snapshots, without a block header
+    bool HasBlockHeaders() const
+    {
+        return header.version != AdjustmentsHistoryFile::kSnapshotsVersion;
+    }
+};
+
+static tl::expected<Layout, Error> GetLayout(std::string_view data)
+{
+    using Header = AdjustmentsHistoryFile::Header;
+    Layout layout;
+
+    if (data.size() < sizeof(Header)) {
+        return tl::unexpected(Error::UnexpectedData);
+    }
+    std::memcpy(&layout.header, data.data(), sizeof(Header));
+
+    const Header& header = layout.header;
+    if (std::string_view(header.magic, sizeof(header.magic)) !=
+            std::string_view(
+                AdjustmentsHistoryFile::kMagic.data(),
+                AdjustmentsHistoryFile::kMagic.size() + 1) ||
+        header.version < AdjustmentsHistoryFile::kSnapshotsVersion ||
+        header.version > AdjustmentsHistoryFile::kVersion) {
+        return tl::unexpected(Error::UnexpectedData);
+    }
+
+    // the sizes are checked against the data before anything is read, in
+    // 64 bits so they don't overflow
+    uint64_t offsetsSize  = (uint64_t(header.strings) + 1) * sizeof(uint32_t);
+    uint64_t stringsEnd   = sizeof(Header) + offsetsSize + header.stringsSize;
+    uint64_t directoryEnd = Align(stringsEnd) +
+        uint64_t(header.adjustments) *
+            sizeof(AdjustmentsHistoryFile::DirectoryEntry);
+    if (directoryEnd > data.size()) {
+        return tl::unexpected(Error::UnexpectedData);
+    }
+
+    layout.data      = data;
+    layout.offsets   = data.data() + sizeof(Header);
+    layout.chars     = layout.offsets + offsetsSize;
+    layout.directory = data.data() + Align(stringsEnd);
+    layout.interned.resize(header.strings);
+
+    uint32_t end = 0;
+    std::memcpy(&end, layout.chars - sizeof(end), sizeof(end));
+    if (end != header.stringsSize) {
+        return tl::unexpected(Error::UnexpectedData);
+    }
+
+    return layout;
+}
+
+static std::optional<std::string_view> GetString(
+    const Layout& layout,
+    uint32_t id)
+{
+    uint32_t offsets[2];
+
+    if (id >= layout.header.strings) {
+        return std::nullopt;
+    }
+    std::memcpy(
+        offsets, layout.offsets + id * sizeof(uint32_t), sizeof(offsets));
+
+    if (offsets[0] > offsets[1] || offsets[1] > layout.header.stringsSize) {
+        return std::nullopt;
+    }
+
+    return std::string_view(
+        layout.chars + offsets[0], offsets[1] - offsets[0]);
+}
+
+// Interns every string once per decoding, the companies repeat them.
+static std::optional<InternedString> GetInterned(
+    const Layout& layout,
+    uint32_t id)
+{
+    if (id >= layout.interned.size()) {
+        return std::nullopt;
+    }
+
+    auto& interned = layout.interned[id];
+    if (! interned) {
+        auto str = GetString(layout, id);
+        if (! str) {
+            return std::nullopt;
+        }
+        interned = *str;
+    }
+
+    return interned;
+}
+
+static AdjustmentsHistoryFile::DirectoryEntry GetDirectoryEntry(
+    const Layout& layout,
+    size_t i)
+{
+    AdjustmentsHistoryFile::DirectoryEntry entry;
+
+    std::memcpy(
+        &entry, layout.directory + i * sizeof(entry), sizeof(entry));
+
+    return entry;
+}
+
+// Returns a cursor at the block of the adjustment at i, past its header, and
+// the header. A delta refers to an earlier adjustment, so following the bases
+// always ends at a snapshot.
+static tl::expected<
+    std::pair<Cursor, AdjustmentsHistoryFile::BlockHeader>,
+    Error>
+GetBlock(const Layout& layout, size_t i)
+{
+    using BlockHeader = AdjustmentsHistoryFile::BlockHeader;
+    using BlockKind   = AdjustmentsHistoryFile::BlockKind;
+
+    auto entry = GetDirectoryEntry(layout, i);
+    if (entry.blockOffset > layout.data.size()) {
+        return tl::unexpected(Error::UnexpectedData);
+    }
+
+    Cursor cursor = {
+        layout.data.data() + entry.blockOffset,
+        layout.data.data() + layout.data.size(),
+    };
+    BlockHeader block = {BlockKind::Snapshot, static_cast<uint32_t>(i)};
+
+    if (layout.HasBlockHeaders()) {
+        if (! cursor.Read(block)) {
+            return tl::unexpected(Error::UnexpectedData);
+        }
+
+        bool valid = block.kind == BlockKind::Snapshot
+            ? block.base == i
+            : block.kind == BlockKind::Delta && block.base < i;
+        if (! valid) {
+            return tl::unexpected(Error::UnexpectedData);
+        }
+    }
+
+    return std::make_pair(cursor, block);
+}
+
+static bool ReadSnapshot(
+    const Layout& layout,
+    Cursor& cursor,
+    std::vector<Company>& companies)
+{
+    uint64_t columnsSize =
+        companies.size() * AdjustmentsHistoryFile::kCompanyColumnsSize;
+    if (columnsSize > static_cast<size_t>(cursor.end - cursor.pos)) {
+        return false;
+    }
+
+    for (auto field : {&Company::symbol, &Company::name}) {
+        for (auto& comp : companies) {
+            uint32_t id = 0;
+            cursor.Read(id);
+
+            auto str = GetInterned(layout, id);
+            if (! str) {
+                return false;
+            }
+            comp.*field = *str;
+        }
+    }
+    ReadColumn(cursor.pos, companies, &Company::shares);
+    ReadColumn(cursor.pos, companies, &Company::reference_price);
+    ReadColumn(cursor.pos, companies, &Company::free_float_factor);
+    ReadColumn(cursor.pos, companies, &Company::representation_factor);
+    ReadColumn(cursor.pos, companies, &Company::price_correction_factor);
+    ReadColumn(cursor.pos, companies, &Company::liquidity_factor);
+    ReadColumn(cursor.pos, companies, &Company::weight);
+
+    return true;
+}
+
+static bool ReadDelta(
+    const Layout& layout,
+    Cursor& cursor,
+    const Index& base,
+    std::vector<Company>& companies)
+{
+    for (auto& comp : companies) {
+        uint32_t source  = 0;
+        uint32_t changed = 0;
+
+        if (! cursor.Read(source) || ! cursor.Read(changed) ||
+            (changed & ~kAllChanged) != 0) {
+            return false;
+        }
+
+        if (source != kNewCompany) {
+            if (source >= base.companies.size()) {
+                return false;
+            }
+            comp = base.companies[source];
+        } else if (changed != kAllChanged) {
+            return false;
+        }
+
+        auto readString = [&](InternedString& str, ChangedField bit) {
+            uint32_t id = 0;
+            if ((changed & bit) == 0) {
+                return true;
+            }
+
+            auto val = cursor.Read(id) ? GetInterned(layout, id) : std::nullopt;
+            if (! val) {
+                return false;
+            }
+            str = *val;
+
+            return true;
+        };
+        auto readValue = [&](auto& value, ChangedField bit) {
+            return (changed & bit) == 0 || cursor.Read(value);
+        };
+
+        if (! readString(comp.symbol, kSymbolChanged) ||
+            ! readString(comp.name, kNameChanged) ||
+            ! readValue(comp.shares, kSharesChanged) ||
+            ! readValue(comp.reference_price, kReferencePriceChanged) ||
+            ! readValue(comp.free_float_factor, kFreeFloatFactorChanged) ||
+            ! readValue(
+                comp.representation_factor, kRepresentationFactorChanged) ||
+            ! readValue(
+                comp.price_correction_factor, kPriceCorrectionFactorChanged) ||
+            ! readValue(comp.liquidity_factor, kLiquidityFactorChanged) ||
+            ! readValue(comp.weight, kWeightChanged)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Decodes the adjustment at i. base is the decoded adjustment its block
+// refers to if it is a delta, it is not used for a snapshot.
+static tl::expected<Index, Error> DecodeEntry(
+    const Layout& layout,
+    size_t i,
+    const Index* base)
+{
+    auto entry = GetDirectoryEntry(layout, i);
+    auto block = GetBlock(layout, i);
+    if (! block) {
+        return tl::unexpected(block.error());
+    }
+
+    auto name   = GetString(layout, entry.name);
+    auto date   = GetString(layout, entry.date);
+    auto reason = GetString(layout, entry.reason);
+    if (! name || ! date || ! reason) {
+        return tl::unexpected(Error::UnexpectedData);
+    }
+
+    // the count comes from the file, the data has to hold at least the
+    // source and the changes of every company before it is trusted
+    auto& [cursor, header] = *block;
+    if (uint64_t(entry.companies) * 2 * sizeof(uint32_t) >
+        static_cast<size_t>(cursor.end - cursor.pos)) {
+        return tl::unexpected(Error::UnexpectedData);
+    }
+
+    Index index;
+    index.name   = *name;
+    index.date   = *date;
+    index.reason = *reason;
+    index.companies.resize(entry.companies);
+
+    bool ok = header.kind == AdjustmentsHistoryFile::BlockKind::Snapshot
+        ? ReadSnapshot(layout, cursor, index.companies)
+        : base != nullptr && ReadDelta(layout, cursor, *base, index.companies);
+    if (! ok) {
+        return tl::unexpected(Error::UnexpectedData);
+    }
+
+    return index;
+}
+
+tl::expected<Indexes, Error> AdjustmentsHistoryFile::Decode(
+    std::string_view data)
+{
+    auto layout = GetLayout(data);
+    if (! layout) {
+        return tl::unexpected(layout.error());
+    }
+
+    // the adjustments are decoded in order, so the base of every delta is
+    // decoded already
+    Indexes indexes;
+    indexes.reserve(layout->header.adjustments);
+    for (size_t i = 0; i < layout->header.adjustments; i++) {
+        auto block = GetBlock(*layout, i);
+        if (! block) {
+            return tl::unexpected(block.error());
+        }
+
+        const BlockHeader& header = block->second;
+        const Index* base =
+            header.kind == BlockKind::Delta ? &indexes[header.base] : nullptr;
+        auto index = DecodeEntry(*layout, i, base);
+        if (! index) {
+            return tl::unexpected(index.error());
+        }
+
+        indexes.push_back(std::move(*index));
+    }
+
+    return indexes;
+}
+
+tl::expected<Index, Error> AdjustmentsHistoryFile::DecodeAdjustment(
+    std::string_view data,
+    std::string_view date,
+    std::string_view reason)
+{
+    auto layout = GetLayout(data);
+    if (! layout) {
+        return tl::unexpected(layout.error());
+    }
+
+    // only the directory and the strings it refers to are read until the
+    // adjustment is found
+    size_t found = layout->header.adjustments;
+    for (size_t i = 0; i < layout->header.adjustments; i++) {
+        auto entry = GetDirectoryEntry(*layout, i);
+
+        auto entryDate   = GetString(*layout, entry.date);
+        auto entryReason = GetString(*layout, entry.reason);
+        if (! entryDate || ! entryReason) {
+            return tl::unexpected(Error::UnexpectedData);
+        }
+
+        if (*entryDate == date && *entryReason == reason) {
+            found = i;
+            break;
+        }
+    }
+
+    if (found == layout->header.adjustments) {
+        return tl::unexpected(Error::InvalidArg);
+    }
+
+    // a delta is applied on its base, so the adjustments from the last
+    // snapshot up to the one found are decoded, at most a snapshot interval
+    std::vector<size_t> chain = {found};
+    while (true) {
+        auto block = GetBlock(*layout, chain.back());
+        if (! block) {
+            return tl::unexpected(block.error());
+        }
+        if (block->second.kind == BlockKind::Snapshot) {
+            break;
+        }
+        chain.push_back(block->second.base);
+    }
+
+    std::optional<Index> index;
+    for (auto it = chain.rbegin(); it != chain.rend(); it++) {
+        auto next = DecodeEntry(*layout, *it, index ? &*index : nullptr);
+        if (! next) {
+            return tl::unexpected(next.error());
+        }
+
+        index = std::move(*next);
+    }
+
+    return std::move(*index);
+}
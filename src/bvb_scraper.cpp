@@ -1,263 +1,327 @@
 #include "bvb_scraper.h"
 
+#include "adjustments_history_file.h"
 #include "chrono_utils.h"
+#include "mapped_file.h"
 #include "string_utils.h"
 
 #include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <set>
+#include <thread>
 #include <utility>
 
-#define DEF_SETTER(entry, field, func)                                         \
-    static TableValueSetter<entry> field =                                     \
-        [](entry& e, const std::string& val) -> void { e.field = func(val); }
-#define NO_FUNC(val)              val
-#define NBSP_OR_DOUBLE_FUNC(val)  (val == "&nbsp;" ? 0.0 : std::stod(val))
-#define NBSP_OR_SDOUBLE_FUNC(val) (val == "&nbsp;" ? 0.0 : StringToDouble(val))
-#define NBSP_OR_U64_FUNC(val)     (val == "&nbsp;" ? 0ull : StringToU64(val))
-#define NBSP_OR_DATE_FUNC(val)                                                 \
-    (val == "&nbsp;" ? ymd_tomorrow() : StringToDate(val))
-
-uint64_t StringToU64(const std::string& val)
+static constexpr std::string_view kNbsp = "&nbsp;";
+
+static constexpr const char* kInfoDividendUrl =
+    "https://bvb.ro/FinancialInstruments/CorporateActions/InfoDividend";
+static constexpr const char* kIndicesProfilesUrl =
+    "https://m.bvb.ro/FinancialInstruments/Indices/IndicesProfiles";
+
+// How long the pages are reused from the http cache, if it is enabled. The
+// indexes performance and the trading data change during the trading day,
+// the rest at most daily.
+static constexpr std::chrono::seconds kInfoDividendCacheTtl =
+    std::chrono::hours(1);
+static constexpr std::chrono::seconds kIndicesProfilesCacheTtl =
+    std::chrono::minutes(5);
+static constexpr std::chrono::seconds kConstituentsCacheTtl =
+    std::chrono::hours(1);
+static constexpr std::chrono::seconds kAdjustmentsHistoryCacheTtl =
+    std::chrono::hours(12);
+static constexpr std::chrono::seconds kTradingDataCacheTtl =
+    std::chrono::minutes(1);
+
+// Below these many rows per thread, starting the threads costs more than
+// decoding the rows. A history row holds a whole constituents table, so it is
+// worth a thread on its own.
+static constexpr size_t kMinTableRowsPerThread   = 256;
+static constexpr size_t kMinHistoryRowsPerThread = 1;
+
+// Set on the threads decoding the rows of a table.
+static thread_local bool t_decodingRows = false;
+
+// The cells of every table row decoded on a thread are located in the same
+// buffer, so decoding a table does not allocate for each row.
+static thread_local HtmlElementLocations t_cellLocations;
+
+// Mantissas below 2^53 and powers of ten up to 1e22 are exact doubles, so a
+// single division gives the correctly rounded value, same as std::stod.
+static constexpr uint64_t kMaxExactMantissa = 1ull << 53;
+static constexpr double kPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Slow path for values that do not fit the exact division above. Values
+// longer than the buffer, once the separators are dropped, are rejected.
+static std::optional<double> StringToDouble(std::string_view val)
 {
-    uint64_t res = 0;
-
+    char buf[64];
+    size_t len = 0;
     for (char c : val) {
-        if (std::isdigit(c)) {
-            res = res * 10 + (c - '0');
+        if (c == ',') {
+            continue;
+        }
+        if (len == sizeof(buf)) {
+            return std::nullopt;
         }
+        buf[len++] = c;
     }
 
-    return res;
-}
-
-uint16_t StringToU16(const std::string& val)
-{
-    return static_cast<uint16_t>(std::stoul(val));
-}
+    double res     = 0.0;
+    auto [ptr, ec] = std::from_chars(buf, buf + len, res);
+    if (ec != std::errc{} || ptr != buf + len) {
+        return std::nullopt;
+    }
 
-double StringToDouble(std::string val)
-{
-    val.erase(std::remove(val.begin(), val.end(), ','), val.end());
-    return std::stod(val);
+    return res;
 }
 
-std::chrono::year_month_day StringToDate(const std::string& val)
+static void WriteAdjustmentsHistoryText(
+    std::ostream& file,
+    const Indexes& indexes)
 {
-    uint8_t month = 0;
-    uint8_t day   = 0;
-    uint16_t year = 0;
-
-    if (parse_mdy_date(val, month, day, year) == false) {
-        return std::chrono::year_month_day{};
+    for (const auto& index : indexes) {
+        file << index.name << std::endl;
+        file << index.date << std::endl;
+        file << index.reason << std::endl;
+        for (const auto& comp : index.companies) {
+            file << comp.symbol << "|";
+            file << comp.name << "|";
+            file << comp.shares << "|";
+            file << double_to_string(comp.reference_price, 4) << "|";
+            file << double_to_string(comp.free_float_factor, 2) << "|";
+            file << double_to_string(comp.representation_factor, 6) << "|";
+            file << double_to_string(comp.price_correction_factor, 6) << "|";
+            file << double_to_string(comp.liquidity_factor, 2) << "|";
+            file << double_to_string(comp.weight, 2) << std::endl;
+        }
+        file << std::endl;
     }
-
-    return std::chrono::year_month_day(
-        std::chrono::year(static_cast<int>(year)),
-        std::chrono::month(month),
-        std::chrono::day(day));
 }
 
 tl::expected<DividendActivities, Error> BvbScraper::GetDividendActivities()
 {
-    auto rsp = GetInfoDividendPage();
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
+    std::string cacheKey;
+
+    auto res = ParseDividendActivities(
+        [this, &cacheKey](const HttpBodyCallback& bodyCallback) -> Error {
+            auto rsp =
+                SendHttpRequest(GetInfoDividendPageRequest(), bodyCallback);
+            if (! rsp) {
+                return rsp.error();
+            }
+
+            cacheKey = std::move(rsp->cacheKey);
+            return Error::NoError;
+        });
+    if (! res) {
+        RemoveCachedResponse(cacheKey);
     }
 
-    return ParseDividendActivities(rsp->body);
+    return res;
 }
 
 tl::expected<IndexesNames, Error> BvbScraper::GetIndexesNames()
 {
-    auto rsp = GetIndicesProfilesPage();
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
-    }
-
-    auto res = ParseIndexesNames(rsp->body);
-    if (! res) {
-        return tl::unexpected(res.error());
+    Error err = LoadSession();
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
     }
 
-    return std::move(res->names);
+    return m_session.details.names;
 }
 
 tl::expected<IndexesPerformance, Error> BvbScraper::GetIndexesPerformance()
 {
-    auto rsp = GetIndicesProfilesPage();
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
+    Error err = LoadSession();
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
     }
 
-    return ParseIndexesPerformance(rsp->body);
+    return ParseIndexesPerformance(m_session.mainPage);
 }
 
 tl::expected<Index, Error> BvbScraper::GetConstituents(const IndexName& name)
 {
-    auto rsp = GetIndicesProfilesPage();
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
-    }
+    std::string body;
+    std::string cacheKey;
 
-    auto indexesDetails = ParseIndexesNames(rsp->body);
-    if (! indexesDetails) {
-        return tl::unexpected(indexesDetails.error());
-    }
-
-    if (indexesDetails->selected == name) {
-        return ParseConstituents(rsp->body, name);
-    }
-
-    auto it = std::find(
-        indexesDetails->names.begin(),
-        indexesDetails->names.end(),
-        name);
-    if (it == indexesDetails->names.end()) {
-        return tl::unexpected(Error::InvalidArg);
-    }
-
-    auto reqData = ParseRequestDataFromMainPage(rsp->body);
-    if (! reqData) {
-        return tl::unexpected(reqData.error());
+    Error err =
+        PerformIndexPageChain(name, IndexPage::Constituents, body, cacheKey);
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
     }
 
-    rsp = SelectIndex(name, *reqData);
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
+    auto res = ParseConstituents(body, name);
+    if (! res) {
+        RemoveCachedResponse(cacheKey);
     }
 
-    return ParseConstituents(rsp->body, name);
+    return res;
 }
 
 tl::expected<Indexes, Error> BvbScraper::GetAdjustmentsHistory(
     const IndexName& name)
 {
-    auto rsp = GetIndicesProfilesPage();
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
-    }
+    std::string body;
+    std::string cacheKey;
 
-    auto indexesDetails = ParseIndexesNames(rsp->body);
-    if (! indexesDetails) {
-        return tl::unexpected(indexesDetails.error());
+    Error err = PerformIndexPageChain(
+        name, IndexPage::AdjustmentsHistory, body, cacheKey);
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
     }
 
-    auto it = std::find(
-        indexesDetails->names.begin(),
-        indexesDetails->names.end(),
-        name);
-    if (it == indexesDetails->names.end()) {
-        return tl::unexpected(Error::InvalidArg);
+    auto res = ParseAdjustmentsHistory(body, name);
+    if (! res) {
+        RemoveCachedResponse(cacheKey);
     }
 
-    auto reqData = ParseRequestDataFromMainPage(rsp->body);
-    if (! reqData) {
-        return tl::unexpected(reqData.error());
-    }
+    return res;
+}
 
-    if (indexesDetails->selected != name) {
-        rsp = SelectIndex(name, *reqData);
-        if (! rsp) {
-            return tl::unexpected(rsp.error());
-        }
+tl::expected<IndexTradingData, Error> BvbScraper::GetTradingData(
+    const IndexName& name)
+{
+    std::string body;
+    std::string cacheKey;
 
-        reqData = ParseRequestDataFromPostRsp(rsp->body);
-        if (! reqData) {
-            return tl::unexpected(reqData.error());
-        }
+    Error err =
+        PerformIndexPageChain(name, IndexPage::TradingData, body, cacheKey);
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
     }
 
-    rsp = SelectAdjustmentsHistory(name, *reqData);
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
+    auto res = ParseTradingData(body, name);
+    if (! res) {
+        RemoveCachedResponse(cacheKey);
     }
 
-    return ParseAdjustmentsHistory(rsp->body, name);
+    return res;
 }
 
-tl::expected<IndexTradingData, Error> BvbScraper::GetTradingData(
-    const IndexName& name)
+std::vector<tl::expected<Index, Error>> BvbScraper::GetConstituents(
+    const IndexesNames& names,
+    size_t maxConnections)
 {
-    auto rsp = GetIndicesProfilesPage();
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
-    }
+    return GetIndexesPages<Index>(
+        names,
+        IndexPage::Constituents,
+        maxConnections,
+        [this](const std::string& body, const IndexName& name) {
+            return ParseConstituents(body, name);
+        });
+}
 
-    auto indexesDetails = ParseIndexesNames(rsp->body);
-    if (! indexesDetails) {
-        return tl::unexpected(indexesDetails.error());
-    }
+std::vector<tl::expected<Indexes, Error>> BvbScraper::GetAdjustmentsHistory(
+    const IndexesNames& names,
+    size_t maxConnections)
+{
+    return GetIndexesPages<Indexes>(
+        names,
+        IndexPage::AdjustmentsHistory,
+        maxConnections,
+        [this](const std::string& body, const IndexName& name) {
+            return ParseAdjustmentsHistory(body, name);
+        });
+}
 
-    auto it = std::find(
-        indexesDetails->names.begin(),
-        indexesDetails->names.end(),
-        name);
-    if (it == indexesDetails->names.end()) {
-        return tl::unexpected(Error::InvalidArg);
-    }
+std::vector<tl::expected<IndexTradingData, Error>> BvbScraper::GetTradingData(
+    const IndexesNames& names,
+    size_t maxConnections)
+{
+    return GetIndexesPages<IndexTradingData>(
+        names,
+        IndexPage::TradingData,
+        maxConnections,
+        [this](const std::string& body, const IndexName& name) {
+            return ParseTradingData(body, name);
+        });
+}
 
-    auto reqData = ParseRequestDataFromMainPage(rsp->body);
-    if (! reqData) {
-        return tl::unexpected(reqData.error());
-    }
+void BvbScraper::SetParseThreads(size_t count)
+{
+    m_parseThreads = std::max<size_t>(count, 1);
+}
 
-    if (indexesDetails->selected != name) {
-        rsp = SelectIndex(name, *reqData);
-        if (! rsp) {
-            return tl::unexpected(rsp.error());
-        }
+void BvbScraper::EnableHttpCache(const std::filesystem::path& dirPath)
+{
+    m_cache = std::make_unique<HttpCache>(dirPath);
+    m_curl.SetCache(m_cache.get());
+}
 
-        reqData = ParseRequestDataFromPostRsp(rsp->body);
-        if (! reqData) {
-            return tl::unexpected(reqData.error());
-        }
+void BvbScraper::SetBaseUrl(std::string baseUrl)
+{
+    while (! baseUrl.empty() && baseUrl.back() == '/') {
+        baseUrl.pop_back();
     }
 
-    rsp = SelectTradingData(name, *reqData);
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
-    }
+    m_baseUrl = std::move(baseUrl);
+    m_session = {};
+}
 
-    return ParseTradingData(rsp->body, name);
+void BvbScraper::SetSessionArchive(SessionArchive* archive)
+{
+    m_archive = archive;
+    m_curl.SetArchive(archive);
 }
 
 Error BvbScraper::SaveAdjustmentsHistoryToFile(
     const IndexName& name,
-    const Indexes& indexes)
+    const Indexes& indexes,
+    HistoryFileFormat format)
 {
     if (indexes.empty() == true) {
         return Error::InvalidArg;
     }
 
-    std::filesystem::path filePath = kDataDirPath;
-    std::string fileName           = name;
-    fileName += kAdjustmentsHistoryFileName;
-    filePath /= fileName;
+    HistoryFileFormat otherFormat = format == HistoryFileFormat::Text
+        ? HistoryFileFormat::Binary
+        : HistoryFileFormat::Text;
+    std::filesystem::path filePath =
+        GetAdjustmentsHistoryFilePath(name, format);
+    std::filesystem::path tmpPath = filePath;
+    tmpPath += ".tmp";
+    std::error_code ec;
+
+    // written aside and renamed, so a failed write keeps the previous files
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (! file) {
+            return Error::InvalidArg;
+        }
 
-    std::ofstream file(filePath.c_str());
-    if (! file) {
-        return Error::InvalidArg;
-    }
+        if (format == HistoryFileFormat::Binary) {
+            file << AdjustmentsHistoryFile::Encode(indexes);
+        } else {
+            WriteAdjustmentsHistoryText(file, indexes);
+        }
 
-    for (const auto& index : indexes) {
-        file << index.name << std::endl;
-        file << index.date << std::endl;
-        file << index.reason << std::endl;
-        for (const auto& comp : index.companies) {
-            file << comp.symbol << "|";
-            file << comp.name << "|";
-            file << comp.shares << "|";
-            file << double_to_string(comp.reference_price, 4) << "|";
-            file << double_to_string(comp.free_float_factor, 2) << "|";
-            file << double_to_string(comp.representation_factor, 6) << "|";
-            file << double_to_string(comp.price_correction_factor, 6) << "|";
-            file << double_to_string(comp.liquidity_factor, 2) << "|";
-            file << double_to_string(comp.weight, 2) << std::endl;
+        file.close();
+        if (! file) {
+            std::filesystem::remove(tmpPath, ec);
+            return Error::InvalidArg;
         }
-        file << std::endl;
     }
 
+    std::filesystem::rename(tmpPath, filePath, ec);
+    if (ec) {
+        std::filesystem::remove(tmpPath, ec);
+        return Error::InvalidArg;
+    }
+
+    // the binary file would be loaded instead of the text one, it is removed
+    // only after the new file is complete
+    std::filesystem::remove(
+        GetAdjustmentsHistoryFilePath(name, otherFormat),
+        ec);
+
     return Error::NoError;
 }
 
@@ -267,13 +331,16 @@ tl::expected<Indexes, Error> BvbScraper::LoadAdjustmentsHistoryFromFile(
     std::vector<std::vector<std::string>> data;
     std::string line;
     Indexes indexes;
-    std::filesystem::path filePath = kDataDirPath;
-    std::string fileName           = name;
 
-    fileName += kAdjustmentsHistoryFileName;
-    filePath /= fileName;
+    MappedFile binaryFile;
+    if (binaryFile.Open(GetAdjustmentsHistoryFilePath(
+            name, HistoryFileFormat::Binary)) == Error::NoError) {
+        // the decoding copies whole columns out of the mapping
+        return AdjustmentsHistoryFile::Decode(binaryFile.GetData());
+    }
 
-    std::ifstream file(filePath.c_str());
+    std::ifstream file(
+        GetAdjustmentsHistoryFilePath(name, HistoryFileFormat::Text));
     if (! file) {
         return tl::unexpected(Error::InvalidArg);
     }
@@ -330,7 +397,108 @@ tl::expected<Indexes, Error> BvbScraper::LoadAdjustmentsHistoryFromFile(
     return std::move(indexes);
 }
 
-bool BvbScraper::IsValidIndexName(const std::string& name)
+std::map<IndexName, BvbScraper::LoadedAdjustmentsHistory>
+BvbScraper::LoadAdjustmentsHistoryFromFiles(
+    const IndexesNames& names,
+    size_t threads)
+{
+    std::vector<LoadedAdjustmentsHistory> loaded(names.size());
+    std::atomic<size_t> next = 0;
+
+    // the files differ a lot in size, so every worker takes the next file
+    // once it is done with one instead of getting a fixed share
+    threads = std::clamp<size_t>(threads, 1, std::max<size_t>(names.size(), 1));
+    {
+        std::vector<std::jthread> workers;
+        workers.reserve(threads);
+
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&]() {
+                for (size_t i = next++; i < names.size(); i = next++) {
+                    auto& file = loaded[i];
+                    auto start = std::chrono::steady_clock::now();
+
+                    file.indexes  = LoadAdjustmentsHistoryFromFile(names[i]);
+                    file.duration =
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start);
+                }
+            });
+        }
+    }
+
+    std::map<IndexName, LoadedAdjustmentsHistory> res;
+    for (size_t i = 0; i < names.size(); i++) {
+        res.emplace(names[i], std::move(loaded[i]));
+    }
+
+    return res;
+}
+
+IndexesNames BvbScraper::GetAdjustmentsHistoryFilesNames()
+{
+    std::set<IndexName> names;
+    std::error_code ec;
+
+    for (const auto& entry :
+         std::filesystem::directory_iterator(kDataDirPath, ec)) {
+        std::string fileName = entry.path().filename().string();
+
+        for (auto suffix :
+             {kAdjustmentsHistoryFileName, kAdjustmentsHistoryBinaryFileName}) {
+            size_t nameSize = fileName.size() - suffix.size();
+            if (fileName.size() > suffix.size() && fileName.ends_with(suffix)) {
+                names.insert(fileName.substr(0, nameSize));
+            }
+        }
+    }
+
+    return IndexesNames(names.begin(), names.end());
+}
+
+tl::expected<Index, Error> BvbScraper::LoadAdjustmentFromFile(
+    const IndexName& name,
+    std::string_view date,
+    std::string_view reason)
+{
+    MappedFile binaryFile;
+    if (binaryFile.Open(GetAdjustmentsHistoryFilePath(
+            name, HistoryFileFormat::Binary)) == Error::NoError) {
+        return AdjustmentsHistoryFile::DecodeAdjustment(
+            binaryFile.GetData(), date, reason);
+    }
+
+    // the text file has no directory, it is loaded whole
+    auto indexes = LoadAdjustmentsHistoryFromFile(name);
+    if (! indexes) {
+        return tl::unexpected(indexes.error());
+    }
+
+    for (auto& index : *indexes) {
+        if (index.date == date && index.reason == reason) {
+            return std::move(index);
+        }
+    }
+
+    return tl::unexpected(Error::InvalidArg);
+}
+
+std::filesystem::path BvbScraper::GetAdjustmentsHistoryFilePath(
+    const IndexName& name,
+    HistoryFileFormat format)
+{
+    std::filesystem::path filePath = kDataDirPath;
+    std::string fileName           = name;
+
+    fileName += format == HistoryFileFormat::Binary
+        ? kAdjustmentsHistoryBinaryFileName
+        : kAdjustmentsHistoryFileName;
+    filePath /= fileName;
+
+    return filePath;
+}
+
+bool BvbScraper::IsValidIndexName(std::string_view name)
 {
     if (name.empty()) {
         return false;
@@ -354,7 +522,7 @@ bool BvbScraper::IsValidIndexName(const std::string& name)
     return true;
 }
 
-bool BvbScraper::IsValidCompanySymbol(const std::string& name)
+bool BvbScraper::IsValidCompanySymbol(std::string_view name)
 {
     if (name.empty()) {
         return false;
@@ -371,7 +539,7 @@ bool BvbScraper::IsValidCompanySymbol(const std::string& name)
     return true;
 }
 
-bool BvbScraper::IsValidCompanyName(const std::string& name)
+bool BvbScraper::IsValidCompanyName(std::string_view name)
 {
     if (name.empty()) {
         return false;
@@ -407,40 +575,43 @@ bool BvbScraper::IsValidCompanyName(const std::string& name)
     return true;
 }
 
-bool BvbScraper::IsValidInt(const std::string& value, bool allowNbsp)
+std::optional<uint64_t> BvbScraper::ParseInt(
+    std::string_view value,
+    bool allowNbsp)
 {
     if (value.empty()) {
-        return false;
+        return std::nullopt;
     }
 
-    if (allowNbsp == true && value == "&nbsp;") {
-        return true;
+    if (allowNbsp == true && value == kNbsp) {
+        return 0;
     }
 
     if (! std::isdigit(value[0]) || value[0] == '0') {
-        return false;
+        return std::nullopt;
     }
 
-    int digits = 0;
-    for (auto it = value.rbegin(); it != value.rend(); ++it) {
-        if (digits == 3) {
-            if (*it != ',') {
-                return false;
+    // every 4th character counted from the right must be a separator
+    uint64_t res = 0;
+    for (size_t i = 0; i < value.size(); i++) {
+        char c = value[i];
+        if ((value.size() - i) % 4 == 0) {
+            if (c != ',') {
+                return std::nullopt;
             }
-            digits = 0;
             continue;
         }
-        if (! std::isdigit(*it)) {
-            return false;
+        if (! std::isdigit(c)) {
+            return std::nullopt;
         }
-        digits++;
+        res = res * 10 + (c - '0');
     }
 
-    return true;
+    return res;
 }
 
-bool BvbScraper::IsValidDouble(
-    const std::string& val,
+std::optional<double> BvbScraper::ParseDouble(
+    std::string_view val,
     size_t decimals,
     bool allowNegative,
     bool hasSeparators,
@@ -448,14 +619,14 @@ bool BvbScraper::IsValidDouble(
 {
     size_t firstDigitPos = 0;
     size_t pointPos      = 0;
-    int digits           = 0;
+    uint64_t mantissa    = 0;
 
     if (val.empty()) {
-        return false;
+        return std::nullopt;
     }
 
-    if (allowNbsp == true && val == "&nbsp;") {
-        return true;
+    if (allowNbsp == true && val == kNbsp) {
+        return 0.0;
     }
 
     if (allowNegative == true && val[0] == '-') {
@@ -463,122 +634,171 @@ bool BvbScraper::IsValidDouble(
     }
 
     if (val.size() < decimals + firstDigitPos + 2) {
-        return false;
+        return std::nullopt;
     }
 
     pointPos = val.size() - decimals - 1;
 
     if (val[firstDigitPos] == '0' && val[firstDigitPos + 1] != '.') {
-        return false;
+        return std::nullopt;
     }
 
     if (val[pointPos] != '.') {
-        return false;
+        return std::nullopt;
     }
 
-    for (size_t i = pointPos; i > firstDigitPos; i--) {
-        char c = val[i - 1];
-        if (hasSeparators == true) {
-            if (digits == 3) {
-                if (c != ',') {
-                    return false;
-                }
-                digits = 0;
-                continue;
-            } else {
-                digits++;
+    for (size_t i = firstDigitPos; i < val.size(); i++) {
+        char c = val[i];
+        if (i == pointPos) {
+            continue;
+        }
+        if (hasSeparators == true && i < pointPos &&
+            (pointPos - i) % 4 == 0) {
+            if (c != ',') {
+                return std::nullopt;
             }
+            continue;
         }
-
         if (! std::isdigit(c)) {
-            return false;
+            return std::nullopt;
+        }
+        if (mantissa < kMaxExactMantissa) {
+            mantissa = mantissa * 10 + (c - '0');
         }
     }
 
-    for (size_t i = pointPos + 1; i < val.size(); i++) {
-        if (! std::isdigit(val[i])) {
-            return false;
+    double res = 0.0;
+    if (mantissa < kMaxExactMantissa && decimals < std::size(kPow10)) {
+        res = static_cast<double>(mantissa) / kPow10[decimals];
+    } else {
+        auto slowRes = StringToDouble(val.substr(firstDigitPos));
+        if (! slowRes) {
+            return std::nullopt;
         }
+        res = *slowRes;
     }
 
-    return true;
+    return firstDigitPos == 1 ? -res : res;
 }
 
-bool BvbScraper::IsValidNumber(const std::string& val)
+std::optional<double> BvbScraper::ParseNumber(std::string_view val)
 {
-    size_t points = 0;
+    size_t points     = 0;
+    size_t decimals   = 0;
+    uint64_t mantissa = 0;
+
+    if (val.empty() || val == ".") {
+        return std::nullopt;
+    }
 
     for (char c : val) {
         if (c == '.') {
-            points++;
-        } else if (! std::isdigit(c)) {
-            return false;
+            if (++points > 1) {
+                return std::nullopt;
+            }
+            continue;
+        }
+        if (! std::isdigit(c)) {
+            return std::nullopt;
+        }
+        if (mantissa < kMaxExactMantissa) {
+            mantissa = mantissa * 10 + (c - '0');
         }
+        decimals += points;
     }
 
-    return points < 2;
+    if (mantissa < kMaxExactMantissa && decimals < std::size(kPow10)) {
+        return static_cast<double>(mantissa) / kPow10[decimals];
+    }
+
+    return StringToDouble(val);
 }
 
-bool BvbScraper::IsValidDate(const std::string& val, bool allowNbsp)
+std::optional<uint16_t> BvbScraper::ParseYear(std::string_view val)
 {
-    size_t slash = 0;
+    uint16_t res = 0;
 
-    if (allowNbsp == true && val == "&nbsp;") {
-        return true;
+    auto [ptr, ec] = std::from_chars(val.data(), val.data() + val.size(), res);
+    if (val.empty() || ec != std::errc{} || ptr != val.data() + val.size()) {
+        return std::nullopt;
     }
 
-    for (char c : val) {
-        if (c == '/') {
-            slash++;
-        } else if (! std::isdigit(c)) {
-            return false;
-        }
+    return res;
+}
+
+std::optional<std::chrono::year_month_day> BvbScraper::ParseDate(
+    std::string_view val,
+    bool allowNbsp)
+{
+    uint8_t month = 0;
+    uint8_t day   = 0;
+    uint16_t year = 0;
+
+    if (allowNbsp == true && val == kNbsp) {
+        return ymd_tomorrow();
+    }
+
+    if (parse_mdy_date(val, month, day, year) == false) {
+        return std::nullopt;
     }
 
-    return slash == 2;
+    return std::chrono::year_month_day(
+        std::chrono::year(static_cast<int>(year)),
+        std::chrono::month(month),
+        std::chrono::day(day));
 }
 
 tl::expected<HttpResponse, Error> BvbScraper::SendHttpRequest(
-    const char* url,
-    const CurlHeaders& headers,
-    HttpMethod method,
-    HttpVersion version,
-    const PostData& postData)
+    const HttpRequest& req,
+    const HttpBodyCallback& bodyCallback)
 {
-    Error err = Error::NoError;
-    ScopedCurl curl;
-
-    if (! curl) {
+    if (! m_curl) {
         return tl::unexpected(Error::CurlInitError);
     }
 
-#define RETURN_IF_ERROR(func)                                                  \
-    err = func;                                                                \
-    if (err != Error::NoError) {                                               \
-        return tl::unexpected(err);                                            \
+    // The handle is shared by all the requests of the scraper, so the
+    // connection to the server is reused instead of being set up again.
+    Error err = m_curl.SetRequest(req);
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
+    }
+
+    auto rsp = bodyCallback ? m_curl.Perform(bodyCallback) : m_curl.Perform();
+    if (! rsp) {
+        return rsp;
+    }
+
+    if (rsp->code != 200) {
+        return tl::unexpected(Error::UnexpectedResponseCode);
     }
 
-    RETURN_IF_ERROR(curl.SetHttpMethod(method));
-    RETURN_IF_ERROR(curl.SetHttpVersion(version));
-    RETURN_IF_ERROR(curl.SetUrl(url));
-    RETURN_IF_ERROR(curl.SetEncoding("gzip"));
-    RETURN_IF_ERROR(curl.SetHeaders(headers));
+    return rsp;
+}
 
-    if (method == HttpMethod::post && postData.empty() == false) {
-        RETURN_IF_ERROR(curl.SetPostData(postData));
+std::string BvbScraper::GetUrl(std::string_view url) const
+{
+    if (m_baseUrl.empty()) {
+        return std::string(url);
     }
 
-#undef RETURN_IF_ERROR
+    size_t hostPos = url.find("://");
+    size_t pathPos =
+        url.find('/', hostPos == std::string_view::npos ? 0 : hostPos + 3);
+    if (pathPos == std::string_view::npos) {
+        return m_baseUrl;
+    }
 
-    return curl.Perform();
+    return m_baseUrl + std::string(url.substr(pathPos));
 }
 
-tl::expected<HttpResponse, Error> BvbScraper::GetInfoDividendPage()
+HttpRequest BvbScraper::GetInfoDividendPageRequest() const
 {
-    CurlHeaders headers;
-    Error err = Error::NoError;
+    HttpRequest req;
 
-    err = headers.Add({
+    req.url      = GetUrl(kInfoDividendUrl);
+    req.encoding = "gzip";
+    req.cacheTtl = kInfoDividendCacheTtl;
+    req.headers  = {
         "Host: bvb.ro",
         "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 "
         "Firefox/111.0",
@@ -594,31 +814,19 @@ tl::expected<HttpResponse, Error> BvbScraper::GetInfoDividendPage()
         "Sec-Fetch-User: ?1",
         "Pragma: no-cache",
         "Cache-Control: no-cache",
-    });
-    if (err != Error::NoError) {
-        return tl::unexpected(err);
-    }
-
-    auto rsp = SendHttpRequest(
-        "https://bvb.ro/FinancialInstruments/CorporateActions/InfoDividend",
-        headers);
-    if (! rsp) {
-        return rsp;
-    }
-
-    if (rsp->code != 200) {
-        return tl::unexpected(Error::UnexpectedResponseCode);
-    }
+    };
 
-    return rsp;
+    return req;
 }
 
-tl::expected<HttpResponse, Error> BvbScraper::GetIndicesProfilesPage()
+HttpRequest BvbScraper::GetIndicesProfilesPageRequest() const
 {
-    CurlHeaders headers;
-    Error err = Error::NoError;
+    HttpRequest req;
 
-    err = headers.Add({
+    req.url      = GetUrl(kIndicesProfilesUrl);
+    req.encoding = "gzip";
+    req.cacheTtl = kIndicesProfilesCacheTtl;
+    req.headers  = {
         "Host: m.bvb.ro",
         "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 "
         "Firefox/111.0",
@@ -635,33 +843,22 @@ tl::expected<HttpResponse, Error> BvbScraper::GetIndicesProfilesPage()
         "Sec-Fetch-User: ?1",
         "Pragma: no-cache",
         "Cache-Control: no-cache",
-    });
-    if (err != Error::NoError) {
-        return tl::unexpected(err);
-    }
-
-    auto rsp = SendHttpRequest(
-        "https://m.bvb.ro/FinancialInstruments/Indices/IndicesProfiles",
-        headers);
-    if (! rsp) {
-        return rsp;
-    }
-
-    if (rsp->code != 200) {
-        return tl::unexpected(Error::UnexpectedResponseCode);
-    }
+    };
 
-    return rsp;
+    return req;
 }
 
-tl::expected<HttpResponse, Error> BvbScraper::SelectIndex(
+HttpRequest BvbScraper::GetSelectIndexRequest(
     const IndexName& name,
-    const RequestData& reqData)
+    const RequestData& reqData) const
 {
-    CurlHeaders headers;
-    Error err = Error::NoError;
+    HttpRequest req;
 
-    PostData postData = {
+    req.url      = GetUrl(kIndicesProfilesUrl);
+    req.method   = HttpMethod::post;
+    req.encoding = "gzip";
+    req.cacheTtl = kConstituentsCacheTtl;
+    req.postData = {
         {"ctl00$ctl00$MasterScriptManager",
          "ctl00$ctl00$MasterScriptManager|ctl00$ctl00$body$"
          "rightColumnPlaceHolder$IndexProfilesCurrentValues$IndexControlList$"
@@ -682,8 +879,7 @@ tl::expected<HttpResponse, Error> BvbScraper::SelectIndex(
         {"gvC_length", "10"},
         {"__ASYNCPOST", "true"},
     };
-
-    err = headers.Add({
+    req.headers  = {
         "Host: m.bvb.ro",
         "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 "
         "Firefox/111.0",
@@ -700,36 +896,22 @@ tl::expected<HttpResponse, Error> BvbScraper::SelectIndex(
         "Sec-Fetch-Dest: empty",
         "Sec-Fetch-Mode: cors",
         "Sec-Fetch-Site: same-origin",
-    });
-    if (err != Error::NoError) {
-        return tl::unexpected(err);
-    }
-
-    auto rsp = SendHttpRequest(
-        "https://m.bvb.ro/FinancialInstruments/Indices/IndicesProfiles",
-        headers,
-        HttpMethod::post,
-        HttpVersion::http1_1,
-        postData);
-    if (! rsp) {
-        return rsp;
-    }
-
-    if (rsp->code != 200) {
-        return tl::unexpected(Error::UnexpectedResponseCode);
-    }
+    };
 
-    return rsp;
+    return req;
 }
 
-tl::expected<HttpResponse, Error> BvbScraper::SelectAdjustmentsHistory(
+HttpRequest BvbScraper::GetSelectAdjustmentsHistoryRequest(
     const IndexName& name,
-    const RequestData& reqData)
+    const RequestData& reqData) const
 {
-    CurlHeaders headers;
-    Error err = Error::NoError;
+    HttpRequest req;
 
-    PostData postData = {
+    req.url      = GetUrl(kIndicesProfilesUrl);
+    req.method   = HttpMethod::post;
+    req.encoding = "gzip";
+    req.cacheTtl = kAdjustmentsHistoryCacheTtl;
+    req.postData = {
         {"ctl00$ctl00$MasterScriptManager",
          "ctl00$ctl00$body$rightColumnPlaceHolder$TabsControl$uptabslist|ctl00$"
          "ctl00$body$rightColumnPlaceHolder$TabsControl$lb5"},
@@ -748,8 +930,7 @@ tl::expected<HttpResponse, Error> BvbScraper::SelectAdjustmentsHistory(
         {"gvC_length", "10"},
         {"__ASYNCPOST", "true"},
     };
-
-    err = headers.Add({
+    req.headers  = {
         "Host: m.bvb.ro",
         "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 "
         "Firefox/111.0",
@@ -766,36 +947,22 @@ tl::expected<HttpResponse, Error> BvbScraper::SelectAdjustmentsHistory(
         "Sec-Fetch-Dest: empty",
         "Sec-Fetch-Mode: cors",
         "Sec-Fetch-Site: same-origin",
-    });
-    if (err != Error::NoError) {
-        return tl::unexpected(err);
-    }
-
-    auto rsp = SendHttpRequest(
-        "https://m.bvb.ro/FinancialInstruments/Indices/IndicesProfiles",
-        headers,
-        HttpMethod::post,
-        HttpVersion::http1_1,
-        postData);
-    if (! rsp) {
-        return rsp;
-    }
-
-    if (rsp->code != 200) {
-        return tl::unexpected(Error::UnexpectedResponseCode);
-    }
+    };
 
-    return rsp;
+    return req;
 }
 
-tl::expected<HttpResponse, Error> BvbScraper::SelectTradingData(
+HttpRequest BvbScraper::GetSelectTradingDataRequest(
     const IndexName& name,
-    const RequestData& reqData)
+    const RequestData& reqData) const
 {
-    CurlHeaders headers;
-    Error err = Error::NoError;
+    HttpRequest req;
 
-    PostData postData = {
+    req.url      = GetUrl(kIndicesProfilesUrl);
+    req.method   = HttpMethod::post;
+    req.encoding = "gzip";
+    req.cacheTtl = kTradingDataCacheTtl;
+    req.postData = {
         {"ctl00$ctl00$MasterScriptManager",
          "ctl00$ctl00$body$rightColumnPlaceHolder$TabsControl$upMob|ctl00$"
          "ctl00$body$rightColumnPlaceHolder$TabsControl$lb1"},
@@ -814,155 +981,464 @@ tl::expected<HttpResponse, Error> BvbScraper::SelectTradingData(
         {"__EVENTVALIDATION", reqData.eventValidation},
         {"__ASYNCPOST", "true"},
     };
+    req.headers  = {
+        "Host: m.bvb.ro",
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 "
+        "Firefox/111.0",
+        "Accept: */*",
+        "Accept-Language: en-US,en;q=0.5",
+        "Referer: "
+        "https://m.bvb.ro/FinancialInstruments/Indices/IndicesProfiles",
+        "Cookie: MobBVBCulturePref=en-US",
+        "X-Requested-With: XMLHttpRequest",
+        "X-MicrosoftAjax: Delta=true",
+        "Cache-Control: no-cache",
+        "Content-Type: application/x-www-form-urlencoded; charset=utf-8",
+        "Origin: https://m.bvb.ro",
+        "Sec-Fetch-Dest: empty",
+        "Sec-Fetch-Mode: cors",
+        "Sec-Fetch-Site: same-origin",
+    };
+
+    return req;
+}
+
+Error BvbScraper::LoadSession()
+{
+    if (m_session.valid) {
+        return Error::NoError;
+    }
+
+    auto rsp = SendHttpRequest(GetIndicesProfilesPageRequest());
+    if (! rsp) {
+        return rsp.error();
+    }
+
+    Error err = LoadSession(std::move(rsp->body), m_session);
+    if (err != Error::NoError) {
+        RemoveCachedResponse(rsp->cacheKey);
+    }
+
+    return err;
+}
+
+Error BvbScraper::LoadSession(std::string&& mainPage, Session& session)
+{
+    session = {};
+
+    auto indexesDetails = ParseIndexesNames(mainPage);
+    if (! indexesDetails) {
+        return indexesDetails.error();
+    }
+
+    auto reqData = ParseRequestDataFromMainPage(mainPage);
+    if (! reqData) {
+        return reqData.error();
+    }
+
+    session.mainPage = std::move(mainPage);
+    session.details  = std::move(*indexesDetails);
+    session.selected = session.details.selected;
+    session.reqData  = std::move(*reqData);
+    session.valid    = true;
+
+    return Error::NoError;
+}
+
+// Returns chain with the cached responses of its requests refreshed.
+static HttpRequestChain RefreshingCache(HttpRequestChain chain)
+{
+    return [chain = std::move(chain)](HttpResponse* rsp)
+               -> tl::expected<std::optional<HttpRequest>, Error> {
+        auto req = chain(rsp);
+        if (req && *req) {
+            (*req)->refreshCache = true;
+        }
+
+        return req;
+    };
+}
+
+Error BvbScraper::PerformIndexPageChain(
+    const IndexName& name,
+    IndexPage page,
+    std::string& body,
+    std::string& cacheKey)
+{
+    bool reused = m_session.valid || m_cache != nullptr;
+
+    Error err = m_curl.PerformChain(
+        GetIndexPageChain(name, page, body, &m_session, &cacheKey));
+    if (err != Error::NoError && reused) {
+        // the server may have dropped the form state of the session, so
+        // start over from the landing page. The http cache would serve the
+        // same form state again, the responses are downloaded instead.
+        m_session = {};
+        err       = m_curl.PerformChain(RefreshingCache(
+            GetIndexPageChain(name, page, body, &m_session, &cacheKey)));
+    }
+    if (err != Error::NoError) {
+        m_session = {};
+    }
+
+    return err;
+}
+
+HttpRequestChain BvbScraper::GetIndexPageChain(
+    const IndexName& name,
+    IndexPage page,
+    std::string& body,
+    Session* session,
+    std::string* cacheKey)
+{
+    enum class Step
+    {
+        Start,
+        IndicesProfilesPage,
+        SelectIndex,
+        SelectPage,
+    };
+
+    // The ViewState of every request comes from the response to the previous
+    // one, so the requests of a chain are dependent and sent in order. When
+    // session is given, the chain starts from its state and keeps it up to
+    // date, otherwise the chain has a session of its own.
+    return [this,
+            name,
+            page,
+            &body,
+            session,
+            cacheKey,
+            ownSession = Session{},
+            step       = Step::Start](HttpResponse* rsp) mutable
+           -> tl::expected<std::optional<HttpRequest>, Error> {
+        Session& s = session != nullptr ? *session : ownSession;
+
+        if (rsp != nullptr && rsp->code != 200) {
+            return tl::unexpected(Error::UnexpectedResponseCode);
+        }
+
+        switch (step) {
+        case Step::Start:
+            if (! s.valid) {
+                step = Step::IndicesProfilesPage;
+                return GetIndicesProfilesPageRequest();
+            }
+            break;
+
+        case Step::IndicesProfilesPage: {
+            Error err = LoadSession(std::move(rsp->body), s);
+            if (err != Error::NoError) {
+                return tl::unexpected(err);
+            }
+            break;
+        }
+
+        case Step::SelectIndex:
+        case Step::SelectPage:
+        default: {
+            // every postback response carries the form state for the next one
+            auto postRspData = ParseRequestDataFromPostRsp(rsp->body);
+            if (postRspData) {
+                s.reqData  = std::move(*postRspData);
+                s.selected = name;
+            } else {
+                s.valid = false;
+            }
+
+            if (step == Step::SelectPage || page == IndexPage::Constituents) {
+                body = std::move(rsp->body);
+                if (cacheKey != nullptr) {
+                    *cacheKey = std::move(rsp->cacheKey);
+                }
+                return std::nullopt;
+            }
+
+            if (! postRspData) {
+                return tl::unexpected(postRspData.error());
+            }
+            break;
+        }
+        }
+
+        auto it =
+            std::find(s.details.names.begin(), s.details.names.end(), name);
+        if (it == s.details.names.end()) {
+            return tl::unexpected(Error::InvalidArg);
+        }
+
+        // the constituents of the index selected in the landing page are in
+        // the page already
+        if (page == IndexPage::Constituents && s.details.selected == name) {
+            body = s.mainPage;
+            if (cacheKey != nullptr) {
+                cacheKey->clear();
+            }
+            return std::nullopt;
+        }
+
+        if (page == IndexPage::Constituents || s.selected != name) {
+            step = Step::SelectIndex;
+            return GetSelectIndexRequest(name, s.reqData);
+        }
+
+        step = Step::SelectPage;
+        return page == IndexPage::AdjustmentsHistory
+            ? GetSelectAdjustmentsHistoryRequest(name, s.reqData)
+            : GetSelectTradingDataRequest(name, s.reqData);
+    };
+}
 
-    err = headers.Add({
-        "Host: m.bvb.ro",
-        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 "
-        "Firefox/111.0",
-        "Accept: */*",
-        "Accept-Language: en-US,en;q=0.5",
-        "Referer: "
-        "https://m.bvb.ro/FinancialInstruments/Indices/IndicesProfiles",
-        "Cookie: MobBVBCulturePref=en-US",
-        "X-Requested-With: XMLHttpRequest",
-        "X-MicrosoftAjax: Delta=true",
-        "Cache-Control: no-cache",
-        "Content-Type: application/x-www-form-urlencoded; charset=utf-8",
-        "Origin: https://m.bvb.ro",
-        "Sec-Fetch-Dest: empty",
-        "Sec-Fetch-Mode: cors",
-        "Sec-Fetch-Site: same-origin",
-    });
-    if (err != Error::NoError) {
-        return tl::unexpected(err);
-    }
+template <typename Result, typename Parse>
+std::vector<tl::expected<Result, Error>> BvbScraper::GetIndexesPages(
+    const IndexesNames& names,
+    IndexPage page,
+    size_t maxConnections,
+    const Parse& parse)
+{
+    std::vector<std::string> bodies(names.size());
+    std::vector<std::string> cacheKeys(names.size());
+    std::vector<tl::expected<Result, Error>> res;
+    CurlMulti multi;
 
-    auto rsp = SendHttpRequest(
-        "https://m.bvb.ro/FinancialInstruments/Indices/IndicesProfiles",
-        headers,
-        HttpMethod::post,
-        HttpVersion::http1_1,
-        postData);
-    if (! rsp) {
-        return rsp;
+    multi.SetCache(m_cache.get());
+    multi.SetArchive(m_archive);
+    for (size_t i = 0; i < names.size(); i++) {
+        multi.Add(GetIndexPageChain(
+            names[i], page, bodies[i], nullptr, &cacheKeys[i]));
     }
 
-    if (rsp->code != 200) {
-        return tl::unexpected(Error::UnexpectedResponseCode);
+    std::vector<Error> errors = multi.Perform(maxConnections);
+
+    res.reserve(names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        if (errors[i] != Error::NoError) {
+            res.emplace_back(tl::unexpected(errors[i]));
+            continue;
+        }
+
+        res.emplace_back(parse(bodies[i], names[i]));
+        if (! res.back()) {
+            RemoveCachedResponse(cacheKeys[i]);
+        }
     }
 
-    return rsp;
+    return res;
 }
 
-tl::expected<std::string_view, Error> BvbScraper::
-    ParseRequestDataFieldFromMainPage(
-        const std::string& data,
-        std::string_view id)
+void BvbScraper::RemoveCachedResponse(const std::string& cacheKey)
 {
-    static constexpr std::string_view kValueTag = "value=\"";
-    static constexpr char kValueEndTag          = '\"';
+    if (m_cache != nullptr && ! cacheKey.empty()) {
+        m_cache->Remove(cacheKey);
+    }
+}
 
-    HtmlParser html(data);
+BvbScraper::RequestDataFields BvbScraper::GetRequestDataFields(
+    RequestData& reqData)
+{
+    return {{
+        {"__EVENTTARGET", &reqData.eventTarget},
+        {"__EVENTARGUMENT", &reqData.eventArg},
+        {"__EVENTVALIDATION", &reqData.eventValidation},
+        {"__LASTFOCUS", &reqData.lastFocus},
+        {"__VIEWSTATE", &reqData.viewState},
+        {"__VIEWSTATEGENERATOR", &reqData.viewStateGenerator},
+        {"__VIEWSTATEENCRYPTED", &reqData.viewStateEncrypted},
+    }};
+}
 
-    auto inputLocation =
-        html.FindElement(HtmlTag::Input, {}, HtmlAttribute::Id, id);
-    if (! inputLocation) {
-        return tl::unexpected(inputLocation.error());
-    }
+tl::expected<std::string_view, Error> BvbScraper::GetInputAttribute(
+    std::string_view beginTag,
+    std::string_view name)
+{
+    size_t pos = 0;
 
-    std::string_view beginTag(
-        data.c_str() + inputLocation->beginTag.Lower(),
-        inputLocation->beginTag.Size());
+    while ((pos = beginTag.find(name, pos)) != std::string_view::npos) {
+        size_t valueStartPos = pos + name.size();
+        bool isAttribute     = pos > 0 && std::isspace(beginTag[pos - 1]);
 
-    size_t valueStartPos = beginTag.find(kValueTag);
-    if (valueStartPos == std::string_view::npos) {
-        return tl::unexpected(Error::InvalidHtmlElement);
-    }
-    valueStartPos += kValueTag.size();
+        pos = valueStartPos;
+        if (! isAttribute || beginTag.substr(valueStartPos, 2) != "=\"") {
+            continue;
+        }
 
-    size_t valueEndPos = beginTag.find(kValueEndTag, valueStartPos);
-    if (valueEndPos == std::string_view::npos) {
-        return tl::unexpected(Error::InvalidHtmlElement);
+        valueStartPos += 2;
+        size_t valueEndPos = beginTag.find('\"', valueStartPos);
+        if (valueEndPos == std::string_view::npos) {
+            return tl::unexpected(Error::InvalidHtmlElement);
+        }
+
+        return beginTag.substr(valueStartPos, valueEndPos - valueStartPos);
     }
 
-    return std::string_view(
-        data.c_str() + inputLocation->beginTag.Lower() + valueStartPos,
-        valueEndPos - valueStartPos);
+    return tl::unexpected(Error::InvalidHtmlElement);
 }
 
 tl::expected<BvbScraper::RequestData, Error> BvbScraper::
     ParseRequestDataFromMainPage(const std::string& data)
 {
+    static constexpr std::string_view kInputBeginMark = "<input";
+    static constexpr std::string_view kInputEndMark   = "/>";
+
     RequestData reqData;
-    tl::expected<std::string_view, Error> fieldValue;
+    RequestDataFields fields = GetRequestDataFields(reqData);
+    std::array<bool, std::tuple_size_v<RequestDataFields>> found = {};
+    size_t numOfFound = 0;
+    size_t pos        = 0;
+
+    // the hidden inputs are visited in a single pass and every input is
+    // skipped as a whole, so the ViewState blob is not searched again
+    while (numOfFound < fields.size()) {
+        size_t beginPos = data.find(kInputBeginMark, pos);
+        if (beginPos == std::string::npos) {
+            return tl::unexpected(Error::HtmlElementNotFound);
+        }
+
+        size_t endPos = data.find(kInputEndMark, beginPos);
+        if (endPos == std::string::npos) {
+            return tl::unexpected(Error::IncompleteHtmlElement);
+        }
+
+        std::string_view beginTag(data.c_str() + beginPos, endPos - beginPos);
+        pos = endPos + kInputEndMark.size();
+
+        auto id = GetInputAttribute(beginTag, "id");
+        if (! id) {
+            continue;
+        }
 
-#define PARSE_FIELD_OR_RETURN_IF_ERROR(field, id)                              \
-    fieldValue = ParseRequestDataFieldFromMainPage(data, id);                  \
-    if (! fieldValue) {                                                        \
-        return tl::unexpected(fieldValue.error());                             \
-    }                                                                          \
-    reqData.field = *fieldValue;
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (found[i] || fields[i].first != *id) {
+                continue;
+            }
 
-    PARSE_FIELD_OR_RETURN_IF_ERROR(eventTarget, "__EVENTTARGET");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(eventArg, "__EVENTARGUMENT");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(eventValidation, "__EVENTVALIDATION");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(lastFocus, "__LASTFOCUS");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(viewState, "__VIEWSTATE");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(viewStateGenerator, "__VIEWSTATEGENERATOR");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(viewStateEncrypted, "__VIEWSTATEENCRYPTED");
+            auto value = GetInputAttribute(beginTag, "value");
+            if (! value) {
+                return tl::unexpected(value.error());
+            }
 
-#undef PARSE_FIELD_OR_RETURN_IF_ERROR
+            *fields[i].second = *value;
+            found[i]          = true;
+            numOfFound++;
+            break;
+        }
+    }
 
     return reqData;
 }
 
-tl::expected<std::string_view, Error> BvbScraper::
-    ParseRequestDataFieldFromPostRsp(
-        const std::string& data,
-        std::string_view id)
+// The length of an ASP.NET delta record is in UTF-16 code units. Returns the
+// size in bytes of the UTF-8 text at pos which holds that many units, or npos
+// if the data ends before.
+static size_t Utf16UnitsToBytes(
+    std::string_view data,
+    size_t pos,
+    size_t units)
 {
-    size_t idStartPos = data.find(id);
-    if (idStartPos == std::string::npos) {
-        return tl::unexpected(Error::NoData);
-    }
+    static constexpr uint64_t kNonAsciiMask = 0x8080808080808080ull;
+
+    size_t start = pos;
+    while (units > 0) {
+        // most of the content is ASCII, skipped 8 bytes at a time
+        uint64_t word = 0;
+        if (units >= sizeof(word) && data.size() - pos >= sizeof(word)) {
+            std::memcpy(&word, data.data() + pos, sizeof(word));
+            if ((word & kNonAsciiMask) == 0) {
+                pos   += sizeof(word);
+                units -= sizeof(word);
+                continue;
+            }
+        }
 
-    size_t dataStartPos = idStartPos + id.size();
-    size_t dataEndPos   = data.find('|', dataStartPos);
-    if (dataEndPos == std::string::npos) {
-        return tl::unexpected(Error::InvalidData);
+        if (pos >= data.size()) {
+            return std::string_view::npos;
+        }
+
+        // a character outside the basic plane is a surrogate pair
+        unsigned char lead = data[pos];
+        size_t bytes       = 1;
+        if (lead >= 0xF0) {
+            bytes = 4;
+        } else if (lead >= 0xE0) {
+            bytes = 3;
+        } else if (lead >= 0xC0) {
+            bytes = 2;
+        }
+
+        size_t charUnits = bytes == 4 ? 2 : 1;
+        if (charUnits > units || bytes > data.size() - pos) {
+            return std::string_view::npos;
+        }
+
+        pos   += bytes;
+        units -= charUnits;
     }
 
-    return std::string_view(
-        data.c_str() + dataStartPos,
-        dataEndPos - dataStartPos);
+    return pos - start;
 }
 
 tl::expected<BvbScraper::RequestData, Error> BvbScraper::
     ParseRequestDataFromPostRsp(const std::string& data)
 {
+    static constexpr char kSeparator = '|';
+
     RequestData reqData;
-    tl::expected<std::string_view, Error> fieldValue;
-
-#define PARSE_FIELD_OR_RETURN_IF_ERROR(field, id)                              \
-    fieldValue = ParseRequestDataFieldFromPostRsp(data, id);                   \
-    if (! fieldValue) {                                                        \
-        return tl::unexpected(fieldValue.error());                             \
-    }                                                                          \
-    reqData.field = *fieldValue;
-
-    PARSE_FIELD_OR_RETURN_IF_ERROR(eventTarget, "|__EVENTTARGET|");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(eventArg, "|__EVENTARGUMENT|");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(eventValidation, "|__EVENTVALIDATION|");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(lastFocus, "|__LASTFOCUS|");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(viewState, "|__VIEWSTATE|");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(
-        viewStateGenerator,
-        "|__VIEWSTATEGENERATOR|");
-    PARSE_FIELD_OR_RETURN_IF_ERROR(
-        viewStateEncrypted,
-        "|__VIEWSTATEENCRYPTED|");
-
-#undef PARSE_FIELD_OR_RETURN_IF_ERROR
+    RequestDataFields fields = GetRequestDataFields(reqData);
+    std::array<bool, std::tuple_size_v<RequestDataFields>> found = {};
+    size_t numOfFound = 0;
+    size_t pos        = 0;
+
+    // The response is a sequence of "length|type|id|content|" records. The
+    // content of every record is skipped by its length, so the ViewState
+    // blob is not searched for separators.
+    while (numOfFound < fields.size() && pos < data.size()) {
+        size_t lengthEndPos = data.find(kSeparator, pos);
+        size_t typeEndPos   = lengthEndPos == std::string::npos
+                                  ? std::string::npos
+                                  : data.find(kSeparator, lengthEndPos + 1);
+        size_t idEndPos     = typeEndPos == std::string::npos
+                                  ? std::string::npos
+                                  : data.find(kSeparator, typeEndPos + 1);
+        if (idEndPos == std::string::npos) {
+            return tl::unexpected(Error::InvalidData);
+        }
+
+        size_t length = 0;
+        auto [ptr, ec] = std::from_chars(
+            data.c_str() + pos,
+            data.c_str() + lengthEndPos,
+            length);
+        if (ec != std::errc{} || ptr != data.c_str() + lengthEndPos) {
+            return tl::unexpected(Error::InvalidData);
+        }
+
+        size_t contentPos  = idEndPos + 1;
+        size_t contentSize = Utf16UnitsToBytes(data, contentPos, length);
+        if (contentSize >= data.size() - contentPos ||
+            data[contentPos + contentSize] != kSeparator) {
+            return tl::unexpected(Error::InvalidData);
+        }
+
+        std::string_view id(
+            data.c_str() + typeEndPos + 1,
+            idEndPos - typeEndPos - 1);
+        pos = contentPos + contentSize + 1;
+
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (found[i] || fields[i].first != id) {
+                continue;
+            }
+
+            fields[i].second->assign(data, contentPos, contentSize);
+            found[i] = true;
+            numOfFound++;
+            break;
+        }
+    }
+
+    if (numOfFound < fields.size()) {
+        return tl::unexpected(Error::NoData);
+    }
 
     return reqData;
 }
@@ -1019,9 +1495,10 @@ tl::expected<std::string_view, Error> BvbScraper::ParseTradingDataTime(
         endMarkPos - beginMarkPos - numOfSpaces};
 }
 
-template <typename Table, typename Entry>
+template <typename Table, typename Entry, typename... Columns>
 tl::expected<Table, Error> BvbScraper::ParseTable(
-    const std::vector<TableColumnDetails<Entry>>& columns,
+    const TableSchema<Columns...>& columns,
+    HtmlParser& html,
     const std::string& data,
     ClosedInterval ci,
     HtmlAttribute attr,
@@ -1029,7 +1506,6 @@ tl::expected<Table, Error> BvbScraper::ParseTable(
     AddEntryToTable<Table, Entry> addFunc)
 {
     Table table;
-    HtmlParser html(data);
 
     auto tableLocation = html.FindElement(HtmlTag::Table, ci, attr, attrValue);
     if (! tableLocation) {
@@ -1046,22 +1522,9 @@ tl::expected<Table, Error> BvbScraper::ParseTable(
         return tl::unexpected(trLocation.error());
     }
 
-    auto thLocations = html.FindAllElements(HtmlTag::Th, trLocation->data);
-    if (! thLocations) {
-        return tl::unexpected(thLocations.error());
-    }
-
-    if (thLocations->size() != columns.size()) {
-        return tl::unexpected(Error::UnexpectedData);
-    }
-
-    for (size_t i = 0; i < columns.size(); i++) {
-        std::string_view val(
-            data.c_str() + (*thLocations)[i].data.Lower(),
-            (*thLocations)[i].data.Size());
-        if (val != columns[i].name) {
-            return tl::unexpected(Error::InvalidData);
-        }
+    Error err = CheckTableHeader(columns, html, data, trLocation->data);
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
     }
 
     auto tbodyLocation = html.FindElement(HtmlTag::Tbody, tableLocation->data);
@@ -1074,115 +1537,289 @@ tl::expected<Table, Error> BvbScraper::ParseTable(
         return tl::unexpected(trLocations.error());
     }
 
-    for (const auto& loc : *trLocations) {
-        auto tdLocations = html.FindAllElements(HtmlTag::Td, loc.data);
-        if (! tdLocations) {
-            return tl::unexpected(tdLocations.error());
-        }
+    auto entries = DecodeRows<Entry>(
+        *trLocations,
+        kMinTableRowsPerThread,
+        [&](const HtmlElementLocation& loc) {
+            return ParseTableRow<Entry>(columns, html, data, loc.data);
+        });
+    if (! entries) {
+        return tl::unexpected(entries.error());
+    }
 
-        if (tdLocations->size() != columns.size()) {
-            return tl::unexpected(Error::UnexpectedData);
+    for (auto& entry : *entries) {
+        addFunc(table, std::move(entry));
+    }
+
+    return table;
+}
+
+template <typename Row, typename Decoder>
+tl::expected<std::vector<Row>, Error> BvbScraper::DecodeRows(
+    const HtmlElementLocations& rows,
+    size_t minRowsPerThread,
+    const Decoder& decoder)
+{
+    // the tables nested in a row being decoded by a worker are decoded on
+    // the same worker
+    size_t threads = t_decodingRows ? 1 : m_parseThreads;
+    threads = std::min(threads, rows.size() / minRowsPerThread);
+
+    if (threads < 2) {
+        std::vector<Row> res;
+        res.reserve(rows.size());
+
+        for (const auto& loc : rows) {
+            auto row = decoder(loc);
+            if (! row) {
+                return tl::unexpected(row.error());
+            }
+
+            res.push_back(std::move(*row));
         }
 
-        Entry entry;
+        return res;
+    }
+
+    // every worker decodes a contiguous slice and stops at its first error,
+    // so the first error in slice order is the first one in the page
+    std::vector<std::vector<Row>> slices(threads);
+    std::vector<Error> errors(threads, Error::NoError);
+    const size_t sliceSize = (rows.size() + threads - 1) / threads;
+
+    {
+        std::vector<std::jthread> workers;
+        workers.reserve(threads);
+
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                size_t begin = t * sliceSize;
+                size_t end   = std::min(begin + sliceSize, rows.size());
 
-        for (size_t i = 0; i < tdLocations->size(); i++) {
-            std::string val;
-            if (columns[i].innerTag != HtmlTag::None) {
-                auto innerLocation = html.FindElement(
-                    columns[i].innerTag,
-                    (*tdLocations)[i].data);
-                if (! innerLocation) {
-                    return tl::unexpected(innerLocation.error());
+                t_decodingRows = true;
+                slices[t].reserve(end - begin);
+
+                for (size_t i = begin; i < end; i++) {
+                    auto row = decoder(rows[i]);
+                    if (! row) {
+                        errors[t] = row.error();
+                        return;
+                    }
+
+                    slices[t].push_back(std::move(*row));
                 }
+            });
+        }
+    }
 
-                val = data.substr(
-                    innerLocation->data.Lower(),
-                    innerLocation->data.Size());
-            } else {
-                val = data.substr(
-                    (*tdLocations)[i].data.Lower(),
-                    (*tdLocations)[i].data.Size());
-            }
+    std::vector<Row> res;
+    res.reserve(rows.size());
 
-            if (! columns[i].validator(val)) {
-                return tl::unexpected(Error::InvalidValue);
-            }
+    for (size_t t = 0; t < threads; t++) {
+        if (errors[t] != Error::NoError) {
+            return tl::unexpected(errors[t]);
+        }
+
+        std::move(slices[t].begin(), slices[t].end(), std::back_inserter(res));
+    }
+
+    return res;
+}
+
+template <typename... Columns>
+Error BvbScraper::CheckTableHeader(
+    const TableSchema<Columns...>& columns,
+    HtmlParser& html,
+    const std::string& data,
+    ClosedInterval ci)
+{
+    const std::array<std::string_view, sizeof...(Columns)> names = std::apply(
+        [](const auto&... column) {
+            return std::array<std::string_view, sizeof...(Columns)>{
+                column.name...};
+        },
+        columns);
+
+    auto thLocations = html.FindAllElements(HtmlTag::Th, ci);
+    if (! thLocations) {
+        return thLocations.error();
+    }
+
+    if (thLocations->size() != names.size()) {
+        return Error::UnexpectedData;
+    }
 
-            columns[i].setter(entry, val);
+    for (size_t i = 0; i < names.size(); i++) {
+        std::string_view val(
+            data.c_str() + (*thLocations)[i].data.Lower(),
+            (*thLocations)[i].data.Size());
+        if (val != names[i]) {
+            return Error::InvalidData;
         }
+    }
 
-        addFunc(table, std::move(entry));
+    return Error::NoError;
+}
+
+template <typename Entry, typename... Columns>
+tl::expected<Entry, Error> BvbScraper::ParseTableRow(
+    const TableSchema<Columns...>& columns,
+    HtmlParser& html,
+    const std::string& data,
+    ClosedInterval ci)
+{
+    HtmlElementLocations& tdLocations = t_cellLocations;
+
+    Error err = html.FindAllElements(tdLocations, HtmlTag::Td, ci);
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
     }
 
-    return table;
+    if (tdLocations.size() != sizeof...(Columns)) {
+        return tl::unexpected(Error::UnexpectedData);
+    }
+
+    Entry entry;
+
+    // the cells are decoded in column order, up to the first error
+    [&]<size_t... I>(std::index_sequence<I...>) {
+        ((err = ParseTableCell(
+              std::get<I>(columns),
+              html,
+              data,
+              tdLocations[I].data,
+              entry),
+          err == Error::NoError) &&
+         ...);
+    }(std::index_sequence_for<Columns...>{});
+
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
+    }
+
+    return entry;
 }
 
-tl::expected<DividendActivities, Error> BvbScraper::ParseDividendActivities(
-    const std::string& data)
+template <typename Entry, typename Column>
+Error BvbScraper::ParseTableCell(
+    const Column& column,
+    HtmlParser& html,
+    const std::string& data,
+    ClosedInterval ci,
+    Entry& entry)
 {
-    static constexpr std::string_view kDivId =
-        "ctl00_ctl00_body_rightColumnPlaceHolder_UpdatePanel1";
-    static constexpr std::string_view kTableId = "gv";
+    if (column.innerTag != HtmlTag::None) {
+        auto innerLocation = html.FindElement(column.innerTag, ci);
+        if (! innerLocation) {
+            return innerLocation.error();
+        }
 
-    HtmlParser html(data);
+        ci = innerLocation->data;
+    }
+
+    std::string_view val(data.c_str() + ci.Lower(), ci.Size());
+
+    auto value = column.decoder(val);
+    if (! value) {
+        return Error::InvalidValue;
+    }
+
+    entry.*column.field = std::move(*value);
+
+    return Error::NoError;
+}
 
-    DEF_SETTER(DividendActivity, symbol, NO_FUNC);
-    DEF_SETTER(DividendActivity, name, NO_FUNC);
-    DEF_SETTER(DividendActivity, dvd_value, std::stod);
-    DEF_SETTER(DividendActivity, dvd_yield, NBSP_OR_DOUBLE_FUNC);
-    DEF_SETTER(DividendActivity, ex_dvd_date, StringToDate);
-    DEF_SETTER(DividendActivity, payment_date, NBSP_OR_DATE_FUNC);
-    DEF_SETTER(DividendActivity, year, StringToU16);
-    DEF_SETTER(DividendActivity, record_date, StringToDate);
-    DEF_SETTER(DividendActivity, dvd_total_value, NBSP_OR_SDOUBLE_FUNC);
-
-    TableValueValidator isValidSymbol = [this](const std::string& val) -> bool {
-        std::string clean_val = val;
-        std::erase_if(clean_val, [](char c) { return std::isspace(c); });
-        return this->IsValidCompanySymbol(clean_val);
+auto BvbScraper::GetDividendActivitiesColumns()
+{
+    // the symbol is wrapped in whitespace inside the cell, it is dropped
+    // while the symbol is checked against the IsValidCompanySymbol rules
+    auto parseSymbol = [](std::string_view val) -> std::optional<std::string> {
+        std::string symbol;
+        for (char c : val) {
+            if (std::isspace(c)) {
+                continue;
+            }
+            if (! std::isupper(c) && ! std::isdigit(c)) {
+                return std::nullopt;
+            }
+            symbol.push_back(c);
+        }
+        if (symbol.empty()) {
+            return std::nullopt;
+        }
+        return symbol;
     };
-    TableValueValidator isValidName = [this](const std::string& val) -> bool {
-        return this->IsValidCompanyName(val);
+    auto parseName =
+        [this](std::string_view val) -> std::optional<std::string> {
+        if (! this->IsValidCompanyName(val)) {
+            return std::nullopt;
+        }
+        return std::string(val);
+    };
+    auto parseDvd = [this](std::string_view val) {
+        return this->ParseDouble(val, 6, false, false, false);
     };
-    TableValueValidator isValidDvd = [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 6, false, false, false);
+    auto parseDvdYield = [this](std::string_view val) {
+        return this->ParseDouble(val, 2, false, false, true);
     };
-    TableValueValidator isValidDvdYield =
-        [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 2, false, false, true);
+    auto parseDvdTotal = [this](std::string_view val) {
+        return this->ParseDouble(val, 2, false, true, true);
     };
-    TableValueValidator isValidDvdTotal =
-        [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 2, false, true, true);
+    auto parseYear = [this](std::string_view val) {
+        return this->ParseYear(val);
     };
-    TableValueValidator isValidYear = [this](const std::string& val) -> bool {
-        return this->IsValidNumber(val);
+    auto parseDate = [this](std::string_view val) {
+        return this->ParseDate(val, false);
     };
-    TableValueValidator isValidDate = [this](const std::string& val) -> bool {
-        return this->IsValidDate(val, false);
+    auto parsePaymentDate = [this](std::string_view val) {
+        return this->ParseDate(val, true);
     };
-    TableValueValidator isValidPaymentDate =
-        [this](const std::string& val) -> bool {
-        return this->IsValidDate(val, true);
+
+    return std::tuple{
+        TableColumn{
+            "Symbol / ISIN",
+            &DividendActivity::symbol,
+            parseSymbol,
+            HtmlTag::Strong},
+        TableColumn{"Company", &DividendActivity::name, parseName},
+        TableColumn{"Dividend", &DividendActivity::dvd_value, parseDvd},
+        TableColumn{"DIVY", &DividendActivity::dvd_yield, parseDvdYield},
+        TableColumn{
+            "Ex-dividend Date",
+            &DividendActivity::ex_dvd_date,
+            parseDate},
+        TableColumn{
+            "Payment date",
+            &DividendActivity::payment_date,
+            parsePaymentDate},
+        TableColumn{"Year", &DividendActivity::year, parseYear},
+        TableColumn{
+            "Registration Date",
+            &DividendActivity::record_date,
+            parseDate},
+        TableColumn{
+            "Dividends Total",
+            &DividendActivity::dvd_total_value,
+            parseDvdTotal},
     };
+}
+
+tl::expected<DividendActivities, Error> BvbScraper::ParseDividendActivities(
+    const std::string& data)
+{
+    static constexpr std::string_view kDivId =
+        "ctl00_ctl00_body_rightColumnPlaceHolder_UpdatePanel1";
+    static constexpr std::string_view kTableId = "gv";
+
+    HtmlParser html(data);
+    html.BuildTagIndex();
 
     AddEntryToTable<DividendActivities, DividendActivity> addFunc =
         [](DividendActivities& table, DividendActivity&& entry) -> void {
         table.push_back(std::move(entry));
     };
 
-    std::vector<TableColumnDetails<DividendActivity>> columns = {
-        {"Symbol / ISIN", isValidSymbol, symbol, HtmlTag::Strong},
-        {"Company", isValidName, name},
-        {"Dividend", isValidDvd, dvd_value},
-        {"DIVY", isValidDvdYield, dvd_yield},
-        {"Ex-dividend Date", isValidDate, ex_dvd_date},
-        {"Payment date", isValidPaymentDate, payment_date},
-        {"Year", isValidYear, year},
-        {"Registration Date", isValidDate, record_date},
-        {"Dividends Total", isValidDvdTotal, dvd_total_value},
-    };
+    auto columns = GetDividendActivitiesColumns();
 
     auto divLocation =
         html.FindElement(HtmlTag::Div, {}, HtmlAttribute::Id, kDivId);
@@ -1192,20 +1829,65 @@ tl::expected<DividendActivities, Error> BvbScraper::ParseDividendActivities(
 
     auto res = ParseTable<DividendActivities, DividendActivity>(
         columns,
+        html,
         data,
         divLocation->data,
         HtmlAttribute::Id,
         kTableId,
         addFunc);
-    if (! res) {
-        return res;
+    return res;
+}
+
+tl::expected<DividendActivities, Error> BvbScraper::ParseDividendActivities(
+    const HttpBodySource& source)
+{
+    static constexpr std::string_view kTableId = "gv";
+
+    DividendActivities activities;
+    bool headerChecked = false;
+    auto columns       = GetDividendActivitiesColumns();
+
+    // the table rows are decoded as soon as they are received, the first one
+    // holds the column names
+    auto parseRow = [&](const std::string& data,
+                        const HtmlElementLocation& row) -> Error {
+        HtmlParser html(data);
+
+        if (! headerChecked) {
+            headerChecked = true;
+            return CheckTableHeader(columns, html, data, row.data);
+        }
+
+        auto entry =
+            ParseTableRow<DividendActivity>(columns, html, data, row.data);
+        if (! entry) {
+            return entry.error();
+        }
+
+        activities.push_back(std::move(*entry));
+
+        return Error::NoError;
+    };
+
+    HtmlStreamParser stream(
+        HtmlTag::Table,
+        HtmlAttribute::Id,
+        kTableId,
+        HtmlTag::Tr,
+        parseRow);
+
+    Error err = source(
+        [&stream](std::string_view chunk) { return stream.Feed(chunk); });
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
     }
 
-    for (auto& activity : *res) {
-        std::erase_if(activity.symbol, [](char c) { return std::isspace(c); });
+    err = stream.Finish();
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
     }
 
-    return res;
+    return activities;
 }
 
 tl::expected<BvbScraper::IndexesDetails, Error> BvbScraper::ParseIndexesNames(
@@ -1261,19 +1943,18 @@ tl::expected<IndexesPerformance, Error> BvbScraper::ParseIndexesPerformance(
 {
     static constexpr std::string_view kTableId = "gvIndexPerformance";
 
-    DEF_SETTER(IndexPerformance, name, NO_FUNC);
-    DEF_SETTER(IndexPerformance, today, NBSP_OR_DOUBLE_FUNC);
-    DEF_SETTER(IndexPerformance, one_week, NBSP_OR_DOUBLE_FUNC);
-    DEF_SETTER(IndexPerformance, one_month, NBSP_OR_DOUBLE_FUNC);
-    DEF_SETTER(IndexPerformance, six_months, NBSP_OR_DOUBLE_FUNC);
-    DEF_SETTER(IndexPerformance, one_year, NBSP_OR_DOUBLE_FUNC);
-    DEF_SETTER(IndexPerformance, year_to_date, NBSP_OR_DOUBLE_FUNC);
+    HtmlParser html(data);
+    html.BuildTagIndex();
 
-    TableValueValidator isValidName = [this](const std::string& val) -> bool {
-        return this->IsValidIndexName(val);
+    auto parseName =
+        [this](std::string_view val) -> std::optional<std::string> {
+        if (! this->IsValidIndexName(val)) {
+            return std::nullopt;
+        }
+        return std::string(val);
     };
-    TableValueValidator isValidValue = [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 2, true, false, true);
+    auto parseValue = [this](std::string_view val) {
+        return this->ParseDouble(val, 2, true, false, true);
     };
 
     AddEntryToTable<IndexesPerformance, IndexPerformance> addFunc =
@@ -1281,18 +1962,19 @@ tl::expected<IndexesPerformance, Error> BvbScraper::ParseIndexesPerformance(
         table.push_back(std::move(entry));
     };
 
-    std::vector<TableColumnDetails<IndexPerformance>> columns = {
-        {"Index", isValidName, name},
-        {"today (%)", isValidValue, today},
-        {"1 week (%)", isValidValue, one_week},
-        {"1 month (%)", isValidValue, one_month},
-        {"6 months (%)", isValidValue, six_months},
-        {"1 year (%)", isValidValue, one_year},
-        {"YTD (%)", isValidValue, year_to_date},
+    const std::tuple columns{
+        TableColumn{"Index", &IndexPerformance::name, parseName},
+        TableColumn{"today (%)", &IndexPerformance::today, parseValue},
+        TableColumn{"1 week (%)", &IndexPerformance::one_week, parseValue},
+        TableColumn{"1 month (%)", &IndexPerformance::one_month, parseValue},
+        TableColumn{"6 months (%)", &IndexPerformance::six_months, parseValue},
+        TableColumn{"1 year (%)", &IndexPerformance::one_year, parseValue},
+        TableColumn{"YTD (%)", &IndexPerformance::year_to_date, parseValue},
     };
 
     return ParseTable<IndexesPerformance, IndexPerformance>(
         columns,
+        html,
         data,
         {},
         HtmlAttribute::Id,
@@ -1306,36 +1988,34 @@ tl::expected<Index, Error> BvbScraper::ParseConstituents(
 {
     static constexpr std::string_view kTableId = "gvC";
 
-    DEF_SETTER(Company, symbol, NO_FUNC);
-    DEF_SETTER(Company, name, NO_FUNC);
-    DEF_SETTER(Company, shares, StringToU64);
-    DEF_SETTER(Company, reference_price, std::stod);
-    DEF_SETTER(Company, free_float_factor, std::stod);
-    DEF_SETTER(Company, representation_factor, std::stod);
-    DEF_SETTER(Company, price_correction_factor, std::stod);
-    DEF_SETTER(Company, liquidity_factor, std::stod);
-    DEF_SETTER(Company, weight, std::stod);
-
-    TableValueValidator isValidSymbol = [this](const std::string& val) -> bool {
-        return this->IsValidCompanySymbol(val);
+    HtmlParser html(data);
+    html.BuildTagIndex();
+
+    auto parseSymbol =
+        [this](std::string_view val) -> std::optional<std::string> {
+        if (! this->IsValidCompanySymbol(val)) {
+            return std::nullopt;
+        }
+        return std::string(val);
     };
-    TableValueValidator isValidName = [this](const std::string& val) -> bool {
-        return this->IsValidCompanyName(val);
+    auto parseName =
+        [this](std::string_view val) -> std::optional<std::string> {
+        if (! this->IsValidCompanyName(val)) {
+            return std::nullopt;
+        }
+        return std::string(val);
     };
-    TableValueValidator isValidShares = [this](const std::string& val) -> bool {
-        return this->IsValidInt(val, false);
+    auto parseShares = [this](std::string_view val) {
+        return this->ParseInt(val, false);
     };
-    TableValueValidator isValidPDouble2 =
-        [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 2, false, false, false);
+    auto parsePDouble2 = [this](std::string_view val) {
+        return this->ParseDouble(val, 2, false, false, false);
     };
-    TableValueValidator isValidPDouble4 =
-        [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 4, false, false, false);
+    auto parsePDouble4 = [this](std::string_view val) {
+        return this->ParseDouble(val, 4, false, false, false);
     };
-    TableValueValidator isValidPDouble6 =
-        [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 6, false, false, false);
+    auto parsePDouble6 = [this](std::string_view val) {
+        return this->ParseDouble(val, 6, false, false, false);
     };
 
     AddEntryToTable<Index, Company> addFunc = [](Index& i,
@@ -1343,31 +2023,32 @@ tl::expected<Index, Error> BvbScraper::ParseConstituents(
         i.companies.push_back(std::move(c));
     };
 
-    std::vector<TableColumnDetails<Company>> columns = {
-        {"Symbol", isValidSymbol, symbol, HtmlTag::A},
-        {"Company", isValidName, name},
-        {"Shares", isValidShares, shares},
-        {"Ref. price", isValidPDouble4, reference_price},
-        {"FF", isValidPDouble2, free_float_factor},
-        {"FR", isValidPDouble6, representation_factor},
-        {"FC", isValidPDouble6, price_correction_factor},
-        {"Weight (%)", isValidPDouble2, weight},
+    const std::tuple columns{
+        TableColumn{"Symbol", &Company::symbol, parseSymbol, HtmlTag::A},
+        TableColumn{"Company", &Company::name, parseName},
+        TableColumn{"Shares", &Company::shares, parseShares},
+        TableColumn{"Ref. price", &Company::reference_price, parsePDouble4},
+        TableColumn{"FF", &Company::free_float_factor, parsePDouble2},
+        TableColumn{"FR", &Company::representation_factor, parsePDouble6},
+        TableColumn{"FC", &Company::price_correction_factor, parsePDouble6},
+        TableColumn{"Weight (%)", &Company::weight, parsePDouble2},
     };
 
-    std::vector<TableColumnDetails<Company>> alternative_columns = {
-        {"Symbol", isValidSymbol, symbol, HtmlTag::A},
-        {"Company", isValidName, name},
-        {"Shares", isValidShares, shares},
-        {"Ref. price", isValidPDouble4, reference_price},
-        {"FF", isValidPDouble2, free_float_factor},
-        {"FR", isValidPDouble6, representation_factor},
-        {"FC", isValidPDouble6, price_correction_factor},
-        {"FL", isValidPDouble2, liquidity_factor},
-        {"Weight (%)", isValidPDouble2, weight},
+    const std::tuple alternative_columns{
+        TableColumn{"Symbol", &Company::symbol, parseSymbol, HtmlTag::A},
+        TableColumn{"Company", &Company::name, parseName},
+        TableColumn{"Shares", &Company::shares, parseShares},
+        TableColumn{"Ref. price", &Company::reference_price, parsePDouble4},
+        TableColumn{"FF", &Company::free_float_factor, parsePDouble2},
+        TableColumn{"FR", &Company::representation_factor, parsePDouble6},
+        TableColumn{"FC", &Company::price_correction_factor, parsePDouble6},
+        TableColumn{"FL", &Company::liquidity_factor, parsePDouble2},
+        TableColumn{"Weight (%)", &Company::weight, parsePDouble2},
     };
 
     auto res = ParseTable<Index, Company>(
         columns,
+        html,
         data,
         {},
         HtmlAttribute::Id,
@@ -1376,6 +2057,7 @@ tl::expected<Index, Error> BvbScraper::ParseConstituents(
     if (! res) {
         res = ParseTable<Index, Company>(
             alternative_columns,
+            html,
             data,
             {},
             HtmlAttribute::Id,
@@ -1394,38 +2076,37 @@ tl::expected<Index, Error> BvbScraper::ParseConstituents(
 }
 
 tl::expected<Index, Error> BvbScraper::ParseAdjustmentsHistoryEntry(
+    HtmlParser& html,
     const std::string& data,
     ClosedInterval ci)
 {
     static constexpr std::string_view kTableId = "gvDetails";
 
-    DEF_SETTER(Company, symbol, NO_FUNC);
-    DEF_SETTER(Company, name, NO_FUNC);
-    DEF_SETTER(Company, shares, StringToU64);
-    DEF_SETTER(Company, reference_price, std::stod);
-    DEF_SETTER(Company, free_float_factor, std::stod);
-    DEF_SETTER(Company, representation_factor, std::stod);
-    DEF_SETTER(Company, price_correction_factor, std::stod);
-    DEF_SETTER(Company, liquidity_factor, std::stod);
-    DEF_SETTER(Company, weight, std::stod);
-
-    TableValueValidator isValidSymbol = [this](const std::string& val) -> bool {
-        return this->IsValidCompanySymbol(val);
+    auto parseSymbol =
+        [this](std::string_view val) -> std::optional<std::string> {
+        if (! this->IsValidCompanySymbol(val)) {
+            return std::nullopt;
+        }
+        return std::string(val);
     };
-    TableValueValidator isValidName = [this](const std::string& val) -> bool {
-        return this->IsValidCompanyName(val);
+    auto parseName =
+        [this](std::string_view val) -> std::optional<std::string> {
+        if (! this->IsValidCompanyName(val)) {
+            return std::nullopt;
+        }
+        return std::string(val);
     };
-    TableValueValidator isValidShares = [this](const std::string& val) -> bool {
-        return this->IsValidInt(val, false);
+    auto parseShares = [this](std::string_view val) {
+        return this->ParseInt(val, false);
     };
-    TableValueValidator isValidPrice = [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 4, false, false, false);
+    auto parsePrice = [this](std::string_view val) {
+        return this->ParseDouble(val, 4, false, false, false);
     };
-    TableValueValidator isValidNumber = [this](const std::string& val) -> bool {
-        return this->IsValidNumber(val);
+    auto parseNumber = [this](std::string_view val) {
+        return this->ParseNumber(val);
     };
-    TableValueValidator isValidWeight = [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 2, false, false, false);
+    auto parseWeight = [this](std::string_view val) {
+        return this->ParseDouble(val, 2, false, false, false);
     };
 
     AddEntryToTable<Index, Company> addFunc = [](Index& i,
@@ -1433,31 +2114,32 @@ tl::expected<Index, Error> BvbScraper::ParseAdjustmentsHistoryEntry(
         i.companies.push_back(std::move(c));
     };
 
-    std::vector<TableColumnDetails<Company>> columns = {
-        {"Symbol", isValidSymbol, symbol, HtmlTag::A},
-        {"Name", isValidName, name},
-        {"Shares", isValidShares, shares},
-        {"Reference price", isValidPrice, reference_price},
-        {"FF", isValidNumber, free_float_factor},
-        {"FR", isValidNumber, representation_factor},
-        {"FC", isValidNumber, price_correction_factor},
-        {"Weight (%)", isValidWeight, weight},
+    const std::tuple columns{
+        TableColumn{"Symbol", &Company::symbol, parseSymbol, HtmlTag::A},
+        TableColumn{"Name", &Company::name, parseName},
+        TableColumn{"Shares", &Company::shares, parseShares},
+        TableColumn{"Reference price", &Company::reference_price, parsePrice},
+        TableColumn{"FF", &Company::free_float_factor, parseNumber},
+        TableColumn{"FR", &Company::representation_factor, parseNumber},
+        TableColumn{"FC", &Company::price_correction_factor, parseNumber},
+        TableColumn{"Weight (%)", &Company::weight, parseWeight},
     };
 
-    std::vector<TableColumnDetails<Company>> alternative_columns = {
-        {"Symbol", isValidSymbol, symbol, HtmlTag::A},
-        {"Name", isValidName, name},
-        {"Shares", isValidShares, shares},
-        {"Reference price", isValidPrice, reference_price},
-        {"FF", isValidNumber, free_float_factor},
-        {"FR", isValidNumber, representation_factor},
-        {"FC", isValidNumber, price_correction_factor},
-        {"FL", isValidNumber, liquidity_factor},
-        {"Weight (%)", isValidWeight, weight},
+    const std::tuple alternative_columns{
+        TableColumn{"Symbol", &Company::symbol, parseSymbol, HtmlTag::A},
+        TableColumn{"Name", &Company::name, parseName},
+        TableColumn{"Shares", &Company::shares, parseShares},
+        TableColumn{"Reference price", &Company::reference_price, parsePrice},
+        TableColumn{"FF", &Company::free_float_factor, parseNumber},
+        TableColumn{"FR", &Company::representation_factor, parseNumber},
+        TableColumn{"FC", &Company::price_correction_factor, parseNumber},
+        TableColumn{"FL", &Company::liquidity_factor, parseNumber},
+        TableColumn{"Weight (%)", &Company::weight, parseWeight},
     };
 
     auto res = ParseTable<Index, Company>(
         columns,
+        html,
         data,
         ci,
         HtmlAttribute::Id,
@@ -1466,6 +2148,7 @@ tl::expected<Index, Error> BvbScraper::ParseAdjustmentsHistoryEntry(
     if (! res) {
         res = ParseTable<Index, Company>(
             alternative_columns,
+            html,
             data,
             ci,
             HtmlAttribute::Id,
@@ -1488,7 +2171,8 @@ tl::expected<Indexes, Error> BvbScraper::ParseAdjustmentsHistory(
         {"&nbsp;", "Date", "Reason", "&nbsp;"};
 
     HtmlParser html(data);
-    Indexes indexes;
+
+    html.BuildTagIndex();
 
     auto tableLocation =
         html.FindElement(HtmlTag::Table, {}, HtmlAttribute::Id, kTableId);
@@ -1534,7 +2218,8 @@ tl::expected<Indexes, Error> BvbScraper::ParseAdjustmentsHistory(
         return tl::unexpected(trLocations.error());
     }
 
-    for (const auto& loc : *trLocations) {
+    auto parseRow =
+        [&](const HtmlElementLocation& loc) -> tl::expected<Index, Error> {
         auto tdLocations = html.FindAllElements(HtmlTag::Td, loc.data);
         if (! tdLocations) {
             return tl::unexpected(tdLocations.error());
@@ -1548,7 +2233,8 @@ tl::expected<Indexes, Error> BvbScraper::ParseAdjustmentsHistory(
             return tl::unexpected(Error::UnexpectedData);
         }
 
-        auto index = ParseAdjustmentsHistoryEntry(data, (*tdLocations)[3].data);
+        auto index =
+            ParseAdjustmentsHistoryEntry(html, data, (*tdLocations)[3].data);
         if (! index) {
             return tl::unexpected(index.error());
         }
@@ -1561,10 +2247,13 @@ tl::expected<Indexes, Error> BvbScraper::ParseAdjustmentsHistory(
             data.c_str() + (*tdLocations)[2].data.Lower(),
             (*tdLocations)[2].data.Size());
 
-        indexes.push_back(std::move(*index));
-    }
+        return index;
+    };
 
-    return std::move(indexes);
+    return DecodeRows<Index>(
+        *trLocations,
+        kMinHistoryRowsPerThread,
+        parseRow);
 }
 
 tl::expected<IndexTradingData, Error> BvbScraper::ParseTradingData(
@@ -1573,36 +2262,33 @@ tl::expected<IndexTradingData, Error> BvbScraper::ParseTradingData(
 {
     static constexpr std::string_view kTableId = "gvTD";
 
-    DEF_SETTER(CompanyTradingData, symbol, NO_FUNC);
-    DEF_SETTER(CompanyTradingData, price, std::stod);
-    DEF_SETTER(CompanyTradingData, variation, NBSP_OR_DOUBLE_FUNC);
-    DEF_SETTER(CompanyTradingData, trades, NBSP_OR_U64_FUNC);
-    DEF_SETTER(CompanyTradingData, volume, NBSP_OR_U64_FUNC);
-    DEF_SETTER(CompanyTradingData, value, NBSP_OR_SDOUBLE_FUNC);
-    DEF_SETTER(CompanyTradingData, lowest_price, NBSP_OR_DOUBLE_FUNC);
-    DEF_SETTER(CompanyTradingData, highest_price, NBSP_OR_DOUBLE_FUNC);
-    DEF_SETTER(CompanyTradingData, weight, std::stod);
-
-    TableValueValidator isValidSymbol = [this](const std::string& val) -> bool {
-        return this->IsValidCompanySymbol(val);
+    HtmlParser html(data);
+    html.BuildTagIndex();
+
+    auto parseSymbol =
+        [this](std::string_view val) -> std::optional<std::string> {
+        if (! this->IsValidCompanySymbol(val)) {
+            return std::nullopt;
+        }
+        return std::string(val);
     };
-    TableValueValidator isValidPrice = [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 4, false, false, false);
+    auto parsePrice = [this](std::string_view val) {
+        return this->ParseDouble(val, 4, false, false, false);
     };
-    TableValueValidator isValidVar = [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 2, true, false, true);
+    auto parseVar = [this](std::string_view val) {
+        return this->ParseDouble(val, 2, true, false, true);
     };
-    TableValueValidator isValidInt = [this](const std::string& val) -> bool {
-        return this->IsValidInt(val, true);
+    auto parseInt = [this](std::string_view val) {
+        return this->ParseInt(val, true);
     };
-    TableValueValidator isValidValue = [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 2, false, true, true);
+    auto parseValue = [this](std::string_view val) {
+        return this->ParseDouble(val, 2, false, true, true);
     };
-    TableValueValidator isValidLH = [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 4, false, false, true);
+    auto parseLH = [this](std::string_view val) {
+        return this->ParseDouble(val, 4, false, false, true);
     };
-    TableValueValidator isValidWeight = [this](const std::string& val) -> bool {
-        return this->IsValidDouble(val, 2, false, false, false);
+    auto parseWeight = [this](std::string_view val) {
+        return this->ParseDouble(val, 2, false, false, false);
     };
 
     AddEntryToTable<IndexTradingData, CompanyTradingData> addFunc =
@@ -1610,20 +2296,25 @@ tl::expected<IndexTradingData, Error> BvbScraper::ParseTradingData(
         i.companies.push_back(std::move(c));
     };
 
-    std::vector<TableColumnDetails<CompanyTradingData>> columns = {
-        {"Symbol", isValidSymbol, symbol, HtmlTag::A},
-        {"Price", isValidPrice, price},
-        {"Var. (%)", isValidVar, variation},
-        {"Trades", isValidInt, trades},
-        {"Volume", isValidInt, volume},
-        {"Value", isValidValue, value},
-        {"Low", isValidLH, lowest_price},
-        {"High", isValidLH, highest_price},
-        {"Weight (%)", isValidWeight, weight},
+    const std::tuple columns{
+        TableColumn{
+            "Symbol",
+            &CompanyTradingData::symbol,
+            parseSymbol,
+            HtmlTag::A},
+        TableColumn{"Price", &CompanyTradingData::price, parsePrice},
+        TableColumn{"Var. (%)", &CompanyTradingData::variation, parseVar},
+        TableColumn{"Trades", &CompanyTradingData::trades, parseInt},
+        TableColumn{"Volume", &CompanyTradingData::volume, parseInt},
+        TableColumn{"Value", &CompanyTradingData::value, parseValue},
+        TableColumn{"Low", &CompanyTradingData::lowest_price, parseLH},
+        TableColumn{"High", &CompanyTradingData::highest_price, parseLH},
+        TableColumn{"Weight (%)", &CompanyTradingData::weight, parseWeight},
     };
 
     auto res = ParseTable<IndexTradingData, CompanyTradingData>(
         columns,
+        html,
         data,
         {},
         HtmlAttribute::Id,
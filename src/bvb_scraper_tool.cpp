@@ -3,11 +3,29 @@
 #include "string_utils.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <magic_enum.hpp>
 #include <set>
 #include <sstream>
+#include <thread>
+
+// The number of indexes downloaded at the same time by the --all commands.
+static constexpr size_t kMaxConnections = 8;
+
+// Enables the http cache and applies the SET_SESSION_ARCHIVE and
+// SET_BVB_BASE_URL environment variables.
+static void SetUpScraper(BvbScraper& bvbScraper)
+{
+    bvbScraper.EnableHttpCache();
+    bvbScraper.SetSessionArchive(SessionArchive::FromEnvironment());
+
+    const char* baseUrl = std::getenv("SET_BVB_BASE_URL");
+    if (baseUrl != nullptr) {
+        bvbScraper.SetBaseUrl(baseUrl);
+    }
+}
 
 int cmd_print_dividends()
 {
@@ -15,6 +33,8 @@ int cmd_print_dividends()
     Table table;
     size_t id = 1;
 
+    SetUpScraper(bvbScraper);
+
     auto r = bvbScraper.GetDividendActivities();
     if (! r) {
         std::cout << "failed to get dividend activity: "
@@ -66,6 +86,8 @@ int cmd_print_indexes()
     Table table;
     size_t id = 1;
 
+    SetUpScraper(bvbScraper);
+
     auto r = bvbScraper.GetIndexesNames();
     if (! r) {
         std::cout << "failed to get indexes: "
@@ -92,6 +114,8 @@ int cmd_print_indexes_performance()
     Table table;
     size_t id = 1;
 
+    SetUpScraper(bvbScraper);
+
     auto r = bvbScraper.GetIndexesPerformance();
     if (! r) {
         std::cout << "failed to get indexes performance: "
@@ -137,6 +161,8 @@ int cmd_print_index_constituents(const IndexName& indexName)
     size_t id = 1;
     IndexesNames names;
 
+    SetUpScraper(bvbScraper);
+
     if (indexName == "--all") {
         auto r = bvbScraper.GetIndexesNames();
         if (! r) {
@@ -150,8 +176,10 @@ int cmd_print_index_constituents(const IndexName& indexName)
         names.push_back(indexName);
     }
 
-    for (const auto& name : names) {
-        auto r = bvbScraper.GetConstituents(name);
+    auto results = bvbScraper.GetConstituents(names, kMaxConnections);
+    for (size_t i = 0; i < names.size(); i++) {
+        const IndexName& name = names[i];
+        auto& r               = results[i];
         if (! r) {
             std::cout << "failed to get " << name
                       << " constituents: " << magic_enum::enum_name(r.error())
@@ -213,6 +241,9 @@ int cmd_print_adjustments_history(const IndexName& indexName, size_t count)
     size_t id = 1;
     IndexesNames names;
 
+    SetUpScraper(bvbScraper);
+    bvbScraper.SetParseThreads(std::thread::hardware_concurrency());
+
     if (indexName == "--all") {
         auto r = bvbScraper.GetIndexesNames();
         if (! r) {
@@ -226,8 +257,10 @@ int cmd_print_adjustments_history(const IndexName& indexName, size_t count)
         names.push_back(indexName);
     }
 
-    for (const auto& name : names) {
-        auto r = bvbScraper.GetAdjustmentsHistory(name);
+    auto results = bvbScraper.GetAdjustmentsHistory(names, kMaxConnections);
+    for (size_t n = 0; n < names.size(); n++) {
+        const IndexName& name = names[n];
+        auto& r               = results[n];
         if (! r) {
             std::cout << "failed to get " << name << " adjustments history: "
                       << magic_enum::enum_name(r.error()) << std::endl;
@@ -291,6 +324,8 @@ int cmd_print_trading_data(const IndexName& indexName)
     size_t id = 1;
     IndexesNames names;
 
+    SetUpScraper(bvbScraper);
+
     if (indexName == "--all") {
         auto r = bvbScraper.GetIndexesNames();
         if (! r) {
@@ -304,8 +339,10 @@ int cmd_print_trading_data(const IndexName& indexName)
         names.push_back(indexName);
     }
 
-    for (const auto& name : names) {
-        auto r = bvbScraper.GetTradingData(name);
+    auto results = bvbScraper.GetTradingData(names, kMaxConnections);
+    for (size_t i = 0; i < names.size(); i++) {
+        const IndexName& name = names[i];
+        auto& r               = results[i];
         if (! r) {
             std::cout << "failed to get " << name
                       << " trading data: " << magic_enum::enum_name(r.error())
@@ -361,11 +398,16 @@ int cmd_print_trading_data(const IndexName& indexName)
     return 0;
 }
 
-int cmd_save_adjustments_history(const IndexName& indexName)
+int cmd_save_adjustments_history(
+    const IndexName& indexName,
+    BvbScraper::HistoryFileFormat format)
 {
     BvbScraper bvbScraper;
     IndexesNames names;
 
+    SetUpScraper(bvbScraper);
+    bvbScraper.SetParseThreads(std::thread::hardware_concurrency());
+
     if (indexName == "--all") {
         auto r = bvbScraper.GetIndexesNames();
         if (! r) {
@@ -379,15 +421,17 @@ int cmd_save_adjustments_history(const IndexName& indexName)
         names.push_back(indexName);
     }
 
-    for (const auto& name : names) {
-        auto r = bvbScraper.GetAdjustmentsHistory(name);
+    auto results = bvbScraper.GetAdjustmentsHistory(names, kMaxConnections);
+    for (size_t i = 0; i < names.size(); i++) {
+        const IndexName& name = names[i];
+        auto& r               = results[i];
         if (! r) {
             std::cout << "failed to get " << name << " adjustments history: "
                       << magic_enum::enum_name(r.error()) << std::endl;
             continue;
         }
 
-        Error err = bvbScraper.SaveAdjustmentsHistoryToFile(name, *r);
+        Error err = bvbScraper.SaveAdjustmentsHistoryToFile(name, *r, format);
         if (err != Error::NoError) {
             std::cout << "failed to save " << name
                       << " adjustments history: " << magic_enum::enum_name(err)
@@ -406,64 +450,99 @@ int cmd_load_adjustments_history(const IndexName& indexName)
     BvbScraper bvbScraper;
     Table table;
     size_t id = 1;
+    IndexesNames names;
 
-    auto r = bvbScraper.LoadAdjustmentsHistoryFromFile(indexName);
-    if (! r) {
-        std::cout << "failed to load " << indexName << " adjustments history: "
-                  << magic_enum::enum_name(r.error()) << std::endl;
-        return -1;
+    if (indexName == "--all") {
+        names = BvbScraper::GetAdjustmentsHistoryFilesNames();
+    } else {
+        names.push_back(indexName);
     }
 
-    for (size_t i = 0; i < r->size(); i++) {
-        Index& index = (*r)[i];
-        std::sort(
-            index.companies.begin(),
-            index.companies.end(),
-            [](Company a, Company b) { return a.weight > b.weight; });
+    auto results = bvbScraper.LoadAdjustmentsHistoryFromFiles(
+        names, std::thread::hardware_concurrency());
+    for (auto& [name, loaded] : results) {
+        auto& r = loaded.indexes;
+        if (! r) {
+            std::cout << "failed to load " << name << " adjustments history: "
+                      << magic_enum::enum_name(r.error()) << std::endl;
+            return -1;
+        }
 
-        id = 1;
-        table.clear();
-        table.reserve(index.companies.size() + 1);
-        table.emplace_back(std::vector<std::string>{
-            "#",
-            "Symbol",
-            "Company",
-            "Shares",
-            "Price",
-            "FF",
-            "FR",
-            "FC",
-            "FL",
-            "Weight (%)",
-        });
+        for (size_t i = 0; i < r->size(); i++) {
+            Index& index = (*r)[i];
+            std::sort(
+                index.companies.begin(),
+                index.companies.end(),
+                [](Company a, Company b) { return a.weight > b.weight; });
 
-        for (const auto& i : index.companies) {
+            id = 1;
+            table.clear();
+            table.reserve(index.companies.size() + 1);
             table.emplace_back(std::vector<std::string>{
-                std::to_string(id),
-                i.symbol,
-                i.name,
-                u64_to_string(i.shares),
-                double_to_string(i.reference_price, 4),
-                double_to_string(i.free_float_factor),
-                double_to_string(i.representation_factor, 6),
-                double_to_string(i.price_correction_factor, 6),
-                double_to_string(i.liquidity_factor),
-                double_to_string(i.weight),
+                "#",
+                "Symbol",
+                "Company",
+                "Shares",
+                "Price",
+                "FF",
+                "FR",
+                "FC",
+                "FL",
+                "Weight (%)",
             });
-            id++;
+
+            for (const auto& i : index.companies) {
+                table.emplace_back(std::vector<std::string>{
+                    std::to_string(id),
+                    i.symbol,
+                    i.name,
+                    u64_to_string(i.shares),
+                    double_to_string(i.reference_price, 4),
+                    double_to_string(i.free_float_factor),
+                    double_to_string(i.representation_factor, 6),
+                    double_to_string(i.price_correction_factor, 6),
+                    double_to_string(i.liquidity_factor),
+                    double_to_string(i.weight),
+                });
+                id++;
+            }
+
+            std::cout << "Index name: " << index.name << std::endl;
+            std::cout << "Date: " << index.date << std::endl;
+            std::cout << "Reason: " << index.reason << std::endl;
+            print_table(table);
         }
+        std::cout << std::endl;
+    }
 
-        std::cout << "Index name: " << index.name << std::endl;
-        std::cout << "Date: " << index.date << std::endl;
-        std::cout << "Reason: " << index.reason << std::endl;
-        print_table(table);
+    // the files are loaded concurrently, so the times overlap
+    id = 1;
+    table.clear();
+    table.reserve(results.size() + 1);
+    table.emplace_back(std::vector<std::string>{
+        "#",
+        "Index",
+        "Adjustments",
+        "Load time (ms)",
+    });
+
+    for (const auto& [name, loaded] : results) {
+        table.emplace_back(std::vector<std::string>{
+            std::to_string(id),
+            name,
+            std::to_string(loaded.indexes->size()),
+            double_to_string(loaded.duration.count() / 1000.0, 3),
+        });
+        id++;
     }
-    std::cout << std::endl;
+    print_table(table);
 
     return 0;
 }
 
-int cmd_update_adjustments_history(const IndexName& indexName)
+int cmd_update_adjustments_history(
+    const IndexName& indexName,
+    BvbScraper::HistoryFileFormat format)
 {
     BvbScraper bvbScraper;
     IndexesNames names;
@@ -471,6 +550,9 @@ int cmd_update_adjustments_history(const IndexName& indexName)
     uint8_t month = 0;
     uint8_t day   = 0;
 
+    SetUpScraper(bvbScraper);
+    bvbScraper.SetParseThreads(std::thread::hardware_concurrency());
+
     if (indexName == "--all") {
         auto r = bvbScraper.GetIndexesNames();
         if (! r) {
@@ -484,7 +566,10 @@ int cmd_update_adjustments_history(const IndexName& indexName)
         names.push_back(indexName);
     }
 
-    for (const auto& name : names) {
+    auto siteHistories =
+        bvbScraper.GetAdjustmentsHistory(names, kMaxConnections);
+    for (size_t i = 0; i < names.size(); i++) {
+        const IndexName& name = names[i];
         std::set<ComparableIndex, IndexComparator> mergedHistory;
         Indexes indexes;
 
@@ -496,7 +581,7 @@ int cmd_update_adjustments_history(const IndexName& indexName)
             continue;
         }
 
-        auto siteHistory = bvbScraper.GetAdjustmentsHistory(name);
+        auto& siteHistory = siteHistories[i];
         if (! siteHistory) {
             std::cout << "failed to get " << name << " adjustments history: "
                       << magic_enum::enum_name(siteHistory.error())
@@ -528,7 +613,8 @@ int cmd_update_adjustments_history(const IndexName& indexName)
             std::back_inserter(indexes),
             [](const ComparableIndex& ci) { return ci.index; });
 
-        Error err = bvbScraper.SaveAdjustmentsHistoryToFile(name, indexes);
+        Error err = bvbScraper.SaveAdjustmentsHistoryToFile(
+            name, indexes, format);
         if (err != Error::NoError) {
             std::cout << "failed to save " << name
                       << " adjustments history: " << magic_enum::enum_name(err)
@@ -562,20 +648,34 @@ void cmd_print_help()
                  "Use --all for index name in order to print trading data for "
                  "all BVB indices."
               << std::endl;
-    std::cout << "--sah <index_name> - saves adjustments history for a BVB "
-                 "index. Use --all for index name in order to save adjustments "
-                 "history for all BVB indices."
+    std::cout << "--sah <index_name> [--binary] - saves adjustments history "
+                 "for a BVB index. Use --all for index name in order to save "
+                 "adjustments history for all BVB indices. Use --binary in "
+                 "order to save it in the binary format, which loads faster."
               << std::endl;
     std::cout << "--lah <index_name> - loads adjustments history from file for "
-                 "a BVB index and prints them."
+                 "a BVB index and prints them, followed by the time spent "
+                 "loading the file. Use --all for index name in order to load "
+                 "the files of all BVB indices concurrently."
               << std::endl;
-    std::cout << "--uah <index_name> - updates adjustments history for a BVB "
-                 "index by merging the adjustments history from file with the "
-                 "adjustments history from BVB site. Use --all for index name "
-                 "in order to update adjustments history for all BVB indices."
+    std::cout << "--uah <index_name> [--binary] - updates adjustments history "
+                 "for a BVB index by merging the adjustments history from file "
+                 "with the adjustments history from BVB site. Use --all for "
+                 "index name in order to update adjustments history for all "
+                 "BVB indices. Use --binary in order to save it in the binary "
+                 "format."
               << std::endl;
 }
 
+BvbScraper::HistoryFileFormat GetHistoryFileFormat(int argc, char* argv[])
+{
+    if (argc > 3 && strcmp(argv[3], "--binary") == 0) {
+        return BvbScraper::HistoryFileFormat::Binary;
+    }
+
+    return BvbScraper::HistoryFileFormat::Text;
+}
+
 int main(int argc, char* argv[])
 {
     if (argc < 2) {
@@ -621,7 +721,8 @@ int main(int argc, char* argv[])
             return -1;
         }
 
-        return cmd_save_adjustments_history(argv[2]);
+        return cmd_save_adjustments_history(
+            argv[2], GetHistoryFileFormat(argc, argv));
     } else if (strcmp(argv[1], "--lah") == 0) {
         if (argc < 3) {
             std::cout << "no index name" << std::endl;
@@ -635,7 +736,8 @@ int main(int argc, char* argv[])
             return -1;
         }
 
-        return cmd_update_adjustments_history(argv[2]);
+        return cmd_update_adjustments_history(
+            argv[2], GetHistoryFileFormat(argc, argv));
     } else if (strcmp(argv[1], "--help") == 0) {
         cmd_print_help();
         return 0;
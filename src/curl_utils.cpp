@@ -1,11 +1,52 @@
 #include "curl_utils.h"
 
+#include <algorithm>
+#include <memory>
+
+struct BodyCallbackData
+{
+    const HttpBodyCallback& callback;
+    Error err = Error::NoError;
+};
+
+static std::string GetCacheKey(
+    HttpMethod method,
+    const std::string& url,
+    const std::string& postData)
+{
+    std::string key = method == HttpMethod::post ? "POST " : "GET ";
+
+    key += url;
+    key += '\n';
+    key += postData;
+
+    return key;
+}
+
+static void RemoveCachedResponse(const HttpCache* cache, HttpResponse* rsp)
+{
+    if (cache != nullptr && rsp != nullptr && ! rsp->cacheKey.empty()) {
+        cache->Remove(rsp->cacheKey);
+        rsp->cacheKey.clear();
+    }
+}
+
 size_t write_cbk(void* ptr, size_t size, size_t nmemb, std::string* data)
 {
     data->append((char*) ptr, size * nmemb);
     return size * nmemb;
 }
 
+size_t body_cbk(void* ptr, size_t size, size_t nmemb, BodyCallbackData* data)
+{
+    data->err = data->callback(std::string_view((char*) ptr, size * nmemb));
+    if (data->err != Error::NoError) {
+        return 0;
+    }
+
+    return size * nmemb;
+}
+
 Error CurlHeaders::Add(const char* header)
 {
     curl_slist* tmp = curl_slist_append(m_headers, header);
@@ -30,12 +71,47 @@ Error CurlHeaders::Add(std::initializer_list<const char*> list)
     return Error::NoError;
 }
 
+Error CurlHeaders::Add(const std::vector<const char*>& list)
+{
+    for (auto elem : list) {
+        if (Add(elem) != Error::NoError) {
+            return Error::CurlAddHeaderError;
+        }
+    }
+
+    return Error::NoError;
+}
+
+void CurlHeaders::Clear()
+{
+    curl_slist_free_all(m_headers);
+    m_headers = NULL;
+}
+
+void ScopedCurl::Reset()
+{
+    if (m_curl) {
+        curl_easy_reset(m_curl.Get());
+    }
+
+    m_headers.Clear();
+    m_method = HttpMethod::get;
+    m_url.clear();
+    m_postData.clear();
+    m_cacheTtl     = std::chrono::seconds(0);
+    m_cacheRefresh = false;
+    m_staleEntry.reset();
+    m_archiveKey.clear();
+}
+
 Error ScopedCurl::SetHttpMethod(HttpMethod method)
 {
     if (! m_curl) {
         return Error::InvalidCurlHandle;
     }
 
+    m_method = method;
+
     switch (method) {
     case HttpMethod::get:
         return curl_easy_setopt(m_curl.Get(), CURLOPT_HTTPGET, 1L) == CURLE_OK
@@ -84,6 +160,8 @@ Error ScopedCurl::SetUrl(const char* url)
         return Error::InvalidCurlHandle;
     }
 
+    m_url = url;
+
     return curl_easy_setopt(m_curl.Get(), CURLOPT_URL, url) == CURLE_OK
         ? Error::NoError
         : Error::CurlSetUrlError;
@@ -107,8 +185,21 @@ Error ScopedCurl::SetHeaders(const CurlHeaders& headers)
         return Error::InvalidCurlHandle;
     }
 
-    return curl_easy_setopt(m_curl.Get(), CURLOPT_HTTPHEADER, headers.Get()) ==
-            CURLE_OK
+    // the list is copied, so the conditional headers of a revalidation can
+    // be added to it
+    if (&headers != &m_headers) {
+        m_headers.Clear();
+        for (curl_slist* i = headers.Get(); i != NULL; i = i->next) {
+            if (m_headers.Add(i->data) != Error::NoError) {
+                return Error::CurlAddHeaderError;
+            }
+        }
+    }
+
+    return curl_easy_setopt(
+               m_curl.Get(),
+               CURLOPT_HTTPHEADER,
+               m_headers.Get()) == CURLE_OK
         ? Error::NoError
         : Error::CurlSetUrlError;
 }
@@ -160,6 +251,7 @@ Error ScopedCurl::SetPostData(const PostData& data)
 
     // remove last '&'
     encodedData.pop_back();
+    m_postData = encodedData;
 
     curlErr = curl_easy_setopt(
         m_curl.Get(),
@@ -180,42 +272,567 @@ Error ScopedCurl::SetPostData(const PostData& data)
     return Error::NoError;
 }
 
+Error ScopedCurl::SetKeepAlive(bool enable)
+{
+    if (! m_curl) {
+        return Error::InvalidCurlHandle;
+    }
+
+    return curl_easy_setopt(
+               m_curl.Get(),
+               CURLOPT_TCP_KEEPALIVE,
+               enable ? 1L : 0L) == CURLE_OK
+        ? Error::NoError
+        : Error::CurlSetoptError;
+}
+
+Error ScopedCurl::SetRequest(const HttpRequest& req)
+{
+    Error err = Error::NoError;
+
+    if (! m_curl) {
+        return Error::InvalidCurlHandle;
+    }
+
+    Reset();
+
+#define RETURN_IF_ERROR(func)                                                  \
+    err = func;                                                                \
+    if (err != Error::NoError) {                                               \
+        return err;                                                            \
+    }
+
+    RETURN_IF_ERROR(m_headers.Add(req.headers));
+    RETURN_IF_ERROR(SetHttpMethod(req.method));
+    RETURN_IF_ERROR(SetHttpVersion(req.version));
+    RETURN_IF_ERROR(SetUrl(req.url.c_str()));
+    RETURN_IF_ERROR(SetHeaders(m_headers));
+    RETURN_IF_ERROR(SetKeepAlive(true));
+
+    if (req.encoding != nullptr) {
+        RETURN_IF_ERROR(SetEncoding(req.encoding));
+    }
+
+    if (req.method == HttpMethod::post && req.postData.empty() == false) {
+        RETURN_IF_ERROR(SetPostData(req.postData));
+    }
+
+#undef RETURN_IF_ERROR
+
+    SetCacheTtl(req.cacheTtl);
+    SetCacheRefresh(req.refreshCache);
+
+    return Error::NoError;
+}
+
+void ScopedCurl::SetCache(const HttpCache* cache)
+{
+    m_cache = cache;
+}
+
+void ScopedCurl::SetCacheTtl(std::chrono::seconds ttl)
+{
+    m_cacheTtl = ttl;
+}
+
+void ScopedCurl::SetCacheRefresh(bool refresh)
+{
+    m_cacheRefresh = refresh;
+}
+
+void ScopedCurl::SetArchive(SessionArchive* archive)
+{
+    m_archive = archive;
+}
+
 tl::expected<HttpResponse, Error> ScopedCurl::Perform()
 {
     if (! m_curl) {
         return tl::unexpected(Error::InvalidCurlHandle);
     }
 
-    CURLcode err;
     HttpResponse rsp;
 
+    auto loaded = LoadCachedResponse(rsp);
+    if (! loaded) {
+        return tl::unexpected(loaded.error());
+    }
+    if (*loaded) {
+        return std::move(rsp);
+    }
+
     rsp.headers.reserve(1024);
     rsp.body.reserve(64 * 1024);
 
-    err = curl_easy_setopt(m_curl.Get(), CURLOPT_WRITEFUNCTION, write_cbk);
+    Error res = SetBodyBuffer(rsp.body);
+    if (res != Error::NoError) {
+        return tl::unexpected(res);
+    }
+
+    res = PerformRequest(rsp);
+    if (res != Error::NoError) {
+        return tl::unexpected(res);
+    }
+
+    StoreCachedResponse(rsp);
+
+    return std::move(rsp);
+}
+
+tl::expected<HttpResponse, Error> ScopedCurl::Perform(
+    const HttpBodyCallback& bodyCallback)
+{
+    if (! m_curl) {
+        return tl::unexpected(Error::InvalidCurlHandle);
+    }
+
+    CURLcode err;
+    HttpResponse rsp;
+    std::string body;
+    bool caching = m_archive != nullptr ||
+        (m_cache != nullptr && m_cacheTtl > std::chrono::seconds(0));
+
+    auto loaded = LoadCachedResponse(rsp);
+    if (! loaded) {
+        return tl::unexpected(loaded.error());
+    }
+    if (*loaded) {
+        Error res = bodyCallback(rsp.body);
+        if (res != Error::NoError) {
+            return tl::unexpected(res);
+        }
+
+        rsp.body.clear();
+        return std::move(rsp);
+    }
+
+    // the body is passed on and kept for the cache at the same time
+    HttpBodyCallback cachingCallback = [&](std::string_view chunk) {
+        body.append(chunk);
+        return bodyCallback(chunk);
+    };
+    BodyCallbackData data{caching ? cachingCallback : bodyCallback};
+
+    rsp.headers.reserve(1024);
+
+    err = curl_easy_setopt(m_curl.Get(), CURLOPT_WRITEFUNCTION, body_cbk);
     if (err != CURLE_OK) {
         return tl::unexpected(Error::CurlSetoptError);
     }
 
-    err = curl_easy_setopt(m_curl.Get(), CURLOPT_WRITEDATA, &rsp.body);
+    err = curl_easy_setopt(m_curl.Get(), CURLOPT_WRITEDATA, &data);
     if (err != CURLE_OK) {
         return tl::unexpected(Error::CurlSetoptError);
     }
 
-    err = curl_easy_setopt(m_curl.Get(), CURLOPT_HEADERDATA, &rsp.headers);
+    Error res = PerformRequest(rsp);
+    if (data.err != Error::NoError) {
+        return tl::unexpected(data.err);
+    }
+    if (res != Error::NoError) {
+        return tl::unexpected(res);
+    }
+
+    if (caching) {
+        rsp.body = std::move(body);
+        if (StoreCachedResponse(rsp)) {
+            // a 304 has no body, the one of the cache entry is passed on
+            res = bodyCallback(rsp.body);
+            if (res != Error::NoError) {
+                return tl::unexpected(res);
+            }
+        }
+        rsp.body.clear();
+    }
+
+    return std::move(rsp);
+}
+
+Error ScopedCurl::PerformChain(const HttpRequestChain& chain)
+{
+    std::optional<HttpResponse> rsp;
+
+    while (true) {
+        auto req = chain(rsp ? &*rsp : nullptr);
+        if (! req) {
+            RemoveCachedResponse(m_cache, rsp ? &*rsp : nullptr);
+            return req.error();
+        }
+        if (! *req) {
+            return Error::NoError;
+        }
+
+        Error err = SetRequest(**req);
+        if (err != Error::NoError) {
+            return err;
+        }
+
+        auto res = Perform();
+        if (! res) {
+            return res.error();
+        }
+
+        rsp = std::move(*res);
+    }
+}
+
+Error ScopedCurl::SetBodyBuffer(std::string& body)
+{
+    CURLcode err;
+
+    err = curl_easy_setopt(m_curl.Get(), CURLOPT_WRITEFUNCTION, write_cbk);
     if (err != CURLE_OK) {
-        return tl::unexpected(Error::CurlSetoptError);
+        return Error::CurlSetoptError;
     }
 
-    err = curl_easy_perform(m_curl.Get());
+    err = curl_easy_setopt(m_curl.Get(), CURLOPT_WRITEDATA, &body);
     if (err != CURLE_OK) {
-        return tl::unexpected(Error::CurlPerformError);
+        return Error::CurlSetoptError;
     }
 
+    return Error::NoError;
+}
+
+Error ScopedCurl::SetHeadersBuffer(std::string& headers)
+{
+    CURLcode err;
+
+    // headers must not go through the write function set for the body
+    err = curl_easy_setopt(m_curl.Get(), CURLOPT_HEADERFUNCTION, write_cbk);
+    if (err != CURLE_OK) {
+        return Error::CurlSetoptError;
+    }
+
+    err = curl_easy_setopt(m_curl.Get(), CURLOPT_HEADERDATA, &headers);
+    if (err != CURLE_OK) {
+        return Error::CurlSetoptError;
+    }
+
+    return Error::NoError;
+}
+
+void ScopedCurl::GetResponseCode(HttpResponse& rsp)
+{
+    CURLcode err;
+
     err = curl_easy_getinfo(m_curl.Get(), CURLINFO_RESPONSE_CODE, &rsp.code);
     if (err != CURLE_OK) {
         rsp.code = -1;
     }
+}
 
-    return std::move(rsp);
+tl::expected<bool, Error> ScopedCurl::LoadCachedResponse(HttpResponse& rsp)
+{
+    m_staleEntry.reset();
+
+    if (m_archive != nullptr) {
+        m_archiveKey =
+            m_archive->NextKey(GetCacheKey(m_method, m_url, m_postData));
+        if (m_archive->GetMode() == SessionArchive::Mode::Record) {
+            return false;
+        }
+
+        auto entry = m_archive->Replay(m_archiveKey);
+        if (! entry) {
+            return tl::unexpected(entry.error());
+        }
+
+        rsp.code    = entry->code;
+        rsp.headers = std::move(entry->headers);
+        rsp.body    = std::move(entry->body);
+        return true;
+    }
+
+    // the response is downloaded without conditional headers, so the server
+    // sends it whole instead of confirming the cached one
+    if (m_cache == nullptr || m_cacheTtl <= std::chrono::seconds(0) ||
+        m_cacheRefresh) {
+        return false;
+    }
+
+    std::string key = GetCacheKey(m_method, m_url, m_postData);
+    auto entry      = m_cache->Load(key);
+    if (! entry) {
+        return false;
+    }
+
+    if (std::chrono::system_clock::now() - entry->storedAt < m_cacheTtl) {
+        rsp.code     = entry->code;
+        rsp.headers  = std::move(entry->headers);
+        rsp.body     = std::move(entry->body);
+        rsp.cacheKey = std::move(key);
+        return true;
+    }
+
+    std::string header;
+    if (! entry->etag.empty()) {
+        header = "If-None-Match: " + entry->etag;
+        m_headers.Add(header.c_str());
+    }
+    if (! entry->lastModified.empty()) {
+        header = "If-Modified-Since: " + entry->lastModified;
+        m_headers.Add(header.c_str());
+    }
+    if (! header.empty()) {
+        curl_easy_setopt(m_curl.Get(), CURLOPT_HTTPHEADER, m_headers.Get());
+    }
+
+    m_staleEntry = std::move(entry);
+    return false;
+}
+
+bool ScopedCurl::StoreCachedResponse(HttpResponse& rsp)
+{
+    HttpCacheEntry entry;
+    bool revalidated = false;
+
+    if (m_archive != nullptr) {
+        entry.storedAt = std::chrono::system_clock::now();
+        entry.code     = rsp.code;
+        entry.headers  = rsp.headers;
+        entry.body     = rsp.body;
+
+        // a response which is not recorded only fails its replay
+        m_archive->Record(m_archiveKey, entry);
+        return false;
+    }
+
+    if (m_cache == nullptr || m_cacheTtl <= std::chrono::seconds(0)) {
+        return false;
+    }
+
+    if (rsp.code == 304 && m_staleEntry) {
+        entry       = std::move(*m_staleEntry);
+        rsp.code    = entry.code;
+        rsp.headers = entry.headers;
+        rsp.body    = entry.body;
+        revalidated = true;
+    } else if (rsp.code == 200) {
+        entry.code    = rsp.code;
+        entry.headers = rsp.headers;
+        entry.body    = rsp.body;
+        HttpCache::ParseValidators(entry);
+    } else {
+        m_staleEntry.reset();
+        return false;
+    }
+
+    m_staleEntry.reset();
+    entry.storedAt = std::chrono::system_clock::now();
+
+    // failing to store the entry only costs a download next time
+    rsp.cacheKey = GetCacheKey(m_method, m_url, m_postData);
+    m_cache->Store(rsp.cacheKey, entry);
+
+    return revalidated;
+}
+
+Error ScopedCurl::PerformRequest(HttpResponse& rsp)
+{
+    Error res = SetHeadersBuffer(rsp.headers);
+    if (res != Error::NoError) {
+        return res;
+    }
+
+    if (curl_easy_perform(m_curl.Get()) != CURLE_OK) {
+        return Error::CurlPerformError;
+    }
+
+    GetResponseCode(rsp);
+
+    return Error::NoError;
+}
+
+struct CurlMulti::Transfer
+{
+    ScopedCurl curl;
+    HttpResponse rsp;
+    size_t chain = 0;
+};
+
+CurlMulti::CurlMulti()
+{
+    m_multi = curl_multi_init();
+}
+
+CurlMulti::~CurlMulti()
+{
+    if (m_multi != nullptr) {
+        curl_multi_cleanup(m_multi);
+    }
+}
+
+void CurlMulti::Add(HttpRequestChain chain)
+{
+    m_chains.push_back(std::move(chain));
+}
+
+void CurlMulti::SetCache(const HttpCache* cache)
+{
+    m_cache = cache;
+}
+
+void CurlMulti::SetArchive(SessionArchive* archive)
+{
+    m_archive = archive;
+}
+
+std::vector<Error> CurlMulti::Perform(size_t maxTransfers)
+{
+    // a chain which is not complete when the loop below stops has failed
+    std::vector<Error> res(m_chains.size(), Error::CurlPerformError);
+    std::vector<std::unique_ptr<Transfer>> transfers;
+    size_t nextChain = 0;
+    size_t active    = 0;
+
+    if (! m_multi) {
+        std::fill(res.begin(), res.end(), Error::CurlInitError);
+        return res;
+    }
+
+    // Moves transfer on to the next chains until one of them sends a request.
+    auto advance = [&](Transfer& transfer, HttpResponse* rsp) {
+        while (true) {
+            auto started = StartRequest(transfer, rsp);
+            if (started && *started) {
+                active++;
+                return;
+            }
+
+            res[transfer.chain] = started ? Error::NoError : started.error();
+            if (nextChain == m_chains.size()) {
+                return;
+            }
+
+            transfer.chain = nextChain++;
+            rsp            = nullptr;
+        }
+    };
+
+    maxTransfers = std::min(std::max<size_t>(maxTransfers, 1), m_chains.size());
+    curl_multi_setopt(
+        m_multi,
+        CURLMOPT_MAX_TOTAL_CONNECTIONS,
+        static_cast<long>(maxTransfers));
+
+    // a transfer may complete several chains right away
+    while (transfers.size() < maxTransfers && nextChain < m_chains.size()) {
+        transfers.emplace_back(std::make_unique<Transfer>());
+        transfers.back()->curl.SetCache(m_cache);
+        transfers.back()->curl.SetArchive(m_archive);
+        transfers.back()->chain = nextChain++;
+        advance(*transfers.back(), nullptr);
+    }
+
+    while (active > 0) {
+        int running = 0;
+        int queued  = 0;
+
+        if (curl_multi_perform(m_multi, &running) != CURLM_OK) {
+            break;
+        }
+
+        while (CURLMsg* msg = curl_multi_info_read(m_multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            CURL* handle    = msg->easy_handle;
+            CURLcode result = msg->data.result;
+            char* priv      = nullptr;
+
+            curl_easy_getinfo(handle, CURLINFO_PRIVATE, &priv);
+            curl_multi_remove_handle(m_multi, handle);
+            active--;
+
+            Transfer& transfer = *reinterpret_cast<Transfer*>(priv);
+            if (result != CURLE_OK) {
+                res[transfer.chain] = Error::CurlPerformError;
+                if (nextChain == m_chains.size()) {
+                    continue;
+                }
+
+                transfer.chain = nextChain++;
+                advance(transfer, nullptr);
+                continue;
+            }
+
+            transfer.curl.GetResponseCode(transfer.rsp);
+            transfer.curl.StoreCachedResponse(transfer.rsp);
+            advance(transfer, &transfer.rsp);
+        }
+
+        if (active > 0 &&
+            curl_multi_poll(m_multi, nullptr, 0, 1000, nullptr) != CURLM_OK) {
+            break;
+        }
+    }
+
+    for (auto& transfer : transfers) {
+        curl_multi_remove_handle(m_multi, transfer->curl.m_curl.Get());
+    }
+
+    return res;
+}
+
+tl::expected<bool, Error> CurlMulti::StartRequest(
+    Transfer& transfer,
+    HttpResponse* rsp)
+{
+    Error err = Error::NoError;
+
+    // the responses served from cache or replayed are passed on to the chain
+    // right away
+    while (true) {
+        auto req = m_chains[transfer.chain](rsp);
+        if (! req) {
+            RemoveCachedResponse(m_cache, rsp);
+            return tl::unexpected(req.error());
+        }
+        if (! *req) {
+            return false;
+        }
+
+        err = transfer.curl.SetRequest(**req);
+        if (err != Error::NoError) {
+            return tl::unexpected(err);
+        }
+
+        // the previous response of the chain is not needed anymore
+        transfer.rsp.code = 0;
+        transfer.rsp.headers.clear();
+        transfer.rsp.body.clear();
+        transfer.rsp.cacheKey.clear();
+
+        auto loaded = transfer.curl.LoadCachedResponse(transfer.rsp);
+        if (! loaded) {
+            return tl::unexpected(loaded.error());
+        }
+        if (! *loaded) {
+            break;
+        }
+
+        rsp = &transfer.rsp;
+    }
+
+    err = transfer.curl.SetBodyBuffer(transfer.rsp.body);
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
+    }
+
+    err = transfer.curl.SetHeadersBuffer(transfer.rsp.headers);
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
+    }
+
+    CURL* handle = transfer.curl.m_curl.Get();
+    if (curl_easy_setopt(handle, CURLOPT_PRIVATE, &transfer) != CURLE_OK) {
+        return tl::unexpected(Error::CurlSetoptError);
+    }
+
+    if (curl_multi_add_handle(m_multi, handle) != CURLM_OK) {
+        return tl::unexpected(Error::CurlPerformError);
+    }
+
+    return true;
 }
@@ -1,9 +1,204 @@
 #include "html_parser.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <iterator>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 static_assert(
     std::string::npos == static_cast<size_t>(-1),
     "Unexpected std::string::npos");
 
+// Tag boundary scanners. They set in the given zero-initialized bitmaps one
+// bit for every '<' and '>' found in data. The vectorized scanners handle
+// blocks of 64 bytes, one bitmap word per block, and leave the remaining bytes
+// to the scalar scanner.
+using ScanTagBoundariesFunc =
+    void (*)(const char* data, size_t size, uint64_t* lt, uint64_t* gt);
+
+static void ScanTagBoundariesScalar(
+    const char* data,
+    size_t size,
+    uint64_t* lt,
+    uint64_t* gt)
+{
+    for (size_t i = 0; i < size; i++) {
+        lt[i / 64] |= static_cast<uint64_t>(data[i] == '<') << (i % 64);
+        gt[i / 64] |= static_cast<uint64_t>(data[i] == '>') << (i % 64);
+    }
+}
+
+#if defined(__SSE2__)
+static void ScanTagBoundariesSse2(
+    const char* data,
+    size_t size,
+    uint64_t* lt,
+    uint64_t* gt)
+{
+    const __m128i ltMask = _mm_set1_epi8('<');
+    const __m128i gtMask = _mm_set1_epi8('>');
+    size_t numBlocks     = size / 64;
+
+    for (size_t block = 0; block < numBlocks; block++) {
+        uint64_t ltBits = 0;
+        uint64_t gtBits = 0;
+
+        for (size_t i = 0; i < 4; i++) {
+            __m128i chunk = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(data + block * 64 + i * 16));
+            uint32_t ltRes = static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, ltMask)));
+            uint32_t gtRes = static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, gtMask)));
+
+            ltBits |= static_cast<uint64_t>(ltRes) << (i * 16);
+            gtBits |= static_cast<uint64_t>(gtRes) << (i * 16);
+        }
+
+        lt[block] = ltBits;
+        gt[block] = gtBits;
+    }
+
+    ScanTagBoundariesScalar(
+        data + numBlocks * 64,
+        size - numBlocks * 64,
+        lt + numBlocks,
+        gt + numBlocks);
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static void ScanTagBoundariesAvx2(
+    const char* data,
+    size_t size,
+    uint64_t* lt,
+    uint64_t* gt)
+{
+    const __m256i ltMask = _mm256_set1_epi8('<');
+    const __m256i gtMask = _mm256_set1_epi8('>');
+    size_t numBlocks     = size / 64;
+
+    for (size_t block = 0; block < numBlocks; block++) {
+        __m256i low = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data + block * 64));
+        __m256i high = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data + block * 64 + 32));
+
+        uint32_t ltLow = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(low, ltMask)));
+        uint32_t ltHigh = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, ltMask)));
+        uint32_t gtLow = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(low, gtMask)));
+        uint32_t gtHigh = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, gtMask)));
+
+        lt[block] = static_cast<uint64_t>(ltHigh) << 32 | ltLow;
+        gt[block] = static_cast<uint64_t>(gtHigh) << 32 | gtLow;
+    }
+
+    ScanTagBoundariesScalar(
+        data + numBlocks * 64,
+        size - numBlocks * 64,
+        lt + numBlocks,
+        gt + numBlocks);
+}
+#endif
+
+// Returns the position of the first set bit in [first, last] or npos.
+static size_t FindNextBit(
+    const std::vector<uint64_t>& bitmap,
+    size_t first,
+    size_t last)
+{
+    if (first > last || first / 64 >= bitmap.size()) {
+        return std::string::npos;
+    }
+
+    size_t word     = first / 64;
+    size_t lastWord = std::min(last / 64, bitmap.size() - 1);
+    uint64_t bits   = bitmap[word] & (~0ull << (first % 64));
+
+    while (bits == 0) {
+        if (++word > lastWord) {
+            return std::string::npos;
+        }
+        bits = bitmap[word];
+    }
+
+    size_t pos = word * 64 + std::countr_zero(bits);
+    return pos <= last ? pos : std::string::npos;
+}
+
+static constexpr std::array<HtmlTag, 12> kIndexedTags = {
+    HtmlTag::Select,
+    HtmlTag::Option,
+    HtmlTag::Table,
+    HtmlTag::Thead,
+    HtmlTag::Tbody,
+    HtmlTag::Tr,
+    HtmlTag::Th,
+    HtmlTag::Td,
+    HtmlTag::Input,
+    HtmlTag::A,
+    HtmlTag::Div,
+    HtmlTag::Strong,
+};
+
+void HtmlParser::BuildTagIndex()
+{
+    struct TagPositions
+    {
+        HtmlTag tag;
+        HtmlTagMarks marks;
+        std::vector<size_t> beginPositions;
+        std::vector<size_t> endPositions;
+    };
+
+    std::vector<TagPositions> tags;
+    std::string_view page(m_htmlPage);
+
+    ScanTagBoundaries();
+
+    tags.reserve(kIndexedTags.size());
+    for (HtmlTag tag : kIndexedTags) {
+        auto eTagMarks = GetTagMarks(tag);
+        if (eTagMarks) {
+            tags.push_back({tag, *eTagMarks, {}, {}});
+        }
+    }
+
+    // all tag marks start with '<', so visiting every '<' once is enough to
+    // find the begin and end tag marks of all tags
+    for (size_t pos = FindNextBit(m_ltBitmap, 0, page.size() - 1);
+         pos != std::string::npos;
+         pos = FindNextBit(m_ltBitmap, pos + 1, page.size() - 1)) {
+        std::string_view mark = page.substr(pos);
+
+        for (auto& t : tags) {
+            if (mark.starts_with(t.marks.begin)) {
+                t.beginPositions.push_back(pos);
+            } else if (
+                ! t.marks.end.empty() && mark.starts_with(t.marks.end)) {
+                t.endPositions.push_back(pos);
+            }
+        }
+    }
+
+    m_tagIndexes.clear();
+    for (const auto& t : tags) {
+        HtmlTagIndex index;
+        if (FillTagIndex(t.marks, t.beginPositions, t.endPositions, index)) {
+            m_tagIndexes.emplace(t.tag, std::move(index));
+        }
+    }
+}
+
 tl::expected<HtmlElementLocation, Error> HtmlParser::FindElement(
     HtmlTag tag,
     ClosedInterval ci,
@@ -28,6 +223,15 @@ tl::expected<HtmlElementLocation, Error> HtmlParser::FindElement(
         return tl::unexpected(eTagMarks.error());
     }
 
+    const HtmlTagIndex* index = GetTagIndex(tag);
+    if (index != nullptr) {
+        return FindIndexedElement(
+            *index,
+            *eTagMarks,
+            attr != HtmlAttribute::None ? *eAttrMark : std::string_view{},
+            ci);
+    }
+
     const HtmlTagMarks& tagMarks = *eTagMarks;
     size_t beginPos              = std::string::npos;
     size_t beginStopPos          = std::string::npos;
@@ -89,25 +293,65 @@ tl::expected<HtmlElementLocations, Error> HtmlParser::FindAllElements(
     HtmlAttribute attr,
     std::string_view attrValue)
 {
+    HtmlElementLocations locations;
+
+    Error err = FindAllElements(locations, tag, ci, attr, attrValue);
+    if (err != Error::NoError) {
+        return tl::unexpected(err);
+    }
+
+    return locations;
+}
+
+Error HtmlParser::FindAllElements(
+    HtmlElementLocations& locations,
+    HtmlTag tag,
+    ClosedInterval ci,
+    HtmlAttribute attr,
+    std::string_view attrValue)
+{
+    locations.clear();
+
     if (ci.Upper() >= m_htmlPage.size()) {
         ci.SetUpper(m_htmlPage.size() - 1);
     }
 
     if (ci.Empty()) {
-        return tl::unexpected(Error::InvalidClosedInterval);
+        return Error::InvalidClosedInterval;
     }
 
     auto eAttrMark = GetAttributeMark(attr, attrValue);
     if (attr != HtmlAttribute::None && ! eAttrMark) {
-        return tl::unexpected(eAttrMark.error());
+        return eAttrMark.error();
     }
 
     auto eTagMarks = GetTagMarks(tag);
     if (! eTagMarks) {
-        return tl::unexpected(eTagMarks.error());
+        return eTagMarks.error();
+    }
+
+    const HtmlTagIndex* index = GetTagIndex(tag);
+    if (index != nullptr) {
+        std::string_view attrMark =
+            attr != HtmlAttribute::None ? *eAttrMark : std::string_view{};
+
+        while (true) {
+            auto location =
+                FindIndexedElement(*index, *eTagMarks, attrMark, ci);
+            if (! location) {
+                if (location.error() == Error::HtmlElementNotFound &&
+                    ! locations.empty()) {
+                    break;
+                }
+                return location.error();
+            }
+
+            locations.push_back(*location);
+        }
+
+        return Error::NoError;
     }
 
-    HtmlElementLocations locations;
     const HtmlTagMarks& tagMarks = *eTagMarks;
     size_t beginPos              = std::string::npos;
     size_t beginStopPos          = std::string::npos;
@@ -122,7 +366,7 @@ tl::expected<HtmlElementLocations, Error> HtmlParser::FindAllElements(
                 ! locations.empty()) {
                 break;
             }
-            return tl::unexpected(eBeginTagPos.error());
+            return eBeginTagPos.error();
         }
         beginPos     = eBeginTagPos->beginPos;
         beginStopPos = eBeginTagPos->beginStopPos;
@@ -140,13 +384,13 @@ tl::expected<HtmlElementLocations, Error> HtmlParser::FindAllElements(
         while (! tagMarks.end.empty()) {
             endPos = FindInInterval(tagMarks.end, ci);
             if (endPos == std::string::npos) {
-                return tl::unexpected(Error::IncompleteHtmlElement);
+                return Error::IncompleteHtmlElement;
             }
 
             auto eCount =
                 CountBeginTagMarks(tagMarks, {ci.Lower(), endPos - 1});
             if (! eCount) {
-                return tl::unexpected(eCount.error());
+                return eCount.error();
             }
 
             numOfBeginMarks += *eCount;
@@ -164,7 +408,98 @@ tl::expected<HtmlElementLocations, Error> HtmlParser::FindAllElements(
             {endPos, endPos + tagMarks.end.size() - 1}});
     }
 
-    return locations;
+    return Error::NoError;
+}
+
+void HtmlParser::ScanTagBoundaries()
+{
+    static const ScanVariant variant = GetFastestScanVariant();
+
+    ScanTagBoundaries(variant, m_htmlPage, m_ltBitmap, m_gtBitmap);
+}
+
+HtmlParser::ScanVariant HtmlParser::GetFastestScanVariant()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        return ScanVariant::Avx2;
+    }
+#endif
+
+#if defined(__SSE2__)
+    return ScanVariant::Sse2;
+#else
+    return ScanVariant::Scalar;
+#endif
+}
+
+bool HtmlParser::ScanTagBoundaries(
+    ScanVariant variant,
+    std::string_view data,
+    HtmlCharBitmap& lt,
+    HtmlCharBitmap& gt)
+{
+    ScanTagBoundariesFunc scan = nullptr;
+
+    switch (variant) {
+    case ScanVariant::Scalar:
+        scan = ScanTagBoundariesScalar;
+        break;
+    case ScanVariant::Sse2:
+#if defined(__SSE2__)
+        scan = ScanTagBoundariesSse2;
+#endif
+        break;
+    case ScanVariant::Avx2:
+#if defined(__x86_64__) || defined(__i386__)
+        if (__builtin_cpu_supports("avx2")) {
+            scan = ScanTagBoundariesAvx2;
+        }
+#endif
+        break;
+    }
+
+    if (scan == nullptr) {
+        return false;
+    }
+
+    lt.assign((data.size() + 63) / 64, 0);
+    gt.assign((data.size() + 63) / 64, 0);
+    scan(data.data(), data.size(), lt.data(), gt.data());
+
+    return true;
+}
+
+size_t HtmlParser::FindTagBoundary(std::string_view val, ClosedInterval ci)
+{
+    size_t lastPos = ci.Upper() - val.size() + 1;
+
+    // tag marks start with '<' or end with '>', so only the positions of
+    // these characters have to be compared
+    if (val.front() == '<') {
+        for (size_t pos = FindNextBit(m_ltBitmap, ci.Lower(), lastPos);
+             pos != std::string::npos;
+             pos = FindNextBit(m_ltBitmap, pos + 1, lastPos)) {
+            if (m_htmlPage.compare(pos, val.size(), val) == 0) {
+                return pos;
+            }
+        }
+
+        return std::string::npos;
+    }
+
+    for (size_t pos = FindNextBit(
+             m_gtBitmap,
+             ci.Lower() + val.size() - 1,
+             ci.Upper());
+         pos != std::string::npos;
+         pos = FindNextBit(m_gtBitmap, pos + 1, ci.Upper())) {
+        if (m_htmlPage.compare(pos - val.size() + 1, val.size(), val) == 0) {
+            return pos - val.size() + 1;
+        }
+    }
+
+    return std::string::npos;
 }
 
 size_t HtmlParser::FindInInterval(std::string_view val, ClosedInterval ci)
@@ -173,6 +508,11 @@ size_t HtmlParser::FindInInterval(std::string_view val, ClosedInterval ci)
         return std::string::npos;
     }
 
+    if (! m_ltBitmap.empty() && ! val.empty() && ci.Size() >= val.size() &&
+        (val.front() == '<' || val.back() == '>')) {
+        return FindTagBoundary(val, ci);
+    }
+
     std::string_view slice(m_htmlPage.c_str() + ci.Lower(), ci.Size());
 
     size_t pos = slice.find(val);
@@ -183,6 +523,145 @@ size_t HtmlParser::FindInInterval(std::string_view val, ClosedInterval ci)
     return ci.Lower() + pos;
 }
 
+const HtmlParser::HtmlTagIndex* HtmlParser::GetTagIndex(HtmlTag tag) const
+{
+    auto it = m_tagIndexes.find(tag);
+    if (it == m_tagIndexes.end()) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
+bool HtmlParser::FillTagIndex(
+    const HtmlTagMarks& tagMarks,
+    const std::vector<size_t>& beginPositions,
+    const std::vector<size_t>& endPositions,
+    HtmlTagIndex& index)
+{
+    std::vector<size_t> openTags;
+    size_t lastEndPos = std::string::npos;
+
+    index.clear();
+    index.reserve(beginPositions.size());
+
+    // Every begin tag mark must be complete, valid and outside of the previous
+    // begin tag, otherwise the sequential search has to report it or skips it
+    // depending on where the search starts, which the index can't reproduce.
+    for (size_t beginPos : beginPositions) {
+        size_t beginStopPos = FindInInterval(
+            tagMarks.beginStop,
+            {beginPos + tagMarks.begin.size(), m_htmlPage.size() - 1});
+        if (beginStopPos == std::string::npos) {
+            return false;
+        }
+
+        if (beginPos + tagMarks.begin.size() != beginStopPos &&
+            m_htmlPage[beginPos + tagMarks.begin.size()] != ' ') {
+            return false;
+        }
+
+        if (! index.empty() &&
+            beginPos <
+                index.back().beginStopPos + tagMarks.beginStop.size()) {
+            return false;
+        }
+
+        index.push_back(HtmlBeginTagRecord{
+            beginPos,
+            beginStopPos,
+            std::string::npos,
+            beginStopPos + tagMarks.beginStop.size()});
+    }
+
+    if (tagMarks.end.empty()) {
+        return true;
+    }
+
+    // Match begin and end tag marks in the same way the sequential search does
+    // it by counting nested begin tag marks. The sequential search resumes
+    // after the last nested end tag mark, so remember that position as well.
+    auto it = index.begin();
+    for (size_t endPos : endPositions) {
+        for (; it != index.end() && it->beginPos < endPos; ++it) {
+            openTags.push_back(it - index.begin());
+        }
+
+        if (it != index.begin() &&
+            endPos < std::prev(it)->beginStopPos + tagMarks.beginStop.size()) {
+            return false;
+        }
+
+        if (! openTags.empty()) {
+            HtmlBeginTagRecord& record = index[openTags.back()];
+            openTags.pop_back();
+
+            record.endPos = endPos;
+            if (lastEndPos != std::string::npos &&
+                lastEndPos > record.beginPos) {
+                record.nextSearchPos = lastEndPos + tagMarks.end.size();
+            }
+        }
+
+        lastEndPos = endPos;
+    }
+
+    return true;
+}
+
+tl::expected<HtmlElementLocation, Error> HtmlParser::FindIndexedElement(
+    const HtmlTagIndex& index,
+    const HtmlTagMarks& tagMarks,
+    std::string_view attrMark,
+    ClosedInterval& ci)
+{
+    auto it = std::lower_bound(
+        index.begin(),
+        index.end(),
+        ci.Lower(),
+        [](const HtmlBeginTagRecord& record, size_t pos) {
+            return record.beginPos < pos;
+        });
+
+    for (; it != index.end(); ++it) {
+        if (ci.Empty() ||
+            it->beginPos + tagMarks.begin.size() - 1 > ci.Upper()) {
+            break;
+        }
+
+        if (it->beginStopPos + tagMarks.beginStop.size() - 1 > ci.Upper()) {
+            return tl::unexpected(Error::IncompleteHtmlElement);
+        }
+        ci.SetLower(it->beginStopPos + tagMarks.beginStop.size());
+
+        if (! attrMark.empty() &&
+            FindInInterval(
+                attrMark,
+                {it->beginPos + tagMarks.begin.size(),
+                 it->beginStopPos - 1}) == std::string::npos) {
+            continue;
+        }
+
+        size_t endPos = it->beginStopPos + tagMarks.beginStop.size();
+        if (! tagMarks.end.empty()) {
+            if (it->endPos == std::string::npos ||
+                it->endPos + tagMarks.end.size() - 1 > ci.Upper()) {
+                return tl::unexpected(Error::IncompleteHtmlElement);
+            }
+
+            endPos = it->endPos;
+            ci.SetLower(it->nextSearchPos);
+        }
+
+        return HtmlElementLocation{
+            {it->beginPos, it->beginStopPos + tagMarks.beginStop.size() - 1},
+            {it->beginStopPos + tagMarks.beginStop.size(), endPos - 1},
+            {endPos, endPos + tagMarks.end.size() - 1}};
+    }
+
+    return tl::unexpected(Error::HtmlElementNotFound);
+}
+
 tl::expected<HtmlParser::HtmlBeginTagPosition, Error> HtmlParser::
     FindBeginTagMark(const HtmlTagMarks& tagMarks, ClosedInterval& ci)
 {
@@ -294,3 +773,162 @@ tl::expected<std::string, Error> HtmlParser::GetAttributeMark(
 
     return std::move(mark);
 }
+
+HtmlStreamParser::HtmlStreamParser(
+    HtmlTag scopeTag,
+    HtmlAttribute attr,
+    std::string_view attrValue,
+    HtmlTag rowTag,
+    RowCallback rowCallback)
+    : m_scopeTag(scopeTag),
+      m_rowTag(rowTag),
+      m_attr(attr),
+      m_attrValue(attrValue),
+      m_rowCallback(std::move(rowCallback))
+{
+}
+
+Error HtmlStreamParser::Feed(std::string_view chunk)
+{
+    if (m_state == State::Done) {
+        return Error::NoError;
+    }
+
+    m_buffer.append(chunk);
+
+    if (m_state == State::SearchingScope) {
+        Error err = FindScope();
+        if (err != Error::NoError) {
+            return err;
+        }
+    }
+
+    if (m_state == State::InScope) {
+        return ParseRows();
+    }
+
+    return Error::NoError;
+}
+
+Error HtmlStreamParser::Finish()
+{
+    switch (m_state) {
+    case State::SearchingScope:
+        return Error::HtmlElementNotFound;
+    case State::InScope:
+        return Error::IncompleteHtmlElement;
+    case State::Done:
+    default:
+        break;
+    }
+
+    return Error::NoError;
+}
+
+Error HtmlStreamParser::FindScope()
+{
+    auto eTagMarks = HtmlParser::GetTagMarks(m_scopeTag);
+    if (! eTagMarks) {
+        return eTagMarks.error();
+    }
+
+    auto eAttrMark = HtmlParser::GetAttributeMark(m_attr, m_attrValue);
+    if (! eAttrMark) {
+        return eAttrMark.error();
+    }
+
+    const HtmlParser::HtmlTagMarks& tagMarks = *eTagMarks;
+    std::string_view buffer(m_buffer);
+
+    while (true) {
+        size_t beginPos = buffer.find(tagMarks.begin, m_pos);
+        if (beginPos == std::string::npos) {
+            // keep what could be the start of a begin mark split in chunks
+            Discard(
+                buffer.size() -
+                std::min(buffer.size(), tagMarks.begin.size() - 1));
+            return Error::NoError;
+        }
+
+        size_t beginStopPos = buffer.find(
+            tagMarks.beginStop,
+            beginPos + tagMarks.begin.size());
+        if (beginStopPos == std::string::npos) {
+            Discard(beginPos);
+            return Error::NoError;
+        }
+        m_pos = beginStopPos + tagMarks.beginStop.size();
+
+        if (beginPos + tagMarks.begin.size() != beginStopPos &&
+            buffer[beginPos + tagMarks.begin.size()] != ' ') {
+            continue;
+        }
+
+        size_t attrPos =
+            buffer.substr(beginPos, beginStopPos - beginPos).find(*eAttrMark);
+        if (attrPos != std::string::npos) {
+            break;
+        }
+    }
+
+    Discard(m_pos);
+    m_state = State::InScope;
+
+    return Error::NoError;
+}
+
+Error HtmlStreamParser::ParseRows()
+{
+    auto eScopeMarks = HtmlParser::GetTagMarks(m_scopeTag);
+    if (! eScopeMarks) {
+        return eScopeMarks.error();
+    }
+
+    auto eRowMarks = HtmlParser::GetTagMarks(m_rowTag);
+    if (! eRowMarks) {
+        return eRowMarks.error();
+    }
+
+    std::string_view buffer(m_buffer);
+    HtmlParser html(m_buffer);
+
+    while (true) {
+        size_t rowPos = buffer.find(eRowMarks->begin, m_pos);
+        size_t endPos = buffer.substr(0, rowPos).find(eScopeMarks->end, m_pos);
+        if (endPos != std::string::npos) {
+            m_state = State::Done;
+            m_buffer.clear();
+            m_pos = 0;
+            return Error::NoError;
+        }
+
+        if (rowPos == std::string::npos) {
+            break;
+        }
+
+        auto eRow = html.FindElement(m_rowTag, {rowPos, buffer.size() - 1});
+        if (! eRow) {
+            if (eRow.error() == Error::IncompleteHtmlElement) {
+                break;
+            }
+            return eRow.error();
+        }
+
+        Error err = m_rowCallback(m_buffer, *eRow);
+        if (err != Error::NoError) {
+            return err;
+        }
+
+        m_pos = eRow->endTag.Upper() + 1;
+    }
+
+    Discard(m_pos);
+
+    return Error::NoError;
+}
+
+void HtmlStreamParser::Discard(size_t size)
+{
+    m_buffer.erase(0, size);
+    m_pos = m_pos > size ? m_pos - size : 0;
+}
@@ -0,0 +1,185 @@
+#include "http_cache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+
+// 64-bit FNV-1a, stable across runs and platforms unlike std::hash.
+static uint64_t HashKey(std::string_view key)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static bool StartsWithCi(std::string_view str, std::string_view prefix)
+{
+    return str.size() >= prefix.size() &&
+        std::equal(
+               prefix.begin(),
+               prefix.end(),
+               str.begin(),
+               [](char a, char b) {
+                   return std::tolower(static_cast<unsigned char>(a)) ==
+                       std::tolower(static_cast<unsigned char>(b));
+               });
+}
+
+static std::string_view Trim(std::string_view str)
+{
+    while (! str.empty() && std::isspace(static_cast<unsigned char>(str[0]))) {
+        str.remove_prefix(1);
+    }
+    while (! str.empty() &&
+           std::isspace(static_cast<unsigned char>(str.back()))) {
+        str.remove_suffix(1);
+    }
+
+    return str;
+}
+
+HttpCache::HttpCache(std::filesystem::path dirPath)
+    : m_dirPath(std::move(dirPath))
+{
+}
+
+std::optional<HttpCacheEntry> HttpCache::Load(std::string_view key) const
+{
+    std::ifstream file(GetFilePath(key), std::ios::binary);
+    if (! file) {
+        return std::nullopt;
+    }
+
+    HttpCacheEntry entry;
+    size_t keySize     = 0;
+    size_t headersSize = 0;
+    size_t bodySize    = 0;
+    int64_t storedAt   = 0;
+
+    file >> keySize >> headersSize >> bodySize >> entry.code >> storedAt;
+    file.ignore(1);
+    std::getline(file, entry.etag);
+    std::getline(file, entry.lastModified);
+    if (! file || keySize != key.size()) {
+        return std::nullopt;
+    }
+
+    std::string storedKey(keySize, '\0');
+    entry.headers.resize(headersSize);
+    entry.body.resize(bodySize);
+
+    file.read(storedKey.data(), keySize);
+    file.read(entry.headers.data(), headersSize);
+    file.read(entry.body.data(), bodySize);
+    if (! file || storedKey != key) {
+        return std::nullopt;
+    }
+
+    entry.storedAt = std::chrono::system_clock::time_point(
+        std::chrono::seconds(storedAt));
+
+    return entry;
+}
+
+bool HttpCache::Contains(std::string_view key) const
+{
+    std::error_code ec;
+
+    return std::filesystem::exists(GetFilePath(key), ec);
+}
+
+Error HttpCache::Store(std::string_view key, const HttpCacheEntry& entry) const
+{
+    std::error_code ec;
+
+    std::filesystem::create_directories(m_dirPath, ec);
+    if (ec) {
+        return Error::InvalidArg;
+    }
+
+    // the entry is written aside and renamed, so a concurrent run never
+    // reads a partial file
+    std::filesystem::path filePath = GetFilePath(key);
+    std::filesystem::path tmpPath  = filePath;
+    tmpPath += ".tmp";
+
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (! file) {
+            return Error::InvalidArg;
+        }
+
+        auto storedAt = std::chrono::duration_cast<std::chrono::seconds>(
+            entry.storedAt.time_since_epoch());
+
+        file << key.size() << ' ' << entry.headers.size() << ' '
+             << entry.body.size() << ' ' << entry.code << ' '
+             << storedAt.count() << '\n'
+             << entry.etag << '\n'
+             << entry.lastModified << '\n'
+             << key << entry.headers << entry.body;
+        if (! file) {
+            return Error::InvalidArg;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, filePath, ec);
+    if (ec) {
+        std::filesystem::remove(tmpPath, ec);
+        return Error::InvalidArg;
+    }
+
+    return Error::NoError;
+}
+
+void HttpCache::Remove(std::string_view key) const
+{
+    std::error_code ec;
+
+    std::filesystem::remove(GetFilePath(key), ec);
+}
+
+void HttpCache::ParseValidators(HttpCacheEntry& entry)
+{
+    static constexpr std::string_view kEtag         = "ETag:";
+    static constexpr std::string_view kLastModified = "Last-Modified:";
+
+    std::string_view headers = entry.headers;
+
+    entry.etag.clear();
+    entry.lastModified.clear();
+
+    // the headers of a redirect come first, the last values win
+    while (! headers.empty()) {
+        size_t end            = headers.find('\n');
+        std::string_view line = headers.substr(0, end);
+        headers.remove_prefix(
+            end == std::string_view::npos ? headers.size() : end + 1);
+
+        if (StartsWithCi(line, kEtag)) {
+            entry.etag = Trim(line.substr(kEtag.size()));
+        } else if (StartsWithCi(line, kLastModified)) {
+            entry.lastModified = Trim(line.substr(kLastModified.size()));
+        }
+    }
+}
+
+std::filesystem::path HttpCache::GetFilePath(std::string_view key) const
+{
+    char name[17];
+
+    std::snprintf(
+        name,
+        sizeof(name),
+        "%016llx",
+        static_cast<unsigned long long>(HashKey(key)));
+
+    return m_dirPath / name;
+}
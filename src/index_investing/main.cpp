@@ -7,8 +7,11 @@
 #include "terminal_ui.h"
 #include "tradeville.h"
 #include "tradeville_activity_filters.h"
+#include "tradeville_daemon.h"
 #include "tradeville_portfolio_filters.h"
 
+#include <csignal>
+#include <future>
 #include <iostream>
 #include <magic_enum.hpp>
 #include <string_view>
@@ -58,19 +61,10 @@ tl::expected<Index, Error> GetConfiguredIndex(const Config& cfg)
 {
     BvbScraper bvb;
 
-    auto indexes = bvb.LoadAdjustmentsHistoryFromFile(*cfg.GetIndexName());
-    if (! indexes) {
-        return tl::unexpected(indexes.error());
-    }
-
-    for (const auto& i : *indexes) {
-        if (i.date == *cfg.GetIndexAdjustmentDate() &&
-            i.reason == *cfg.GetIndexAdjustmentReason()) {
-            return i;
-        }
-    }
-
-    return tl::unexpected(Error::InvalidArg);
+    return bvb.LoadAdjustmentFromFile(
+        *cfg.GetIndexName(),
+        *cfg.GetIndexAdjustmentDate(),
+        *cfg.GetIndexAdjustmentReason());
 }
 
 void PrintAssetAndCurrencyValue(
@@ -115,21 +109,35 @@ int CmdPrintPortfolio(
     uint64_t startYear = std::stoull(*cfg.GetTradevilleStartYear());
     uint64_t endYear   = get_current_year();
 
-    auto dvdActivities = bvb.GetDividendActivities();
+    bvb.EnableHttpCache();
+    bvb.SetSessionArchive(SessionArchive::FromEnvironment());
+    tv.SetSessionArchive(SessionArchive::FromEnvironment());
+    tv.SetDaemonSocket(TradevilleDaemon::GetDefaultSocketPath());
+    tv.EnableActivityStore();
+
+    // BVB and Tradeville are queried at the same time, and both Tradeville
+    // requests are in flight together
+    auto dvdActivitiesRsp = std::async(std::launch::async, [&bvb]() {
+        return bvb.GetDividendActivities();
+    });
+    auto portfolioRsp  = tv.GetPortfolioAsync();
+    auto activitiesRsp = tv.GetActivityAsync(std::nullopt, startYear, endYear);
+
+    auto dvdActivities = dvdActivitiesRsp.get();
     if (! dvdActivities) {
         std::cout << "Failed to get dividend activities from BVB: "
                   << magic_enum::enum_name(dvdActivities.error()) << std::endl;
         return -1;
     }
 
-    auto portfolio = tv.GetPortfolio();
+    auto portfolio = portfolioRsp.get();
     if (! portfolio) {
         std::cout << "Failed to get portfolio: "
                   << magic_enum::enum_name(portfolio.error()) << std::endl;
         return -1;
     }
 
-    auto activities = tv.GetActivity(std::nullopt, startYear, endYear);
+    auto activities = activitiesRsp.get();
     if (! activities) {
         std::cout << "Failed to get activity: "
                   << magic_enum::enum_name(activities.error()) << std::endl;
@@ -181,7 +189,7 @@ int CmdPrintPortfolio(
         table.emplace_back(std::vector<ColorizedString>{
             std::to_string(id),
             i.account,
-            i.symbol,
+            i.symbol.Get(),
             quantity_to_string(i.quantity),
             double_to_string(i.avg_price, 4),
             double_to_string(i.market_price, 4),
@@ -230,7 +238,7 @@ int CmdPrintPortfolio(
 
             estDvdTable.emplace_back(std::vector<ColorizedString>{
                 std::to_string(id),
-                i.symbol,
+                i.symbol.Get(),
                 ColorizedString{double_to_string(i.estimated_dvd), estDvdColor},
                 double_to_string(i.estimated_net_dvd),
                 std::to_string(i.estimated_shares),
@@ -271,6 +279,10 @@ int CmdPrintActivity(const Config& cfg, const ActivityFilters& filters)
     uint64_t startYear = std::stoull(*cfg.GetTradevilleStartYear());
     uint64_t endYear   = get_current_year();
 
+    tv.SetSessionArchive(SessionArchive::FromEnvironment());
+    tv.SetDaemonSocket(TradevilleDaemon::GetDefaultSocketPath());
+    tv.EnableActivityStore();
+
     auto activities = tv.GetActivity(std::nullopt, startYear, endYear);
     if (! activities) {
         std::cout << "Failed to get activity: "
@@ -339,6 +351,10 @@ int CmdPrintDividends(const Config& cfg, uint64_t startYear, uint64_t endYear)
     std::map<uint64_t, std::map<Currency, double>> dividends;
     uint64_t year = 0;
 
+    tv.SetSessionArchive(SessionArchive::FromEnvironment());
+    tv.SetDaemonSocket(TradevilleDaemon::GetDefaultSocketPath());
+    tv.EnableActivityStore();
+
     auto activities = tv.GetActivity(std::nullopt, startYear, endYear);
     if (! activities) {
         std::cout << "Failed to get activity: "
@@ -392,46 +408,54 @@ tl::expected<IndexReplication::Entries, Error> GetIndexReplication(
     IndexReplication ir;
     Tradeville tv(*cfg.GetTradevilleUser(), *cfg.GetTradevillePass());
     BvbScraper bvb;
-    const Index* index = nullptr;
     uint64_t startYear = std::stoull(*cfg.GetTradevilleStartYear());
     uint64_t endYear   = get_current_year();
 
-    auto indexes = bvb.LoadAdjustmentsHistoryFromFile(*cfg.GetIndexName());
-    if (! indexes) {
-        std::cout << "Failed to load adjustments history: "
-                  << magic_enum::enum_name(indexes.error()) << std::endl;
-        return tl::unexpected(indexes.error());
-    }
-
-    for (const auto& i : *indexes) {
-        if (i.date == *cfg.GetIndexAdjustmentDate() &&
-            i.reason == *cfg.GetIndexAdjustmentReason()) {
-            index = &i;
-            break;
+    auto index = bvb.LoadAdjustmentFromFile(
+        *cfg.GetIndexName(),
+        *cfg.GetIndexAdjustmentDate(),
+        *cfg.GetIndexAdjustmentReason());
+    if (! index) {
+        if (index.error() == Error::InvalidArg) {
+            std::cout << "No index adjustments found with specific date and "
+                         "reason"
+                      << std::endl;
+        } else {
+            std::cout << "Failed to load adjustments history: "
+                      << magic_enum::enum_name(index.error()) << std::endl;
         }
+        return tl::unexpected(index.error());
     }
 
-    if (index == nullptr) {
-        std::cout << "No index adjustments found with specific date and reason"
-                  << std::endl;
-        return tl::unexpected(Error::InvalidArg);
-    }
+    bvb.EnableHttpCache();
+    bvb.SetSessionArchive(SessionArchive::FromEnvironment());
+    tv.SetSessionArchive(SessionArchive::FromEnvironment());
+    tv.SetDaemonSocket(TradevilleDaemon::GetDefaultSocketPath());
+    tv.EnableActivityStore();
 
-    auto dvdActivities = bvb.GetDividendActivities();
+    // BVB and Tradeville are queried at the same time, and both Tradeville
+    // requests are in flight together
+    auto dvdActivitiesRsp = std::async(std::launch::async, [&bvb]() {
+        return bvb.GetDividendActivities();
+    });
+    auto portfolioRsp  = tv.GetPortfolioAsync();
+    auto activitiesRsp = tv.GetActivityAsync(std::nullopt, startYear, endYear);
+
+    auto dvdActivities = dvdActivitiesRsp.get();
     if (! dvdActivities) {
         std::cout << "Failed to get dividend activities from BVB: "
                   << magic_enum::enum_name(dvdActivities.error()) << std::endl;
         return tl::unexpected(dvdActivities.error());
     }
 
-    auto portfolio = tv.GetPortfolio();
+    auto portfolio = portfolioRsp.get();
     if (! portfolio) {
         std::cout << "Failed to get portfolio: "
                   << magic_enum::enum_name(portfolio.error()) << std::endl;
         return tl::unexpected(portfolio.error());
     }
 
-    auto activities = tv.GetActivity(std::nullopt, startYear, endYear);
+    auto activities = activitiesRsp.get();
     if (! activities) {
         std::cout << "Failed to get activity: "
                   << magic_enum::enum_name(activities.error()) << std::endl;
@@ -568,7 +592,7 @@ int CmdPrintIndexReplication(
 
         indexReplicationTable.emplace_back(std::vector<ColorizedString>{
             std::to_string(id),
-            i.symbol,
+            i.symbol.Get(),
             double_to_string(i.weight * 100.0),
             double_to_string(i.avg_price, 6),
             double_to_string(i.market_price, 6),
@@ -597,7 +621,7 @@ int CmdPrintIndexReplication(
 
         profitTable.emplace_back(std::vector<ColorizedString>{
             std::to_string(id),
-            i.symbol,
+            i.symbol.Get(),
             double_to_string(i.cost),
             double_to_string(i.value),
             double_to_string(i.dividends),
@@ -697,6 +721,9 @@ int CmdSaveTradevilleActivity(const Config& cfg, uint64_t year)
 {
     Tradeville tv(*cfg.GetTradevilleUser(), *cfg.GetTradevillePass());
 
+    tv.SetSessionArchive(SessionArchive::FromEnvironment());
+    tv.SetDaemonSocket(TradevilleDaemon::GetDefaultSocketPath());
+
     Error err = tv.SaveActivityToFile(year);
     if (err != Error::NoError) {
         std::cout << "Failed to save Tradeville activity to file: "
@@ -713,6 +740,9 @@ int CmdSaveTradevillePortfolio(const Config& cfg)
 {
     Tradeville tv(*cfg.GetTradevilleUser(), *cfg.GetTradevillePass());
 
+    tv.SetSessionArchive(SessionArchive::FromEnvironment());
+    tv.SetDaemonSocket(TradevilleDaemon::GetDefaultSocketPath());
+
     Error err = tv.SavePortfolioToFile();
     if (err != Error::NoError) {
         std::cout << "Failed to save Tradeville portfolio to file: "
@@ -726,6 +756,32 @@ int CmdSaveTradevillePortfolio(const Config& cfg)
     return 0;
 }
 
+int CmdRunTradevilleDaemon(const Config& cfg)
+{
+    static TradevilleDaemon* daemon = nullptr;
+
+    Tradeville tv(*cfg.GetTradevilleUser(), *cfg.GetTradevillePass());
+    TradevilleDaemon tvd(tv, TradevilleDaemon::GetDefaultSocketPath());
+
+    tv.SetSessionArchive(SessionArchive::FromEnvironment());
+
+    daemon = &tvd;
+    std::signal(SIGINT, [](int) { daemon->Stop(); });
+    std::signal(SIGTERM, [](int) { daemon->Stop(); });
+
+    std::cout << "Serving Tradeville requests on "
+              << TradevilleDaemon::GetDefaultSocketPath().string() << std::endl;
+
+    Error err = tvd.Run();
+    if (err != Error::NoError) {
+        std::cout << "Failed to run the Tradeville daemon: "
+                  << magic_enum::enum_name(err) << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
 void CmdPrintHelp()
 {
     std::cout << "Supported commands:" << std::endl;
@@ -761,6 +817,10 @@ void CmdPrintHelp()
               << std::endl;
     std::cout << "--stvp - save the portfolio from tradeville to file."
               << std::endl;
+    std::cout << "--tvd - keeps a tradeville session open in the background "
+                 "until interrupted. The other commands use it while it runs, "
+                 "so they don't connect and log in every time."
+              << std::endl;
 }
 
 bool ParseActivityFilters(
@@ -1145,6 +1205,8 @@ int main(int argc, char* argv[])
         return CmdSaveTradevilleActivity(cfg, year);
     } else if (strcmp(argv[1], "--stvp") == 0) {
         return CmdSaveTradevillePortfolio(cfg);
+    } else if (strcmp(argv[1], "--tvd") == 0) {
+        return CmdRunTradevilleDaemon(cfg);
     } else if (strcmp(argv[1], "--ui") == 0) {
         TerminalUi tui(cfg);
 
@@ -2,6 +2,7 @@
 
 #include "chrono_utils.h"
 #include "string_utils.h"
+#include "tradeville_daemon.h"
 
 #include <magic_enum.hpp>
 
@@ -119,20 +120,10 @@ void TerminalUi::LoadIndex()
 {
     BvbScraper bvb;
 
-    auto indexes = bvb.LoadAdjustmentsHistoryFromFile(*m_config.GetIndexName());
-    if (! indexes) {
-        m_index = tl::unexpected(indexes.error());
-    }
-
-    for (const auto& i : *indexes) {
-        if (i.date == *m_config.GetIndexAdjustmentDate() &&
-            i.reason == *m_config.GetIndexAdjustmentReason()) {
-            m_index = i;
-            return;
-        }
-    }
-
-    m_index = tl::unexpected(Error::InvalidArg);
+    m_index = bvb.LoadAdjustmentFromFile(
+        *m_config.GetIndexName(),
+        *m_config.GetIndexAdjustmentDate(),
+        *m_config.GetIndexAdjustmentReason());
 }
 
 void TerminalUi::GetDataFromTradeville()
@@ -141,12 +132,19 @@ void TerminalUi::GetDataFromTradeville()
     uint64_t startYear = std::stoull(*m_config.GetTradevilleStartYear());
     uint64_t endYear   = get_current_year();
 
-    m_portfolio = tv.GetPortfolio();
+    tv.SetSessionArchive(SessionArchive::FromEnvironment());
+    tv.SetDaemonSocket(TradevilleDaemon::GetDefaultSocketPath());
+    tv.EnableActivityStore();
+
+    auto portfolioRsp  = tv.GetPortfolioAsync();
+    auto activitiesRsp = tv.GetActivityAsync(std::nullopt, startYear, endYear);
+
+    m_portfolio = portfolioRsp.get();
     if (! m_portfolio) {
         return;
     }
 
-    m_activities = tv.GetActivity(std::nullopt, startYear, endYear);
+    m_activities = activitiesRsp.get();
     if (! m_activities) {
         return;
     }
@@ -0,0 +1,64 @@
+#include "interned_string.h"
+
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
+
+struct StringHash
+{
+    using is_transparent = void;
+
+    size_t operator()(std::string_view str) const
+    {
+        return std::hash<std::string_view>()(str);
+    }
+};
+
+// The nodes of the set don't move, so the pointers to its strings stay
+// valid while it grows.
+struct StringTable
+{
+    std::shared_mutex mutex;
+    std::unordered_set<std::string, StringHash, std::equal_to<>> strings;
+};
+
+static StringTable& GetStringTable()
+{
+    static StringTable table;
+
+    return table;
+}
+
+static const std::string* Intern(std::string_view str)
+{
+    static const std::string empty;
+    StringTable& table = GetStringTable();
+
+    if (str.empty()) {
+        return &empty;
+    }
+
+    // most strings are interned already, they only need the shared lock
+    {
+        std::shared_lock<std::shared_mutex> lock(table.mutex);
+
+        auto it = table.strings.find(str);
+        if (it != table.strings.end()) {
+            return &*it;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(table.mutex);
+
+    return &*table.strings.emplace(str).first;
+}
+
+InternedString::InternedString()
+    : m_str(Intern({}))
+{
+}
+
+InternedString::InternedString(std::string_view str)
+    : m_str(Intern(str))
+{
+}
@@ -0,0 +1,59 @@
+#include "mapped_file.h"
+
+// posix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+Error MappedFile::Open(const std::filesystem::path& path)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return Error::InvalidArg;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return Error::InvalidArg;
+    }
+
+    // an empty file can't be mapped, it is just empty data
+    if (st.st_size > 0) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            return Error::InvalidArg;
+        }
+
+        m_addr = addr;
+        m_size = st.st_size;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+
+    return Error::NoError;
+}
+
+void MappedFile::Close()
+{
+    if (m_addr != nullptr) {
+        munmap(m_addr, m_size);
+        m_addr = nullptr;
+        m_size = 0;
+    }
+}
+
+std::string_view MappedFile::GetData() const
+{
+    return std::string_view(static_cast<const char*>(m_addr), m_size);
+}
@@ -0,0 +1,82 @@
+#include "session_archive.h"
+
+#include <cstdlib>
+#include <memory>
+
+static std::string GetExchangeKey(std::string_view request, size_t index)
+{
+    std::string key(request);
+
+    key += "\n#";
+    key += std::to_string(index);
+
+    return key;
+}
+
+SessionArchive::SessionArchive(std::filesystem::path dirPath, Mode mode)
+    : m_mode(mode), m_store(std::move(dirPath))
+{
+}
+
+std::string SessionArchive::NextKey(std::string_view request)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t& sent    = m_sent[std::string(request)];
+    std::string key = GetExchangeKey(request, sent);
+
+    // once the recorded exchanges are used up the last one is repeated
+    if (m_mode == Mode::Replay && sent > 0 && ! m_store.Contains(key)) {
+        return GetExchangeKey(request, sent - 1);
+    }
+
+    sent++;
+    return key;
+}
+
+Error SessionArchive::Record(
+    std::string_view key,
+    const HttpCacheEntry& entry) const
+{
+    return m_store.Store(key, entry);
+}
+
+tl::expected<HttpCacheEntry, Error> SessionArchive::Replay(
+    std::string_view key) const
+{
+    auto entry = m_store.Load(key);
+    if (! entry) {
+        return tl::unexpected(Error::NotRecorded);
+    }
+
+    return std::move(*entry);
+}
+
+SessionArchive* SessionArchive::FromEnvironment()
+{
+    static std::unique_ptr<SessionArchive> archive = []() {
+        static constexpr std::string_view kRecord = "record:";
+        static constexpr std::string_view kReplay = "replay:";
+
+        const char* env = std::getenv("SET_SESSION_ARCHIVE");
+        if (env == nullptr) {
+            return std::unique_ptr<SessionArchive>();
+        }
+
+        std::string_view spec = env;
+        if (spec.starts_with(kRecord) && spec.size() > kRecord.size()) {
+            return std::make_unique<SessionArchive>(
+                spec.substr(kRecord.size()),
+                Mode::Record);
+        }
+        if (spec.starts_with(kReplay) && spec.size() > kReplay.size()) {
+            return std::make_unique<SessionArchive>(
+                spec.substr(kReplay.size()),
+                Mode::Replay);
+        }
+
+        return std::unique_ptr<SessionArchive>();
+    }();
+
+    return archive.get();
+}
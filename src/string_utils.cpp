@@ -1,6 +1,7 @@
 #include "string_utils.h"
 
 #include <algorithm>
+#include <charconv>
 #include <iomanip>
 #include <locale>
 #include <sstream>
@@ -142,7 +143,7 @@ std::vector<std::string> split_string(
 }
 
 bool parse_mdy_date(
-    const std::string& str,
+    std::string_view str,
     uint8_t& month,
     uint8_t& day,
     uint16_t& year)
@@ -151,40 +152,36 @@ bool parse_mdy_date(
     day   = 0;
     year  = 0;
 
-    auto validator = [](const std::string& s) -> bool {
-        for (char c : s) {
-            if (! std::isdigit(c)) {
-                return false;
-            }
-        }
-        return true;
-    };
-
-    auto setter = [](const std::string& s,
+    auto setter = [](std::string_view s,
                      auto& value,
                      unsigned long min,
                      unsigned long max) -> bool {
-        unsigned long tmp = std::stoul(s);
-        if (tmp < min || tmp > max) {
+        unsigned long tmp = 0;
+        if (s.empty() || ! std::all_of(s.begin(), s.end(), ::isdigit)) {
+            return false;
+        }
+        auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), tmp);
+        if (ec != std::errc{} || tmp < min || tmp > max) {
             return false;
         }
         value = static_cast<std::remove_cvref_t<decltype(value)>>(tmp);
         return true;
     };
 
-    std::vector<std::string> tokens = split_string(str, '/');
-    if (tokens.size() != 3) {
+    size_t first = str.find('/');
+    if (first == std::string_view::npos) {
         return false;
     }
 
-    for (const auto& t : tokens) {
-        if (! validator(t)) {
-            return false;
-        }
+    size_t second = str.find('/', first + 1);
+    if (second == std::string_view::npos ||
+        str.find('/', second + 1) != std::string_view::npos) {
+        return false;
     }
 
-    if (! setter(tokens[0], month, 1, 12) || ! setter(tokens[1], day, 1, 31) ||
-        ! setter(tokens[2], year, 2000, 3000)) {
+    if (! setter(str.substr(0, first), month, 1, 12) ||
+        ! setter(str.substr(first + 1, second - first - 1), day, 1, 31) ||
+        ! setter(str.substr(second + 1), year, 2000, 3000)) {
         return false;
     }
 
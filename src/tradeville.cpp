@@ -2,10 +2,14 @@
 
 #include "chrono_utils.h"
 #include "string_utils.h"
+#include "tradeville_daemon.h"
 
+#include <array>
 #include <fstream>
 #include <iomanip>
+#include <iterator>
 #include <magic_enum.hpp>
+#include <optional>
 
 tl::expected<AssetValue, Error> Portfolio::GetValueByAsset(
     Currency currency,
@@ -341,51 +345,79 @@ Error Portfolio::CalculateEstimateShares(
     return Error::NoError;
 }
 
+Tradeville::Tradeville(const std::string& user, const std::string& pass)
+    : m_username(user), m_password(pass), m_wsConn(kHost, kPort)
+{
+    m_wsConn.SetMessageKey(GetMessageKey);
+}
+
 tl::expected<Portfolio, Error> Tradeville::GetPortfolio()
+{
+    return GetPortfolioAsync().get();
+}
+
+tl::expected<Activities, Error> Tradeville::GetActivity(
+    std::optional<std::string> symbol,
+    uint64_t startYear,
+    uint64_t endYear)
+{
+    return GetActivityAsync(std::move(symbol), startYear, endYear).get();
+}
+
+std::future<tl::expected<Portfolio, Error>> Tradeville::GetPortfolioAsync()
 {
     static constexpr const char* kRequest =
         "{ \"cmd\": \"Portfolio\", \"prm\": { \"data\": \"null\" } } ";
 
-    Error err = InitConnection();
-    if (err != Error::NoError) {
-        return tl::unexpected(err);
-    }
-
-    auto rsp = m_wsConn.SendRequest(kRequest);
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
-    }
+    return std::async(
+        std::launch::deferred,
+        [this, rsp = SendRequestAsync(kRequest)]() mutable
+        -> tl::expected<Portfolio, Error> {
+            auto data = rsp.get();
+            if (! data) {
+                return tl::unexpected(data.error());
+            }
 
-    auto json = ValidatePortfolioJson(*rsp);
-    if (! json) {
-        return tl::unexpected(json.error());
-    }
+            auto json = ValidatePortfolioJson(*data);
+            if (! json) {
+                return tl::unexpected(json.error());
+            }
 
-    return ParsePortfolio(*json);
+            return ParsePortfolio(*json);
+        });
 }
 
-tl::expected<Activities, Error> Tradeville::GetActivity(
+std::future<tl::expected<Activities, Error>> Tradeville::GetActivityAsync(
     std::optional<std::string> symbol,
     uint64_t startYear,
     uint64_t endYear)
 {
-    Error err = InitConnection();
-    if (err != Error::NoError) {
-        return tl::unexpected(err);
+    if (m_activityStore && ! symbol) {
+        return GetActivityFromStoreAsync(startYear, endYear);
     }
 
     std::string req = GetActivityRequest(symbol, startYear, endYear);
-    auto rsp        = m_wsConn.SendRequest(req);
-    if (! rsp) {
-        return tl::unexpected(rsp.error());
-    }
 
-    auto json = ValidateActivityJson(*rsp, symbol, startYear, endYear);
-    if (! json) {
-        return tl::unexpected(json.error());
-    }
+    return std::async(
+        std::launch::deferred,
+        [this,
+         symbol = std::move(symbol),
+         startYear,
+         endYear,
+         rsp = SendRequestAsync(req)]() mutable
+        -> tl::expected<Activities, Error> {
+            auto data = rsp.get();
+            if (! data) {
+                return tl::unexpected(data.error());
+            }
+
+            auto json = ValidateActivityJson(*data, symbol, startYear, endYear);
+            if (! json) {
+                return tl::unexpected(json.error());
+            }
 
-    return ParseActivity(*json);
+            return ParseActivity(*json);
+        });
 }
 
 Error Tradeville::SavePortfolioToFile()
@@ -393,17 +425,14 @@ Error Tradeville::SavePortfolioToFile()
     static constexpr const char* kRequest =
         "{ \"cmd\": \"Portfolio\", \"prm\": { \"data\": \"null\" } } ";
 
-    Error err = InitConnection();
-    if (err != Error::NoError) {
-        return err;
-    }
-
-    auto rsp = m_wsConn.SendRequest(kRequest);
+    auto rsp = SendRequestAsync(kRequest).get();
     if (! rsp) {
         return rsp.error();
     }
 
-    auto json = ValidatePortfolioJson(*rsp);
+    // parsed in place, the response is saved as it came
+    std::string data = *rsp;
+    auto json        = ValidatePortfolioJson(data);
     if (! json) {
         return json.error();
     }
@@ -421,27 +450,20 @@ Error Tradeville::SavePortfolioToFile()
 
 Error Tradeville::SaveActivityToFile(uint64_t year)
 {
-    Error err = InitConnection();
-    if (err != Error::NoError) {
-        return err;
-    }
-
     std::string req = GetActivityRequest(std::nullopt, year, year);
-    auto rsp        = m_wsConn.SendRequest(req);
+    auto rsp        = SendRequestAsync(req).get();
     if (! rsp) {
         return rsp.error();
     }
 
-    auto json = ValidateActivityJson(*rsp, std::nullopt, year, year);
+    // parsed in place, the response is saved as it came
+    std::string data = *rsp;
+    auto json        = ValidateActivityJson(data, std::nullopt, year, year);
     if (! json) {
         return json.error();
     }
 
-    std::string fileName = "tradeville_activity_";
-    fileName += std::to_string(year);
-    fileName += ".txt";
-
-    std::ofstream file(fileName);
+    std::ofstream file(GetActivityFileName(year));
     if (! file) {
         return Error::FileNotFound;
     }
@@ -452,6 +474,92 @@ Error Tradeville::SaveActivityToFile(uint64_t year)
     return Error::NoError;
 }
 
+void Tradeville::SetSessionArchive(SessionArchive* archive)
+{
+    m_archive = archive;
+    m_wsConn.SetSessionArchive(archive);
+}
+
+void Tradeville::EnableActivityStore(const std::filesystem::path& dirPath)
+{
+    // the accounts of several users don't mix
+    m_activityStore = dirPath / m_username;
+}
+
+void Tradeville::SetDaemonSocket(std::filesystem::path socketPath)
+{
+    m_daemonSocket = std::move(socketPath);
+}
+
+// Returns the value of the string or null field name of json, without the
+// quotes, or nullopt if the field is missing. The messages are not parsed, the
+// field is searched in the text.
+static std::optional<std::string_view> FindJsonField(
+    std::string_view json,
+    std::string_view name)
+{
+    std::string key = "\"" + std::string(name) + "\"";
+
+    size_t pos = json.find(key);
+    if (pos == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    pos = json.find_first_not_of(" \t\r\n:", pos + key.size());
+    if (pos == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    if (json[pos] != '"') {
+        size_t endPos = json.find_first_of(",} \t\r\n", pos);
+        return json.substr(pos, endPos - pos);
+    }
+
+    size_t endPos = json.find('"', pos + 1);
+    if (endPos == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    return json.substr(pos + 1, endPos - pos - 1);
+}
+
+std::string Tradeville::GetMessageKey(std::string_view msg)
+{
+    static constexpr std::string_view kPrmKey = "\"prm\"";
+    static constexpr std::array<std::string_view, 3> kPrmFields = {
+        "symbol",
+        "dstart",
+        "dend",
+    };
+
+    auto cmd = FindJsonField(msg, "cmd");
+    if (! cmd) {
+        return {};
+    }
+
+    std::string key(*cmd);
+
+    // the parameters are echoed in the response, so the requests with the
+    // same command, e.g. the activity of different years, are told apart
+    size_t prmPos = msg.find(kPrmKey);
+    if (prmPos == std::string_view::npos) {
+        return key;
+    }
+
+    std::string_view prm = msg.substr(prmPos, msg.find('}', prmPos) - prmPos);
+    for (auto field : kPrmFields) {
+        auto value = FindJsonField(prm, field);
+        if (value) {
+            key += '|';
+            key += field;
+            key += '=';
+            key += *value;
+        }
+    }
+
+    return key;
+}
+
 Error Tradeville::InitConnection()
 {
     if (m_wsConn.IsConnected() == true) {
@@ -463,8 +571,9 @@ Error Tradeville::InitConnection()
         return err;
     }
 
+    // the password is kept out of the session archive
     std::string loginReq = GetLoginRequest();
-    auto rsp             = m_wsConn.SendRequest(loginReq);
+    auto rsp = m_wsConn.SendRequest(loginReq, "login " + m_username);
     if (! rsp) {
         return rsp.error();
     }
@@ -476,6 +585,32 @@ Error Tradeville::InitConnection()
     return Error::NoError;
 }
 
+std::future<WebsocketConnection::Response> Tradeville::SendRequestAsync(
+    const std::string& req)
+{
+    if (m_archive == nullptr && ! m_daemonSocket.empty()) {
+        auto rsp = TradevilleDaemon::SendRequestAsync(
+            m_daemonSocket,
+            m_username,
+            req);
+        if (rsp) {
+            return std::move(*rsp);
+        }
+
+        // no daemon, the next requests don't look for it anymore
+        m_daemonSocket.clear();
+    }
+
+    Error err = InitConnection();
+    if (err != Error::NoError) {
+        std::promise<WebsocketConnection::Response> promise;
+        promise.set_value(tl::unexpected(err));
+        return promise.get_future();
+    }
+
+    return m_wsConn.SendRequestAsync(req);
+}
+
 std::string Tradeville::GetLoginRequest()
 {
     rapidjson::StringBuffer strBuff;
@@ -546,7 +681,7 @@ bool Tradeville::VerifyLoginResponse(const std::string& data)
 }
 
 tl::expected<rapidjson::Document, Error> Tradeville::ValidatePortfolioJson(
-    const std::string& data)
+    std::string& data)
 {
     static std::vector<std::string_view> kDataArrays = {
         "Account",
@@ -559,7 +694,8 @@ tl::expected<rapidjson::Document, Error> Tradeville::ValidatePortfolioJson(
     };
 
     rapidjson::Document doc;
-    doc.Parse(data.c_str(), data.size());
+    // the strings of the document point into data instead of being copied
+    doc.ParseInsitu(data.data());
 
     if (doc.IsObject() == false) {
         return tl::unexpected(Error::UnexpectedData);
@@ -829,6 +965,122 @@ Error Tradeville::ParsePortfolioCurrency(
     return Error::NoError;
 }
 
+std::string Tradeville::GetActivityFileName(uint64_t year)
+{
+    std::string fileName = "tradeville_activity_";
+    fileName += std::to_string(year);
+    fileName += ".txt";
+
+    return fileName;
+}
+
+std::future<tl::expected<Activities, Error>> Tradeville::
+    GetActivityFromStoreAsync(uint64_t startYear, uint64_t endYear)
+{
+    struct YearActivity
+    {
+        uint64_t year = 0;
+        std::optional<std::string> stored;
+        std::future<WebsocketConnection::Response> rsp;
+    };
+
+    std::vector<YearActivity> years;
+    uint64_t currentYear = get_current_year();
+
+    // the past years are loaded from the store, the missing ones and the
+    // current one are requested together
+    for (uint64_t year = startYear; year <= endYear; year++) {
+        YearActivity& ya = years.emplace_back();
+        ya.year          = year;
+
+        std::ifstream file(
+            *m_activityStore / GetActivityFileName(year),
+            std::ios::binary);
+        if (year < currentYear && file) {
+            ya.stored = std::string(
+                (std::istreambuf_iterator<char>(file)),
+                std::istreambuf_iterator<char>());
+        } else {
+            ya.rsp =
+                SendRequestAsync(GetActivityRequest(std::nullopt, year, year));
+        }
+    }
+
+    return std::async(
+        std::launch::deferred,
+        [this, currentYear, years = std::move(years)]() mutable
+        -> tl::expected<Activities, Error> {
+            Activities activities;
+
+            for (auto& ya : years) {
+                std::string data;
+                if (ya.stored) {
+                    data = std::move(*ya.stored);
+                } else {
+                    auto rsp = ya.rsp.get();
+                    if (! rsp) {
+                        return tl::unexpected(rsp.error());
+                    }
+                    data = std::move(*rsp);
+                }
+
+                // a past year is complete, later runs don't download it. It
+                // is parsed in place, so the text to store is copied.
+                std::optional<std::string> toStore;
+                if (! ya.stored && ya.year < currentYear) {
+                    toStore = data;
+                }
+
+                auto json =
+                    ValidateActivityJson(data, std::nullopt, ya.year, ya.year);
+                if (! json) {
+                    return tl::unexpected(json.error());
+                }
+
+                auto yearActivities = ParseActivity(*json);
+                if (! yearActivities) {
+                    return tl::unexpected(yearActivities.error());
+                }
+
+                if (toStore) {
+                    StoreActivity(ya.year, *toStore);
+                }
+
+                activities.insert(
+                    activities.end(),
+                    std::make_move_iterator(yearActivities->begin()),
+                    std::make_move_iterator(yearActivities->end()));
+            }
+
+            return activities;
+        });
+}
+
+void Tradeville::StoreActivity(uint64_t year, const std::string& data)
+{
+    std::error_code ec;
+    std::filesystem::path filePath =
+        *m_activityStore / GetActivityFileName(year);
+    std::filesystem::path tmpPath = filePath;
+    tmpPath += ".tmp";
+
+    std::filesystem::create_directories(*m_activityStore, ec);
+
+    // written aside and renamed, so a partial file is never loaded
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file << data;
+        if (! file) {
+            return;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, filePath, ec);
+    if (ec) {
+        std::filesystem::remove(tmpPath, ec);
+    }
+}
+
 std::string Tradeville::GetActivityRequest(
     const std::optional<std::string>& symbol,
     uint64_t startYear,
@@ -871,7 +1123,7 @@ std::string Tradeville::GetActivityRequest(
 }
 
 tl::expected<rapidjson::Document, Error> Tradeville::ValidateActivityJson(
-    const std::string& data,
+    std::string& data,
     const std::optional<std::string>& symbol,
     uint64_t startYear,
     uint64_t endYear)
@@ -900,7 +1152,8 @@ tl::expected<rapidjson::Document, Error> Tradeville::ValidateActivityJson(
     std::string dstart = "1jan" + std::to_string(startYear % 100);
     std::string dend   = "31dec" + std::to_string(endYear % 100);
 
-    doc.Parse(data.c_str(), data.size());
+    // the strings of the document point into data instead of being copied
+    doc.ParseInsitu(data.data());
 
     if (doc.IsObject() == false) {
         return tl::unexpected(Error::UnexpectedData);
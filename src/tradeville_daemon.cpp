@@ -0,0 +1,424 @@
+#include "tradeville_daemon.h"
+
+#include "tradeville.h"
+
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <list>
+#include <optional>
+#include <sstream>
+#include <string_view>
+
+// posix
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// the requests are small, anything bigger is not from the tool
+static constexpr size_t kMaxRequestSize = 64 * 1024;
+static constexpr size_t kMaxHeaderSize  = 256;
+static constexpr int kPollTimeoutMs     = 1000;
+
+// Owns the file descriptor of a connected socket.
+class UnixSocket : private noncopyable {
+public:
+    explicit UnixSocket(int fd)
+        : m_fd(fd)
+    {
+    }
+    UnixSocket(UnixSocket&& other)
+        : m_fd(other.m_fd)
+    {
+        other.m_fd = -1;
+    }
+    ~UnixSocket()
+    {
+        if (m_fd != -1) {
+            close(m_fd);
+        }
+    }
+
+    int Get() const
+    {
+        return m_fd;
+    }
+
+private:
+    int m_fd;
+};
+
+static bool FillAddress(const std::filesystem::path& path, sockaddr_un& addr)
+{
+    const std::string& str = path.native();
+
+    addr            = {};
+    addr.sun_family = AF_UNIX;
+    if (str.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    str.copy(addr.sun_path, str.size());
+
+    return true;
+}
+
+// Whether the process at the other end of the socket runs as the current
+// user. The socket path alone does not prove it, e.g. a socket in a shared
+// directory can be created by anyone.
+static bool IsPeerOwnUser(int fd)
+{
+    ucred cred    = {};
+    socklen_t len = sizeof(cred);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 ||
+        len != sizeof(cred)) {
+        return false;
+    }
+
+    return cred.uid == getuid();
+}
+
+// Creates dirPath if it is missing, only the current user may use it. An
+// existing one has to be owned by the current user and not writable by the
+// others, so nobody else can replace the socket in it.
+static bool PreparePrivateDir(const std::filesystem::path& dirPath)
+{
+    struct stat st = {};
+
+    if (mkdir(dirPath.c_str(), S_IRWXU) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    return lstat(dirPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode) &&
+        st.st_uid == getuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+static std::optional<UnixSocket> ConnectTo(const std::filesystem::path& path)
+{
+    sockaddr_un addr;
+    if (! FillAddress(path, addr)) {
+        return std::nullopt;
+    }
+
+    UnixSocket sock(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (sock.Get() == -1) {
+        return std::nullopt;
+    }
+
+    auto* sockAddr = reinterpret_cast<sockaddr*>(&addr);
+    if (connect(sock.Get(), sockAddr, sizeof(addr)) != 0) {
+        return std::nullopt;
+    }
+
+    // the requests carry the credentials of the user, they are not sent to
+    // a daemon of somebody else
+    if (! IsPeerOwnUser(sock.Get())) {
+        return std::nullopt;
+    }
+
+    return sock;
+}
+
+static bool WriteAll(int fd, std::string_view data)
+{
+    while (! data.empty()) {
+        ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data.remove_prefix(n);
+    }
+
+    return true;
+}
+
+static std::optional<std::string> ReadAll(int fd, size_t size)
+{
+    std::string data(size, '\0');
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = recv(fd, data.data() + done, size - done, 0);
+        if (n <= 0) {
+            return std::nullopt;
+        }
+        done += n;
+    }
+
+    return data;
+}
+
+// Reads the "<word> <size>\n" header of a message.
+static std::optional<std::pair<std::string, size_t>> ReadHeader(int fd)
+{
+    std::string line;
+    char c = '\0';
+
+    while (line.size() < kMaxHeaderSize) {
+        if (recv(fd, &c, 1, 0) != 1) {
+            return std::nullopt;
+        }
+        if (c == '\n') {
+            break;
+        }
+        line.push_back(c);
+    }
+
+    std::istringstream stream(line);
+    std::string word;
+    size_t size = 0;
+
+    if (c != '\n' || ! (stream >> word >> size)) {
+        return std::nullopt;
+    }
+
+    return std::make_pair(std::move(word), size);
+}
+
+TradevilleDaemon::TradevilleDaemon(
+    Tradeville& tradeville,
+    std::filesystem::path socketPath)
+    : m_tradeville(tradeville), m_socketPath(std::move(socketPath))
+{
+    m_tradeville.m_wsConn.SetKeepAlive(kHeartbeatInterval);
+}
+
+TradevilleDaemon::~TradevilleDaemon()
+{
+    Unlisten();
+}
+
+Error TradevilleDaemon::Run()
+{
+    Error err = Listen();
+    if (err != Error::NoError) {
+        return err;
+    }
+
+    // the clients are logged in already when they come
+    err = KeepConnected();
+    if (err != Error::NoError) {
+        return err;
+    }
+
+    std::list<std::future<void>> clients;
+    auto lastCheck = std::chrono::steady_clock::now();
+
+    while (! m_stop) {
+        pollfd pfd = {m_listenFd, POLLIN, 0};
+
+        int res = poll(&pfd, 1, kPollTimeoutMs);
+        if (res > 0) {
+            int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd != -1) {
+                clients.push_back(std::async(
+                    std::launch::async,
+                    [this, fd]() { ServeClient(fd); }));
+            }
+        }
+
+        clients.remove_if([](const std::future<void>& client) {
+            return client.wait_for(std::chrono::seconds(0)) ==
+                std::future_status::ready;
+        });
+
+        // the pings keep the connection open, this brings it back once the
+        // server or the network dropped it
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastCheck >= kHeartbeatInterval) {
+            lastCheck = now;
+            KeepConnected();
+        }
+    }
+
+    // the clients coming from now on connect directly
+    Unlisten();
+
+    return Error::NoError;
+}
+
+void TradevilleDaemon::Stop()
+{
+    m_stop = true;
+}
+
+std::filesystem::path TradevilleDaemon::GetDefaultSocketPath()
+{
+    static constexpr const char* kSocketName = "index_investing_tool.sock";
+
+    const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir != nullptr && runtimeDir[0] != '\0') {
+        return std::filesystem::path(runtimeDir) / kSocketName;
+    }
+
+    // the temp directory is shared, the socket is kept in a directory of the
+    // user which Listen() creates
+    std::string dirName = "index_investing_tool-";
+    dirName += std::to_string(getuid());
+
+    std::error_code ec;
+    return std::filesystem::temp_directory_path(ec) / dirName / kSocketName;
+}
+
+tl::expected<std::future<WebsocketConnection::Response>, Error>
+TradevilleDaemon::SendRequestAsync(
+    const std::filesystem::path& socketPath,
+    const std::string& user,
+    const std::string& req)
+{
+    auto sock = ConnectTo(socketPath);
+    if (! sock) {
+        return tl::unexpected(Error::DaemonNotRunning);
+    }
+
+    std::string msg = user;
+    msg += ' ';
+    msg += std::to_string(req.size());
+    msg += '\n';
+    msg += req;
+    if (! WriteAll(sock->Get(), msg)) {
+        return tl::unexpected(Error::DaemonNotRunning);
+    }
+
+    return std::async(
+        std::launch::deferred,
+        [sock = std::move(*sock)]() -> WebsocketConnection::Response {
+            auto header = ReadHeader(sock.Get());
+            if (! header) {
+                return tl::unexpected(Error::WebsocketReadFailed);
+            }
+
+            const std::string& code = header->first;
+            uint32_t err            = 0;
+            if (std::from_chars(code.data(), code.data() + code.size(), err)
+                    .ec != std::errc()) {
+                return tl::unexpected(Error::WebsocketReadFailed);
+            }
+            if (static_cast<Error>(err) != Error::NoError) {
+                return tl::unexpected(static_cast<Error>(err));
+            }
+
+            auto rsp = ReadAll(sock.Get(), header->second);
+            if (! rsp) {
+                return tl::unexpected(Error::WebsocketReadFailed);
+            }
+
+            return std::move(*rsp);
+        });
+}
+
+Error TradevilleDaemon::Listen()
+{
+    sockaddr_un addr;
+    if (! FillAddress(m_socketPath, addr)) {
+        return Error::InvalidArg;
+    }
+
+    if (! PreparePrivateDir(m_socketPath.parent_path())) {
+        return Error::InvalidArg;
+    }
+
+    // a socket left behind by a daemon which did not stop cleanly is
+    // replaced, the one of a running daemon is not
+    if (ConnectTo(m_socketPath)) {
+        return Error::AlreadyExists;
+    }
+    unlink(m_socketPath.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return Error::InvalidArg;
+    }
+
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return Error::InvalidArg;
+    }
+    m_listenFd = fd;
+
+    // the session is logged in, only its user may use it
+    if (chmod(m_socketPath.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        return Error::InvalidArg;
+    }
+
+    return Error::NoError;
+}
+
+void TradevilleDaemon::Unlisten()
+{
+    if (m_listenFd != -1) {
+        close(m_listenFd);
+        unlink(m_socketPath.c_str());
+        m_listenFd = -1;
+    }
+}
+
+void TradevilleDaemon::ServeClient(int fd)
+{
+    UnixSocket sock(fd);
+    WebsocketConnection::Response rsp;
+
+    // checked besides the mode of the socket, which a squatted path lacks
+    if (! IsPeerOwnUser(sock.Get())) {
+        return;
+    }
+
+    auto header = ReadHeader(sock.Get());
+    if (! header || header->second > kMaxRequestSize) {
+        return;
+    }
+
+    auto req = ReadAll(sock.Get(), header->second);
+    if (! req) {
+        return;
+    }
+
+    if (header->first != m_tradeville.m_username) {
+        rsp = tl::unexpected(Error::InvalidArg);
+    } else {
+        rsp = Forward(*req);
+    }
+
+    std::string msg = std::to_string(
+        static_cast<uint32_t>(rsp ? Error::NoError : rsp.error()));
+    msg += ' ';
+    msg += std::to_string(rsp ? rsp->size() : 0);
+    msg += '\n';
+    if (rsp) {
+        msg += *rsp;
+    }
+
+    WriteAll(sock.Get(), msg);
+}
+
+WebsocketConnection::Response TradevilleDaemon::Forward(const std::string& req)
+{
+    WebsocketConnection::Response rsp;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        std::future<WebsocketConnection::Response> pending;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            pending = m_tradeville.SendRequestAsync(req);
+        }
+
+        // the other requests are sent while this one is waited for
+        rsp = pending.get();
+        if (rsp || (rsp.error() != Error::WebsocketReadFailed &&
+                    rsp.error() != Error::WebsocketWriteFailed)) {
+            break;
+        }
+    }
+
+    return rsp;
+}
+
+Error TradevilleDaemon::KeepConnected()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_tradeville.InitConnection();
+}
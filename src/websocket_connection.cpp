@@ -1,8 +1,10 @@
 #include "websocket_connection.h"
 
+#include <algorithm>
+
 WebsocketConnection::WebsocketConnection(const std::string& host, uint16_t port)
     : m_sslCtx(ssl::context::tlsv12_client), m_tcpResolver(m_ioCtx),
-      m_wss(m_ioCtx, m_sslCtx), m_host(host), m_port(port)
+      m_host(host), m_port(port)
 {
 }
 
@@ -11,20 +13,52 @@ WebsocketConnection::~WebsocketConnection()
     Close();
 }
 
+void WebsocketConnection::SetMessageKey(MessageKey messageKey)
+{
+    m_messageKey = std::move(messageKey);
+}
+
+void WebsocketConnection::SetKeepAlive(std::chrono::seconds interval)
+{
+    m_keepAlive = interval;
+}
+
 Error WebsocketConnection::Connect(
     const std::string& target,
     const std::string& subprotocol)
 {
     boost::system::error_code ec;
 
-    m_wss.set_option(
+    if (m_archive != nullptr &&
+        m_archive->GetMode() == SessionArchive::Mode::Replay) {
+        m_replaying = true;
+        return Error::NoError;
+    }
+
+    Close();
+    m_wss.emplace(m_ioCtx, m_sslCtx);
+    m_writeQueue.clear();
+    m_readMessage.clear();
+    m_writing = false;
+    m_reading = false;
+
+    // also bounds the wait for the close frame of the server
+    auto timeout = websocket::stream_base::timeout::suggested(
+        boost::beast::role_type::client);
+    if (m_keepAlive) {
+        // beast pings once half of the idle timeout has passed
+        timeout.idle_timeout     = *m_keepAlive * 2;
+        timeout.keep_alive_pings = true;
+    }
+    m_wss->set_option(timeout);
+    m_wss->set_option(
         websocket::stream_base::decorator([&](websocket::request_type& req) {
             req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
             req.set(http::field::sec_websocket_protocol, subprotocol);
         }));
 
     if (! SSL_set_tlsext_host_name(
-            m_wss.next_layer().native_handle(),
+            m_wss->next_layer().native_handle(),
             m_host.c_str())) {
         return Error::SetSniFailed;
     }
@@ -35,49 +69,212 @@ Error WebsocketConnection::Connect(
         return Error::IpResolverFailed;
     }
 
-    net::connect(get_lowest_layer(m_wss), resolverResults, ec);
+    net::connect(get_lowest_layer(*m_wss), resolverResults, ec);
     if (ec) {
         return Error::TcpConnectFailed;
     }
 
-    m_wss.next_layer().handshake(ssl::stream_base::client, ec);
+    m_wss->next_layer().handshake(ssl::stream_base::client, ec);
     if (ec) {
         return Error::SslHandshakeFailed;
     }
 
-    m_wss.handshake(m_host, target, ec);
+    m_wss->handshake(m_host, target, ec);
     if (ec) {
         return Error::WebsocketHandshakeFailed;
     }
 
+    m_connected = true;
+    m_ioCtx.restart();
+    m_work.emplace(net::make_work_guard(m_ioCtx));
+    m_ioThread = std::thread([this]() { m_ioCtx.run(); });
+
+    // the idle timeout only runs while a read is pending
+    if (m_keepAlive) {
+        net::post(m_ioCtx, [this]() { Read(); });
+    }
+
     return Error::NoError;
 }
 
 void WebsocketConnection::Close()
 {
-    if (m_wss.is_open()) {
+    m_replaying = false;
+
+    if (m_ioThread.joinable()) {
+        // the I/O is stopped instead of drained, the idle timer of a failed
+        // stream stays armed until it expires
+        net::post(m_ioCtx, [this]() {
+            if (m_wss->is_open()) {
+                m_wss->async_close(
+                    websocket::close_code::normal,
+                    [this](boost::system::error_code) { m_ioCtx.stop(); });
+            } else {
+                m_ioCtx.stop();
+            }
+        });
+        m_work.reset();
+        m_ioThread.join();
+
+        // the I/O thread is gone, so its state is safe to touch
+        Fail(Error::WebsocketReadFailed);
+    } else if (m_wss && m_wss->is_open()) {
         boost::system::error_code ec;
-        m_wss.close(websocket::close_code::normal, ec);
+        m_wss->close(websocket::close_code::normal, ec);
     }
+
+    m_connected = false;
 }
 
-tl::expected<std::string, Error> WebsocketConnection::SendRequest(
-    const std::string& req)
+void WebsocketConnection::SetSessionArchive(SessionArchive* archive)
 {
-    boost::system::error_code ec;
-    boost::beast::flat_buffer buffer;
+    m_archive = archive;
+}
 
-    m_wss.write(net::buffer(req), ec);
-    if (ec) {
-        return tl::unexpected(Error::WebsocketWriteFailed);
+std::future<WebsocketConnection::Response> WebsocketConnection::
+    SendRequestAsync(
+        const std::string& req,
+        const std::optional<std::string>& archivedReq)
+{
+    std::promise<Response> promise;
+    std::future<Response> future = promise.get_future();
+    std::string archiveKey;
+
+    if (m_archive != nullptr) {
+        archiveKey = m_archive->NextKey(
+            "WS " + m_host + "\n" + archivedReq.value_or(req));
     }
 
-    m_wss.read(buffer, ec);
-    if (ec) {
-        return tl::unexpected(Error::WebsocketReadFailed);
+    if (m_replaying) {
+        auto entry = m_archive->Replay(archiveKey);
+        if (entry) {
+            promise.set_value(std::move(entry->body));
+        } else {
+            promise.set_value(tl::unexpected(entry.error()));
+        }
+        return future;
     }
 
-    return std::string(
-        reinterpret_cast<char*>(buffer.data().data()),
-        buffer.data().size());
+    if (! m_connected) {
+        promise.set_value(tl::unexpected(Error::WebsocketWriteFailed));
+        return future;
+    }
+
+    std::string key = m_messageKey ? m_messageKey(req) : std::string();
+
+    net::post(
+        m_ioCtx,
+        [this,
+         req,
+         key        = std::move(key),
+         archiveKey = std::move(archiveKey),
+         promise    = std::move(promise)]() mutable {
+            m_pending.push_back(
+                {std::move(key), std::move(archiveKey), std::move(promise)});
+            m_writeQueue.push_back(std::move(req));
+
+            if (! m_writing) {
+                Write();
+            }
+            if (! m_reading) {
+                Read();
+            }
+        });
+
+    return future;
+}
+
+WebsocketConnection::Response WebsocketConnection::SendRequest(
+    const std::string& req,
+    const std::optional<std::string>& archivedReq)
+{
+    return SendRequestAsync(req, archivedReq).get();
+}
+
+void WebsocketConnection::Write()
+{
+    m_writing = true;
+
+    m_wss->async_write(
+        net::buffer(m_writeQueue.front()),
+        [this](boost::system::error_code ec, size_t) {
+            m_writing = false;
+
+            if (ec) {
+                m_writeQueue.clear();
+                Fail(Error::WebsocketWriteFailed);
+                return;
+            }
+
+            m_writeQueue.pop_front();
+            if (! m_writeQueue.empty()) {
+                Write();
+            }
+        });
+}
+
+void WebsocketConnection::Read()
+{
+    m_reading = true;
+
+    m_readBuffer.emplace(m_readMessage);
+    m_wss->async_read(
+        *m_readBuffer,
+        [this](boost::system::error_code ec, size_t) {
+            m_reading = false;
+
+            if (ec) {
+                Fail(Error::WebsocketReadFailed);
+                return;
+            }
+
+            std::string rsp = std::move(m_readMessage);
+            m_readMessage.clear();
+
+            OnResponse(std::move(rsp));
+            if (! m_pending.empty() || m_keepAlive) {
+                Read();
+            }
+        });
+}
+
+void WebsocketConnection::OnResponse(std::string rsp)
+{
+    if (m_pending.empty()) {
+        return;
+    }
+
+    // a response with an unexpected key (e.g. an error) goes to the oldest
+    // request, which then fails its validation instead of waiting forever
+    std::string key = m_messageKey ? m_messageKey(rsp) : std::string();
+    auto it         = std::find_if(
+        m_pending.begin(),
+        m_pending.end(),
+        [&key](const PendingRequest& p) { return p.key == key; });
+    if (it == m_pending.end()) {
+        it = m_pending.begin();
+    }
+
+    if (m_archive != nullptr) {
+        HttpCacheEntry entry;
+
+        entry.storedAt = std::chrono::system_clock::now();
+        entry.body     = rsp;
+
+        // a response which is not recorded only fails its replay
+        m_archive->Record(it->archiveKey, entry);
+    }
+
+    it->promise.set_value(std::move(rsp));
+    m_pending.erase(it);
+}
+
+void WebsocketConnection::Fail(Error err)
+{
+    m_connected = false;
+
+    for (auto& pending : m_pending) {
+        pending.promise.set_value(tl::unexpected(err));
+    }
+    m_pending.clear();
 }
@@ -0,0 +1,351 @@
+#include "bvb_scraper.h"
+#include "html_parser.h"
+
+#include <benchmark/benchmark.h>
+#include <fstream>
+#include <streambuf>
+
+class BvbScraperBenchmark {
+public:
+    tl::expected<DividendActivities, Error> ParseDividendActivities(
+        const std::string& data)
+    {
+        return m_bvbScraper.ParseDividendActivities(data);
+    }
+
+    tl::expected<BvbScraper::IndexesDetails, Error> ParseIndexesNames(
+        const std::string& data)
+    {
+        return m_bvbScraper.ParseIndexesNames(data);
+    }
+
+    tl::expected<Index, Error> ParseConstituents(
+        const std::string& data,
+        const IndexName& indexName)
+    {
+        return m_bvbScraper.ParseConstituents(data, indexName);
+    }
+
+    tl::expected<Indexes, Error> ParseAdjustmentsHistory(
+        const std::string& data,
+        const IndexName& indexName)
+    {
+        return m_bvbScraper.ParseAdjustmentsHistory(data, indexName);
+    }
+
+    tl::expected<IndexTradingData, Error> ParseTradingData(
+        const std::string& data,
+        const IndexName& indexName)
+    {
+        return m_bvbScraper.ParseTradingData(data, indexName);
+    }
+
+    std::optional<double> ParseDouble(
+        std::string_view val,
+        size_t decimals,
+        bool allowNegative,
+        bool hasSeparators,
+        bool allowNbsp)
+    {
+        return m_bvbScraper.ParseDouble(
+            val,
+            decimals,
+            allowNegative,
+            hasSeparators,
+            allowNbsp);
+    }
+
+    void SetParseThreads(size_t count)
+    {
+        m_bvbScraper.SetParseThreads(count);
+    }
+
+private:
+    BvbScraper m_bvbScraper;
+};
+
+static std::string ReadFile(const char* path)
+{
+    std::ifstream f(path);
+
+    return std::string(
+        (std::istreambuf_iterator<char>(f)),
+        std::istreambuf_iterator<char>());
+}
+
+// Builds a synthetic page by repeating the content of the given element
+// (e.g. the rows of a table body) factor times.
+static std::string ScalePage(
+    const std::string& data,
+    HtmlTag scopeTag,
+    HtmlAttribute attr,
+    std::string_view attrValue,
+    HtmlTag contentTag,
+    size_t factor)
+{
+    HtmlParser html(data);
+
+    auto scope = html.FindElement(scopeTag, {}, attr, attrValue);
+    if (! scope) {
+        return {};
+    }
+
+    ClosedInterval content = scope->data;
+    if (contentTag != HtmlTag::None) {
+        auto location = html.FindElement(contentTag, scope->data);
+        if (! location) {
+            return {};
+        }
+        content = location->data;
+    }
+
+    std::string res = data.substr(0, content.Upper() + 1);
+    for (size_t i = 1; i < factor; i++) {
+        res.append(data, content.Lower(), content.Size());
+    }
+    res.append(data, content.Upper() + 1);
+
+    return res;
+}
+
+template <typename Parse, typename CountRows>
+static void RunParseBenchmark(
+    benchmark::State& state,
+    const std::string& data,
+    Parse parse,
+    CountRows countRows)
+{
+    size_t rows = 0;
+
+    if (data.empty()) {
+        state.SkipWithError("failed to load the fixture");
+        return;
+    }
+
+    for (auto _ : state) {
+        auto res = parse(data);
+        if (! res) {
+            state.SkipWithError("failed to parse the fixture");
+            return;
+        }
+
+        rows += countRows(*res);
+        benchmark::DoNotOptimize(res);
+    }
+
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.counters["rows"] = benchmark::Counter(
+        static_cast<double>(rows),
+        benchmark::Counter::kIsRate);
+}
+
+static void BM_ParseDividendActivities(benchmark::State& state)
+{
+    static const std::string page =
+        ReadFile("test/data/parse_dividend_activities.txt");
+    const std::string data = ScalePage(
+        page,
+        HtmlTag::Table,
+        HtmlAttribute::Id,
+        "gv",
+        HtmlTag::Tbody,
+        state.range(0));
+    BvbScraperBenchmark bvb;
+
+    RunParseBenchmark(
+        state,
+        data,
+        [&](const std::string& d) { return bvb.ParseDividendActivities(d); },
+        [](const DividendActivities& r) { return r.size(); });
+}
+
+static void BM_ParseIndexesNames(benchmark::State& state)
+{
+    static const std::string page =
+        ReadFile("test/data/parse_indexes_names_data.txt");
+    const std::string data = ScalePage(
+        page,
+        HtmlTag::Select,
+        HtmlAttribute::Name,
+        "ctl00$ctl00$body$rightColumnPlaceHolder$IndexProfilesCurrentValues$"
+        "IndexControlList$ddIndices",
+        HtmlTag::None,
+        state.range(0));
+    BvbScraperBenchmark bvb;
+
+    RunParseBenchmark(
+        state,
+        data,
+        [&](const std::string& d) { return bvb.ParseIndexesNames(d); },
+        [](const auto& r) { return r.names.size(); });
+}
+
+static void BM_ParseConstituents(benchmark::State& state)
+{
+    static const std::string page =
+        ReadFile("test/data/parse_index_constituents.txt");
+    const std::string data = ScalePage(
+        page,
+        HtmlTag::Table,
+        HtmlAttribute::Id,
+        "gvC",
+        HtmlTag::Tbody,
+        state.range(0));
+    BvbScraperBenchmark bvb;
+
+    RunParseBenchmark(
+        state,
+        data,
+        [&](const std::string& d) {
+            return bvb.ParseConstituents(d, "BET-BK");
+        },
+        [](const Index& r) { return r.companies.size(); });
+}
+
+static void BM_ParseAdjustmentsHistory(benchmark::State& state)
+{
+    static const std::string page =
+        ReadFile("test/data/parse_index_adjustments_history.txt");
+    const std::string data = ScalePage(
+        page,
+        HtmlTag::Table,
+        HtmlAttribute::Id,
+        "gvAH",
+        HtmlTag::Tbody,
+        state.range(0));
+    BvbScraperBenchmark bvb;
+
+    bvb.SetParseThreads(state.range(1));
+
+    RunParseBenchmark(
+        state,
+        data,
+        [&](const std::string& d) {
+            return bvb.ParseAdjustmentsHistory(d, "BET-BK");
+        },
+        [](const Indexes& r) {
+            size_t rows = 0;
+            for (const auto& index : r) {
+                rows += index.companies.size();
+            }
+            return rows;
+        });
+}
+
+static void BM_ParseTradingData(benchmark::State& state)
+{
+    static const std::string page =
+        ReadFile("test/data/parse_index_trading_data.txt");
+    const std::string data = ScalePage(
+        page,
+        HtmlTag::Table,
+        HtmlAttribute::Id,
+        "gvTD",
+        HtmlTag::Tbody,
+        state.range(0));
+    BvbScraperBenchmark bvb;
+
+    RunParseBenchmark(
+        state,
+        data,
+        [&](const std::string& d) {
+            return bvb.ParseTradingData(d, "BET-FI");
+        },
+        [](const IndexTradingData& r) { return r.companies.size(); });
+}
+
+// Decodes the decimal cells of the trading data fixture with the formats of
+// their columns.
+static void BM_ParseNumbers(benchmark::State& state)
+{
+    struct ColumnFormat
+    {
+        bool isDecimal;
+        size_t decimals;
+        bool allowNegative;
+        bool hasSeparators;
+        bool allowNbsp;
+    };
+
+    // symbol, price, variation, trades, volume, value, low, high, weight
+    static constexpr ColumnFormat kFormats[] = {
+        {false, 0, false, false, false},
+        {true, 4, false, false, false},
+        {true, 2, true, false, true},
+        {false, 0, false, false, false},
+        {false, 0, false, false, false},
+        {true, 2, false, true, true},
+        {true, 4, false, false, true},
+        {true, 4, false, false, true},
+        {true, 2, false, false, false},
+    };
+
+    const std::string data = ReadFile("test/data/parse_index_trading_data.txt");
+    HtmlParser html(data);
+    std::vector<std::pair<std::string_view, const ColumnFormat*>> corpus;
+    size_t bytes = 0;
+    BvbScraperBenchmark bvb;
+
+    auto table =
+        html.FindElement(HtmlTag::Table, {}, HtmlAttribute::Id, "gvTD");
+    if (! table) {
+        state.SkipWithError("failed to load the fixture");
+        return;
+    }
+
+    auto tbody = html.FindElement(HtmlTag::Tbody, table->data);
+    if (! tbody) {
+        state.SkipWithError("failed to load the fixture");
+        return;
+    }
+
+    auto cells = html.FindAllElements(HtmlTag::Td, tbody->data);
+    if (! cells) {
+        state.SkipWithError("failed to load the fixture");
+        return;
+    }
+
+    for (size_t i = 0; i < cells->size(); i++) {
+        const ColumnFormat& format = kFormats[i % std::size(kFormats)];
+        if (! format.isDecimal) {
+            continue;
+        }
+
+        std::string_view val(
+            data.c_str() + (*cells)[i].data.Lower(),
+            (*cells)[i].data.Size());
+        corpus.emplace_back(val, &format);
+        bytes += val.size();
+    }
+
+    for (auto _ : state) {
+        for (const auto& [val, format] : corpus) {
+            auto res = bvb.ParseDouble(
+                val,
+                format->decimals,
+                format->allowNegative,
+                format->hasSeparators,
+                format->allowNbsp);
+            if (! res) {
+                state.SkipWithError("invalid value in the corpus");
+                return;
+            }
+            benchmark::DoNotOptimize(res);
+        }
+    }
+
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.SetItemsProcessed(state.iterations() * corpus.size());
+}
+
+BENCHMARK(BM_ParseDividendActivities)->Arg(1)->Arg(10)->Arg(100);
+BENCHMARK(BM_ParseIndexesNames)->Arg(1)->Arg(10)->Arg(100);
+BENCHMARK(BM_ParseConstituents)->Arg(1)->Arg(10)->Arg(100);
+BENCHMARK(BM_ParseAdjustmentsHistory)
+    ->Args({1, 1})
+    ->Args({10, 1})
+    ->Args({100, 1})
+    ->Args({100, 4})
+    ->UseRealTime();
+BENCHMARK(BM_ParseTradingData)->Arg(1)->Arg(10)->Arg(100);
+BENCHMARK(BM_ParseNumbers);
@@ -1,17 +1,42 @@
+#include "adjustments_history_file.h"
 #include "bvb_scraper.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
 #include <fstream>
 #include <gtest/gtest.h>
 #include <streambuf>
 
 class BvbScraperTest {
 public:
+    using Session   = BvbScraper::Session;
+    using IndexPage = BvbScraper::IndexPage;
+
     tl::expected<DividendActivities, Error> ParseDividendActivities(
         const std::string& data)
     {
         return m_bvbScraper.ParseDividendActivities(data);
     }
 
+    tl::expected<DividendActivities, Error> ParseDividendActivitiesStream(
+        const std::string& data,
+        size_t chunkSize)
+    {
+        return m_bvbScraper.ParseDividendActivities(
+            [&](const HttpBodyCallback& bodyCallback) -> Error {
+                for (size_t pos = 0; pos < data.size(); pos += chunkSize) {
+                    Error err = bodyCallback(
+                        std::string_view(data).substr(pos, chunkSize));
+                    if (err != Error::NoError) {
+                        return err;
+                    }
+                }
+
+                return Error::NoError;
+            });
+    }
+
     tl::expected<BvbScraper::IndexesDetails, Error> ParseIndexesNames(
         const std::string& data)
     {
@@ -38,6 +63,13 @@ public:
         return m_bvbScraper.ParseAdjustmentsHistory(data, indexName);
     }
 
+    static std::filesystem::path GetAdjustmentsHistoryFilePath(
+        const IndexName& name,
+        BvbScraper::HistoryFileFormat format)
+    {
+        return BvbScraper::GetAdjustmentsHistoryFilePath(name, format);
+    }
+
     tl::expected<IndexTradingData, Error> ParseTradingData(
         const std::string& data,
         const IndexName& indexName)
@@ -45,6 +77,72 @@ public:
         return m_bvbScraper.ParseTradingData(data, indexName);
     }
 
+    tl::expected<BvbScraper::RequestData, Error> ParseRequestDataFromMainPage(
+        const std::string& data)
+    {
+        return m_bvbScraper.ParseRequestDataFromMainPage(data);
+    }
+
+    tl::expected<BvbScraper::RequestData, Error> ParseRequestDataFromPostRsp(
+        const std::string& data)
+    {
+        return m_bvbScraper.ParseRequestDataFromPostRsp(data);
+    }
+
+    void SetParseThreads(size_t count)
+    {
+        m_bvbScraper.SetParseThreads(count);
+    }
+
+    std::optional<uint64_t> ParseInt(std::string_view value, bool allowNbsp)
+    {
+        return m_bvbScraper.ParseInt(value, allowNbsp);
+    }
+
+    std::optional<double> ParseDouble(
+        std::string_view val,
+        size_t decimals,
+        bool allowNegative,
+        bool hasSeparators,
+        bool allowNbsp)
+    {
+        return m_bvbScraper.ParseDouble(
+            val,
+            decimals,
+            allowNegative,
+            hasSeparators,
+            allowNbsp);
+    }
+
+    std::optional<double> ParseNumber(std::string_view val)
+    {
+        return m_bvbScraper.ParseNumber(val);
+    }
+
+    HttpRequestChain GetIndexPageChain(
+        const IndexName& name,
+        IndexPage page,
+        std::string& body,
+        Session* session)
+    {
+        return m_bvbScraper.GetIndexPageChain(name, page, body, session);
+    }
+
+    void SetBaseUrl(std::string baseUrl)
+    {
+        m_bvbScraper.SetBaseUrl(std::move(baseUrl));
+    }
+
+    HttpRequest GetInfoDividendPageRequest()
+    {
+        return m_bvbScraper.GetInfoDividendPageRequest();
+    }
+
+    HttpRequest GetSelectIndexRequest(const IndexName& name)
+    {
+        return m_bvbScraper.GetSelectIndexRequest(name, {});
+    }
+
 private:
     BvbScraper m_bvbScraper;
 };
@@ -724,6 +822,267 @@ TEST(BvbScraperTest, ParseAdjustmentsHistory)
     }
 }
 
+TEST(BvbScraperTest, ParseAdjustmentsHistoryParallel)
+{
+    BvbScraperTest bvbTest;
+    std::ifstream f("test/data/parse_index_adjustments_history.txt");
+
+    ASSERT_TRUE(f.is_open());
+
+    std::string data(
+        (std::istreambuf_iterator<char>(f)),
+        std::istreambuf_iterator<char>());
+    f.close();
+
+    ASSERT_TRUE(data.size() > 0);
+
+    auto expected = bvbTest.ParseAdjustmentsHistory(data, "BET-BK");
+    ASSERT_TRUE(expected.has_value());
+
+    bvbTest.SetParseThreads(3);
+    auto res = bvbTest.ParseAdjustmentsHistory(data, "BET-BK");
+    ASSERT_TRUE(res.has_value());
+    ASSERT_EQ(res->size(), expected->size());
+
+    for (size_t i = 0; i < expected->size(); i++) {
+        const auto& index = (*res)[i];
+
+        ASSERT_EQ(index.date, (*expected)[i].date);
+        ASSERT_EQ(index.reason, (*expected)[i].reason);
+        ASSERT_EQ(index.companies.size(), (*expected)[i].companies.size());
+
+        for (size_t j = 0; j < index.companies.size(); j++) {
+            ASSERT_EQ(
+                index.companies[j].symbol,
+                (*expected)[i].companies[j].symbol);
+            ASSERT_EQ(
+                index.companies[j].shares,
+                (*expected)[i].companies[j].shares);
+            ASSERT_EQ(
+                index.companies[j].weight,
+                (*expected)[i].companies[j].weight);
+        }
+    }
+}
+
+static void AssertSameIndex(const Index& index, const Index& exp)
+{
+    ASSERT_EQ(index.name, exp.name);
+    ASSERT_EQ(index.date, exp.date);
+    ASSERT_EQ(index.reason, exp.reason);
+    ASSERT_EQ(index.companies.size(), exp.companies.size());
+
+    for (size_t j = 0; j < index.companies.size(); j++) {
+        const Company& c  = index.companies[j];
+        const Company& ec = exp.companies[j];
+
+        ASSERT_EQ(c.symbol, ec.symbol);
+        ASSERT_EQ(c.name, ec.name);
+        ASSERT_EQ(c.shares, ec.shares);
+        ASSERT_EQ(c.reference_price, ec.reference_price);
+        ASSERT_EQ(c.free_float_factor, ec.free_float_factor);
+        ASSERT_EQ(c.representation_factor, ec.representation_factor);
+        ASSERT_EQ(c.price_correction_factor, ec.price_correction_factor);
+        ASSERT_EQ(c.liquidity_factor, ec.liquidity_factor);
+        ASSERT_EQ(c.weight, ec.weight);
+    }
+}
+
+TEST(BvbScraperTest, AdjustmentsHistoryFile)
+{
+    BvbScraperTest bvbTest;
+    std::ifstream f("test/data/parse_index_adjustments_history.txt");
+
+    ASSERT_TRUE(f.is_open());
+
+    std::string data(
+        (std::istreambuf_iterator<char>(f)),
+        std::istreambuf_iterator<char>());
+    f.close();
+
+    auto expected = bvbTest.ParseAdjustmentsHistory(data, "BET-BK");
+    ASSERT_TRUE(expected.has_value());
+    ASSERT_FALSE(expected->empty());
+
+    // only snapshots, short delta chains and the default ones
+    std::string snapshots = AdjustmentsHistoryFile::Encode(*expected, 1);
+    std::string encoded   = AdjustmentsHistoryFile::Encode(*expected);
+    ASSERT_LT(encoded.size(), snapshots.size());
+
+    for (const auto& enc : {
+             snapshots,
+             AdjustmentsHistoryFile::Encode(*expected, 3),
+             encoded,
+         }) {
+        auto res = AdjustmentsHistoryFile::Decode(enc);
+        ASSERT_TRUE(res.has_value());
+        ASSERT_EQ(res->size(), expected->size());
+
+        for (size_t i = 0; i < expected->size(); i++) {
+            AssertSameIndex((*res)[i], (*expected)[i]);
+        }
+
+        // a single adjustment is decoded from the last snapshot before it,
+        // the first one with its date and reason is returned
+        for (const auto& exp : *expected) {
+            auto one = AdjustmentsHistoryFile::DecodeAdjustment(
+                enc, exp.date, exp.reason);
+            ASSERT_TRUE(one.has_value());
+
+            auto first = std::find_if(
+                expected->begin(), expected->end(), [&](const Index& i) {
+                    return i.date == exp.date && i.reason == exp.reason;
+                });
+            AssertSameIndex(*one, *first);
+        }
+    }
+
+    // the blocks of the other adjustments are not read
+    const Index& first = expected->front();
+    auto one           = AdjustmentsHistoryFile::DecodeAdjustment(
+        std::string_view(encoded).substr(0, encoded.size() - 1),
+        first.date,
+        first.reason);
+    ASSERT_TRUE(one.has_value());
+    AssertSameIndex(*one, first);
+
+    auto missing = AdjustmentsHistoryFile::DecodeAdjustment(
+        encoded, first.date, "no such reason");
+    ASSERT_FALSE(missing.has_value());
+    ASSERT_EQ(missing.error(), Error::InvalidArg);
+
+    auto empty = AdjustmentsHistoryFile::Decode(
+        AdjustmentsHistoryFile::Encode(Indexes{}));
+    ASSERT_TRUE(empty.has_value());
+    ASSERT_TRUE(empty->empty());
+
+    // a truncated file and a wrong magic are detected
+    for (size_t size : {
+             size_t(0),
+             sizeof(AdjustmentsHistoryFile::Header),
+             encoded.size() / 2,
+             encoded.size() - 1,
+         }) {
+        auto truncated = AdjustmentsHistoryFile::Decode(
+            std::string_view(encoded).substr(0, size));
+        ASSERT_FALSE(truncated.has_value());
+        ASSERT_EQ(truncated.error(), Error::UnexpectedData);
+    }
+
+    // a file written with the other byte order
+    std::string swapped = encoded;
+    char* version =
+        swapped.data() + offsetof(AdjustmentsHistoryFile::Header, version);
+    std::reverse(version, version + sizeof(uint32_t));
+    auto foreign = AdjustmentsHistoryFile::Decode(swapped);
+    ASSERT_FALSE(foreign.has_value());
+    ASSERT_EQ(foreign.error(), Error::UnexpectedData);
+
+    encoded[0] = 'X';
+    ASSERT_FALSE(AdjustmentsHistoryFile::Decode(encoded).has_value());
+}
+
+TEST(BvbScraperTest, SaveAdjustmentsHistoryToFile)
+{
+    using Format = BvbScraper::HistoryFileFormat;
+
+    BvbScraperTest bvbTest;
+    BvbScraper bvb;
+    const IndexName name = "SET-TEST-SAVE";
+    std::ifstream f("test/data/parse_index_adjustments_history.txt");
+
+    ASSERT_TRUE(f.is_open());
+
+    std::string data(
+        (std::istreambuf_iterator<char>(f)),
+        std::istreambuf_iterator<char>());
+    f.close();
+
+    auto parsed = bvbTest.ParseAdjustmentsHistory(data, name);
+    ASSERT_TRUE(parsed.has_value());
+    ASSERT_FALSE(parsed->empty());
+
+    auto textPath =
+        BvbScraperTest::GetAdjustmentsHistoryFilePath(name, Format::Text);
+    auto binaryPath =
+        BvbScraperTest::GetAdjustmentsHistoryFilePath(name, Format::Binary);
+
+    ASSERT_EQ(
+        bvb.SaveAdjustmentsHistoryToFile(name, *parsed, Format::Text),
+        Error::NoError);
+    auto expected = bvb.LoadAdjustmentsHistoryFromFile(name);
+    ASSERT_TRUE(expected.has_value());
+    ASSERT_EQ(expected->size(), parsed->size());
+
+    // every save replaces the file of the other format without losing data
+    for (Format format : {Format::Binary, Format::Text, Format::Binary}) {
+        ASSERT_EQ(
+            bvb.SaveAdjustmentsHistoryToFile(name, *expected, format),
+            Error::NoError);
+        ASSERT_EQ(
+            std::filesystem::exists(binaryPath),
+            format == Format::Binary);
+        ASSERT_EQ(
+            std::filesystem::exists(textPath),
+            format == Format::Text);
+
+        auto res = bvb.LoadAdjustmentsHistoryFromFile(name);
+        ASSERT_TRUE(res.has_value());
+        ASSERT_EQ(res->size(), expected->size());
+        for (size_t i = 0; i < expected->size(); i++) {
+            AssertSameIndex((*res)[i], (*expected)[i]);
+        }
+    }
+
+    // a failed save keeps the file of the other format
+    std::filesystem::create_directories(textPath / "busy");
+    ASSERT_EQ(
+        bvb.SaveAdjustmentsHistoryToFile(name, *expected, Format::Text),
+        Error::InvalidArg);
+    std::filesystem::remove_all(textPath);
+
+    auto kept = bvb.LoadAdjustmentsHistoryFromFile(name);
+    ASSERT_TRUE(kept.has_value());
+    ASSERT_EQ(kept->size(), expected->size());
+
+    std::filesystem::remove(binaryPath);
+    std::filesystem::remove(textPath.string() + ".tmp");
+    ASSERT_FALSE(bvb.LoadAdjustmentsHistoryFromFile(name).has_value());
+}
+
+TEST(BvbScraperTest, LoadAdjustmentsHistoryFromFiles)
+{
+    BvbScraper bvb;
+
+    IndexesNames names = BvbScraper::GetAdjustmentsHistoryFilesNames();
+    ASSERT_FALSE(names.empty());
+    ASSERT_TRUE(std::is_sorted(names.begin(), names.end()));
+    ASSERT_NE(std::find(names.begin(), names.end(), "BET"), names.end());
+
+    names.push_back("NO-SUCH-INDEX");
+    auto loaded = bvb.LoadAdjustmentsHistoryFromFiles(names, 4);
+    ASSERT_EQ(loaded.size(), names.size());
+
+    // the same histories as loaded one by one
+    for (const auto& name : names) {
+        auto expected = bvb.LoadAdjustmentsHistoryFromFile(name);
+        auto& res     = loaded.at(name).indexes;
+
+        ASSERT_EQ(res.has_value(), expected.has_value());
+        if (! expected) {
+            ASSERT_EQ(res.error(), expected.error());
+            continue;
+        }
+
+        ASSERT_EQ(res->size(), expected->size());
+        for (size_t i = 0; i < expected->size(); i++) {
+            AssertSameIndex((*res)[i], (*expected)[i]);
+        }
+    }
+
+    ASSERT_EQ(loaded.at("NO-SUCH-INDEX").indexes.error(), Error::InvalidArg);
+}
+
 TEST(BvbScraperTest, ParseDividendActivities)
 {
     using namespace std::chrono;
@@ -784,3 +1143,348 @@ TEST(BvbScraperTest, ParseDividendActivities)
             expected_activities[i].payment_date);
     }
 }
+
+TEST(BvbScraperTest, ParseDividendActivitiesStream)
+{
+    BvbScraperTest bvbTest;
+    std::ifstream f("test/data/parse_dividend_activities.txt");
+
+    ASSERT_TRUE(f.is_open());
+
+    std::string data(
+        (std::istreambuf_iterator<char>(f)),
+        std::istreambuf_iterator<char>());
+    f.close();
+
+    ASSERT_TRUE(data.size() > 0);
+
+    auto expected = bvbTest.ParseDividendActivities(data);
+    ASSERT_TRUE(expected.has_value());
+
+    for (size_t chunkSize : {1ul, 7ul, 64ul, 1000ul, data.size()}) {
+        auto res = bvbTest.ParseDividendActivitiesStream(data, chunkSize);
+        ASSERT_TRUE(res.has_value()) << chunkSize;
+        ASSERT_EQ(res->size(), expected->size());
+
+        for (size_t i = 0; i < expected->size(); i++) {
+            ASSERT_EQ((*res)[i].symbol, (*expected)[i].symbol);
+            ASSERT_EQ((*res)[i].name, (*expected)[i].name);
+            ASSERT_EQ((*res)[i].dvd_value, (*expected)[i].dvd_value);
+            ASSERT_EQ(
+                (*res)[i].dvd_total_value,
+                (*expected)[i].dvd_total_value);
+            ASSERT_EQ((*res)[i].dvd_yield, (*expected)[i].dvd_yield);
+            ASSERT_EQ((*res)[i].year, (*expected)[i].year);
+            ASSERT_EQ((*res)[i].ex_dvd_date, (*expected)[i].ex_dvd_date);
+            ASSERT_EQ((*res)[i].record_date, (*expected)[i].record_date);
+            ASSERT_EQ((*res)[i].payment_date, (*expected)[i].payment_date);
+        }
+    }
+
+    auto res = bvbTest.ParseDividendActivitiesStream(
+        data.substr(0, data.size() / 2),
+        64);
+    ASSERT_FALSE(res.has_value());
+}
+
+TEST(BvbScraperTest, ParseRequestData)
+{
+    BvbScraperTest bvbTest;
+
+    std::string mainPage =
+        "<form>"
+        "<input type=\"hidden\" name=\"__EVENTTARGET\" id=\"__EVENTTARGET\" "
+        "value=\"\" />"
+        "<input type=\"hidden\" name=\"__EVENTARGUMENT\" "
+        "id=\"__EVENTARGUMENT\" value=\"\" />"
+        "<input type=\"hidden\" name=\"__LASTFOCUS\" id=\"__LASTFOCUS\" "
+        "value=\"\" />"
+        "<input type=\"hidden\" name=\"__VIEWSTATE\" id=\"__VIEWSTATE\" "
+        "value=\"vs/+=\" />"
+        "<input type=\"text\" data-id=\"__VIEWSTATEGENERATOR\" value=\"x\" />"
+        "<input type=\"hidden\" name=\"__VIEWSTATEGENERATOR\" "
+        "id=\"__VIEWSTATEGENERATOR\" value=\"gen\" />"
+        "<input type=\"hidden\" name=\"__VIEWSTATEENCRYPTED\" "
+        "id=\"__VIEWSTATEENCRYPTED\" value=\"\" />"
+        "<input type=\"hidden\" name=\"__EVENTVALIDATION\" "
+        "id=\"__EVENTVALIDATION\" value=\"ev\" />"
+        "</form>";
+
+    auto res = bvbTest.ParseRequestDataFromMainPage(mainPage);
+    ASSERT_TRUE(res.has_value());
+    ASSERT_EQ(res->eventTarget, "");
+    ASSERT_EQ(res->eventArg, "");
+    ASSERT_EQ(res->lastFocus, "");
+    ASSERT_EQ(res->viewState, "vs/+=");
+    ASSERT_EQ(res->viewStateGenerator, "gen");
+    ASSERT_EQ(res->viewStateEncrypted, "");
+    ASSERT_EQ(res->eventValidation, "ev");
+
+    res = bvbTest.ParseRequestDataFromMainPage(
+        mainPage.substr(0, mainPage.find("<input type=\"text\"")));
+    ASSERT_FALSE(res.has_value());
+    ASSERT_EQ(res.error(), Error::HtmlElementNotFound);
+
+    std::string postRsp =
+        "1|#||4|10|updatePanel|panel|<p>a|b</p>|"
+        "0|hiddenField|__EVENTTARGET||"
+        "0|hiddenField|__EVENTARGUMENT||"
+        "0|hiddenField|__LASTFOCUS||"
+        "5|hiddenField|__VIEWSTATE|vs/+=|"
+        "3|hiddenField|__VIEWSTATEGENERATOR|gen|"
+        "0|hiddenField|__VIEWSTATEENCRYPTED||"
+        "2|hiddenField|__EVENTVALIDATION|ev|";
+
+    res = bvbTest.ParseRequestDataFromPostRsp(postRsp);
+    ASSERT_TRUE(res.has_value());
+    ASSERT_EQ(res->eventTarget, "");
+    ASSERT_EQ(res->eventArg, "");
+    ASSERT_EQ(res->lastFocus, "");
+    ASSERT_EQ(res->viewState, "vs/+=");
+    ASSERT_EQ(res->viewStateGenerator, "gen");
+    ASSERT_EQ(res->viewStateEncrypted, "");
+    ASSERT_EQ(res->eventValidation, "ev");
+
+    res = bvbTest.ParseRequestDataFromPostRsp(
+        postRsp.substr(0, postRsp.find("2|hiddenField")));
+    ASSERT_FALSE(res.has_value());
+    ASSERT_EQ(res.error(), Error::NoData);
+
+    // the lengths are in UTF-16 code units: "Ț", "„" and "”" are one unit
+    // of 2 and 3 bytes, "📈" is a surrogate pair of 4 bytes
+    res = bvbTest.ParseRequestDataFromPostRsp(
+        "38|updatePanel|panel|<p>Națională „Nuclearelectrica” 📈</p>|" +
+        postRsp.substr(postRsp.find("0|hiddenField")));
+    ASSERT_TRUE(res.has_value());
+    ASSERT_EQ(res->viewState, "vs/+=");
+    ASSERT_EQ(res->eventValidation, "ev");
+
+    res = bvbTest.ParseRequestDataFromPostRsp("9|hiddenField|__VIEWSTATE|vs|");
+    ASSERT_FALSE(res.has_value());
+    ASSERT_EQ(res.error(), Error::InvalidData);
+
+    // half of a surrogate pair
+    res = bvbTest.ParseRequestDataFromPostRsp("1|hiddenField|__VIEWSTATE|📈|");
+    ASSERT_FALSE(res.has_value());
+    ASSERT_EQ(res.error(), Error::InvalidData);
+}
+
+// Builds the AJAX response of a postback holding the form state.
+static std::string PostRsp(const std::string& viewState)
+{
+    std::string rsp = "4|updatePanel|panel|data|";
+
+    for (const char* id :
+         {"__EVENTTARGET",
+          "__EVENTARGUMENT",
+          "__LASTFOCUS",
+          "__VIEWSTATEENCRYPTED",
+          "__EVENTVALIDATION"}) {
+        rsp += "0|hiddenField|";
+        rsp += id;
+        rsp += "||";
+    }
+    rsp += "3|hiddenField|__VIEWSTATEGENERATOR|gen|";
+    rsp += std::to_string(viewState.size()) + "|hiddenField|__VIEWSTATE|" +
+        viewState + "|";
+
+    return rsp;
+}
+
+static std::string GetPostValue(const HttpRequest& req, std::string_view key)
+{
+    for (const auto& [k, v] : req.postData) {
+        if (k == key) {
+            return v;
+        }
+    }
+
+    return {};
+}
+
+TEST(BvbScraperTest, IndexPageChainSession)
+{
+    using IndexPage = BvbScraperTest::IndexPage;
+
+    BvbScraperTest bvbTest;
+    BvbScraperTest::Session session;
+    std::string body;
+
+    std::ifstream f("test/data/parse_indexes_names_data.txt");
+    std::string mainPage(
+        (std::istreambuf_iterator<char>(f)),
+        std::istreambuf_iterator<char>());
+    mainPage += "<input type=\"hidden\" id=\"__VIEWSTATE\" value=\"vs0\" />";
+    for (const char* id :
+         {"__EVENTTARGET",
+          "__EVENTARGUMENT",
+          "__LASTFOCUS",
+          "__VIEWSTATEGENERATOR",
+          "__VIEWSTATEENCRYPTED",
+          "__EVENTVALIDATION"}) {
+        mainPage += "<input type=\"hidden\" id=\"";
+        mainPage += id;
+        mainPage += "\" value=\"\" />";
+    }
+
+    // the first chain starts from the landing page
+    auto chain = bvbTest.GetIndexPageChain(
+        "BET-BK",
+        IndexPage::AdjustmentsHistory,
+        body,
+        &session);
+
+    auto req = chain(nullptr);
+    ASSERT_TRUE(req.has_value() && req->has_value());
+    ASSERT_EQ((*req)->method, HttpMethod::get);
+
+    HttpResponse rsp{200, {}, mainPage};
+    req = chain(&rsp);
+    ASSERT_TRUE(req.has_value() && req->has_value());
+    ASSERT_EQ((*req)->method, HttpMethod::post);
+    ASSERT_EQ(GetPostValue(**req, "__VIEWSTATE"), "vs0");
+    ASSERT_EQ(
+        GetPostValue(**req, "__EVENTTARGET"),
+        "ctl00$ctl00$body$rightColumnPlaceHolder$IndexProfilesCurrentValues$"
+        "IndexControlList$ddIndices");
+
+    rsp = {200, {}, PostRsp("vs1")};
+    req = chain(&rsp);
+    ASSERT_TRUE(req.has_value() && req->has_value());
+    ASSERT_EQ(GetPostValue(**req, "__VIEWSTATE"), "vs1");
+    ASSERT_EQ(
+        GetPostValue(**req, "__EVENTTARGET"),
+        "ctl00$ctl00$body$rightColumnPlaceHolder$TabsControl$lb5");
+
+    rsp = {200, {}, PostRsp("vs2")};
+    req = chain(&rsp);
+    ASSERT_TRUE(req.has_value());
+    ASSERT_FALSE(req->has_value());
+    ASSERT_EQ(body, PostRsp("vs2"));
+    ASSERT_TRUE(session.valid);
+    ASSERT_EQ(session.selected, "BET-BK");
+    ASSERT_EQ(session.reqData.viewState, "vs2");
+
+    // the next chain for the same index goes straight to the tab
+    chain = bvbTest.GetIndexPageChain(
+        "BET-BK",
+        IndexPage::TradingData,
+        body,
+        &session);
+    req = chain(nullptr);
+    ASSERT_TRUE(req.has_value() && req->has_value());
+    ASSERT_EQ(GetPostValue(**req, "__VIEWSTATE"), "vs2");
+    ASSERT_EQ(
+        GetPostValue(**req, "__EVENTTARGET"),
+        "ctl00$ctl00$body$rightColumnPlaceHolder$TabsControl$lb1");
+
+    // the constituents of the index selected in the landing page need no
+    // request at all
+    chain = bvbTest.GetIndexPageChain(
+        "BET",
+        IndexPage::Constituents,
+        body,
+        &session);
+    req = chain(nullptr);
+    ASSERT_TRUE(req.has_value());
+    ASSERT_FALSE(req->has_value());
+    ASSERT_EQ(body, mainPage);
+
+    chain = bvbTest.GetIndexPageChain(
+        "INVALID",
+        IndexPage::Constituents,
+        body,
+        &session);
+    req = chain(nullptr);
+    ASSERT_FALSE(req.has_value());
+    ASSERT_EQ(req.error(), Error::InvalidArg);
+
+    // a failed response is reported and the session is left as it was
+    chain = bvbTest.GetIndexPageChain(
+        "BET-FI",
+        IndexPage::TradingData,
+        body,
+        &session);
+    req = chain(nullptr);
+    ASSERT_TRUE(req.has_value() && req->has_value());
+    rsp = {500, {}, {}};
+    req = chain(&rsp);
+    ASSERT_FALSE(req.has_value());
+    ASSERT_EQ(req.error(), Error::UnexpectedResponseCode);
+
+    // without a session every chain starts from the landing page
+    chain = bvbTest.GetIndexPageChain(
+        "BET-BK",
+        IndexPage::TradingData,
+        body,
+        nullptr);
+    req = chain(nullptr);
+    ASSERT_TRUE(req.has_value() && req->has_value());
+    ASSERT_EQ((*req)->method, HttpMethod::get);
+}
+
+TEST(BvbScraperTest, BaseUrl)
+{
+    BvbScraperTest bvbTest;
+
+    ASSERT_EQ(
+        bvbTest.GetInfoDividendPageRequest().url,
+        "https://bvb.ro/FinancialInstruments/CorporateActions/InfoDividend");
+
+    bvbTest.SetBaseUrl("http://127.0.0.1:8080/");
+    ASSERT_EQ(
+        bvbTest.GetInfoDividendPageRequest().url,
+        "http://127.0.0.1:8080/FinancialInstruments/CorporateActions/"
+        "InfoDividend");
+    ASSERT_EQ(
+        bvbTest.GetSelectIndexRequest("BET").url,
+        "http://127.0.0.1:8080/FinancialInstruments/Indices/IndicesProfiles");
+
+    bvbTest.SetBaseUrl("");
+    ASSERT_EQ(
+        bvbTest.GetSelectIndexRequest("BET").url,
+        "https://m.bvb.ro/FinancialInstruments/Indices/IndicesProfiles");
+}
+
+TEST(BvbScraperTest, ParseNumbers)
+{
+    BvbScraperTest bvbTest;
+
+    ASSERT_EQ(bvbTest.ParseInt("1,234,567", false), 1234567u);
+    ASSERT_EQ(bvbTest.ParseInt("123", false), 123u);
+    ASSERT_EQ(bvbTest.ParseInt("&nbsp;", true), 0u);
+    ASSERT_FALSE(bvbTest.ParseInt("&nbsp;", false));
+    ASSERT_FALSE(bvbTest.ParseInt("1234", false));
+    ASSERT_FALSE(bvbTest.ParseInt("0,123", false));
+    ASSERT_FALSE(bvbTest.ParseInt("", false));
+
+    ASSERT_EQ(
+        bvbTest.ParseDouble("12.3456", 4, false, false, false),
+        12.3456);
+    ASSERT_EQ(bvbTest.ParseDouble("0.05", 2, false, false, false), 0.05);
+    ASSERT_EQ(bvbTest.ParseDouble("-1.25", 2, true, false, false), -1.25);
+    ASSERT_EQ(
+        bvbTest.ParseDouble("1,234,567.89", 2, false, true, false),
+        1234567.89);
+    ASSERT_EQ(bvbTest.ParseDouble("&nbsp;", 2, false, false, true), 0.0);
+    ASSERT_FALSE(bvbTest.ParseDouble("-1.25", 2, false, false, false));
+    ASSERT_FALSE(bvbTest.ParseDouble("12.345", 2, false, false, false));
+    ASSERT_FALSE(bvbTest.ParseDouble("01.25", 2, false, false, false));
+    ASSERT_FALSE(bvbTest.ParseDouble("1234.25", 2, false, true, false));
+    ASSERT_FALSE(bvbTest.ParseDouble("1,234.25", 2, false, false, false));
+    ASSERT_EQ(
+        bvbTest.ParseDouble(
+            "12,345,678,901,234,567,890.12", 2, false, true, false),
+        12345678901234567890.12);
+    ASSERT_FALSE(bvbTest.ParseDouble(
+        std::string(70, '1') + ".25", 2, false, false, false));
+
+    ASSERT_EQ(bvbTest.ParseNumber("0.123456"), 0.123456);
+    ASSERT_EQ(bvbTest.ParseNumber("1"), 1.0);
+    ASSERT_FALSE(bvbTest.ParseNumber("1.2.3"));
+    ASSERT_FALSE(bvbTest.ParseNumber(""));
+    ASSERT_EQ(
+        bvbTest.ParseNumber("12345678901234567890.5"),
+        12345678901234567890.5);
+    ASSERT_FALSE(bvbTest.ParseNumber(std::string(70, '1')));
+}
@@ -0,0 +1,717 @@
+// A stand-in for the BVB web servers, so the scraper can be load and latency
+// tested with no network access. It serves pages built from the test/data
+// fixtures and emulates the ASP.NET postbacks of the indices profiles page:
+// the ViewState round-trip, the index selection and the adjustments history
+// and trading data tabs.
+//
+// Point the scraper at it with BvbScraper::SetBaseUrl(), or with the
+// SET_BVB_BASE_URL environment variable for bvb_scraper_tool.
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <netinet/in.h>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static constexpr std::string_view kInfoDividendPath =
+    "/FinancialInstruments/CorporateActions/InfoDividend";
+static constexpr std::string_view kIndicesProfilesPath =
+    "/FinancialInstruments/Indices/IndicesProfiles";
+
+static constexpr std::string_view kSelectIndexTarget =
+    "ctl00$ctl00$body$rightColumnPlaceHolder$IndexProfilesCurrentValues$"
+    "IndexControlList$ddIndices";
+static constexpr std::string_view kAdjustmentsHistoryTarget =
+    "ctl00$ctl00$body$rightColumnPlaceHolder$TabsControl$lb5";
+static constexpr std::string_view kTradingDataTarget =
+    "ctl00$ctl00$body$rightColumnPlaceHolder$TabsControl$lb1";
+
+static constexpr std::string_view kViewStateMark      = "/wEPDwUKMTY";
+static constexpr std::string_view kViewStateGenerator = "6C0A8E5E";
+static constexpr std::string_view kEventValidation    = "/wEdAA2bvbTestServer";
+static constexpr size_t kMaxRequestSize               = 16 * 1024 * 1024;
+// the bandwidth limit is applied over periods of this length
+static constexpr std::chrono::milliseconds kSendPeriod{10};
+
+struct Options
+{
+    uint16_t port = 8080;
+    std::chrono::milliseconds latency{0};
+    // bytes per second, zero is unlimited
+    size_t bandwidth = 0;
+    // percent of the requests answered with 503
+    unsigned errorRate   = 0;
+    size_t viewStateSize = 8 * 1024;
+    std::filesystem::path dataDir = "test/data";
+};
+
+struct Pages
+{
+    std::string dividends;
+    std::string indexesNames;
+    std::string indexesPerformance;
+    std::string selectedConstituents;
+    std::string constituents;
+    std::string adjustmentsHistory;
+    std::string tradingData;
+    std::vector<std::string> indexes;
+    std::string selected;
+};
+
+struct Request
+{
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> headers;
+    std::string body;
+};
+
+struct Response
+{
+    int code = 200;
+    std::string body;
+    bool cacheable = false;
+};
+
+static std::optional<std::string> ReadFile(const std::filesystem::path& path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (! f) {
+        return std::nullopt;
+    }
+
+    return std::string(
+        (std::istreambuf_iterator<char>(f)),
+        std::istreambuf_iterator<char>());
+}
+
+static std::string ToLower(std::string_view str)
+{
+    std::string res(str);
+
+    for (char& c : res) {
+        c = std::tolower(static_cast<unsigned char>(c));
+    }
+
+    return res;
+}
+
+static uint64_t Hash(std::string_view data)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static std::string UrlDecode(std::string_view str)
+{
+    std::string res;
+
+    res.reserve(str.size());
+    for (size_t i = 0; i < str.size(); i++) {
+        if (str[i] == '+') {
+            res += ' ';
+        } else if (str[i] == '%' && i + 2 < str.size() &&
+                   std::isxdigit(static_cast<unsigned char>(str[i + 1])) &&
+                   std::isxdigit(static_cast<unsigned char>(str[i + 2]))) {
+            res += static_cast<char>(
+                std::stoi(std::string(str.substr(i + 1, 2)), nullptr, 16));
+            i += 2;
+        } else {
+            res += str[i];
+        }
+    }
+
+    return res;
+}
+
+static std::map<std::string, std::string> ParseForm(std::string_view body)
+{
+    std::map<std::string, std::string> form;
+
+    while (! body.empty()) {
+        size_t end            = body.find('&');
+        std::string_view pair = body.substr(0, end);
+        body.remove_prefix(
+            end == std::string_view::npos ? body.size() : end + 1);
+
+        size_t eq = pair.find('=');
+        if (eq == std::string_view::npos) {
+            form[UrlDecode(pair)] = {};
+        } else {
+            form[UrlDecode(pair.substr(0, eq))] =
+                UrlDecode(pair.substr(eq + 1));
+        }
+    }
+
+    return form;
+}
+
+// Fills the indexes and the selected one from the options of the indexes
+// select.
+static bool ParseIndexes(Pages& pages)
+{
+    static constexpr std::string_view kValueMark    = "value=\"";
+    static constexpr std::string_view kSelectedMark = "selected=\"selected\"";
+
+    std::string_view data = pages.indexesNames;
+    size_t pos            = 0;
+
+    while ((pos = data.find("<option", pos)) != std::string_view::npos) {
+        size_t tagEnd = data.find('>', pos);
+        size_t value  = data.find(kValueMark, pos);
+        if (tagEnd == std::string_view::npos || value > tagEnd) {
+            return false;
+        }
+
+        value += kValueMark.size();
+        std::string name(data.substr(value, data.find('"', value) - value));
+        if (pages.selected.empty() &&
+            data.substr(pos, tagEnd - pos).find(kSelectedMark) !=
+                std::string_view::npos) {
+            pages.selected = name;
+        }
+
+        pages.indexes.push_back(std::move(name));
+        pos = tagEnd;
+    }
+
+    return ! pages.indexes.empty() && ! pages.selected.empty();
+}
+
+static std::optional<Pages> LoadPages(const std::filesystem::path& dataDir)
+{
+    Pages pages;
+    std::pair<const char*, std::string*> files[] = {
+        {"parse_dividend_activities.txt", &pages.dividends},
+        {"parse_indexes_names_data.txt", &pages.indexesNames},
+        {"parse_indexes_performance_data.txt", &pages.indexesPerformance},
+        {"parse_index_constituents_selected.txt", &pages.selectedConstituents},
+        {"parse_index_constituents.txt", &pages.constituents},
+        {"parse_index_adjustments_history.txt", &pages.adjustmentsHistory},
+        {"parse_index_trading_data.txt", &pages.tradingData},
+    };
+
+    for (auto& [name, page] : files) {
+        auto data = ReadFile(dataDir / name);
+        if (! data) {
+            std::cerr << "failed to read " << (dataDir / name) << std::endl;
+            return std::nullopt;
+        }
+        *page = std::move(*data);
+    }
+
+    if (! ParseIndexes(pages)) {
+        std::cerr << "failed to parse the indexes names" << std::endl;
+        return std::nullopt;
+    }
+
+    return pages;
+}
+
+// Like the real one, the ViewState depends only on the state of the page (the
+// selected index), so the same page always has the same ViewState.
+static std::string GetViewState(const Options& opts, const std::string& index)
+{
+    std::string res(kViewStateMark);
+
+    res += index;
+    res += '!';
+    while (res.size() < opts.viewStateSize) {
+        res += static_cast<char>('A' + res.size() % 26);
+    }
+
+    return res;
+}
+
+// Returns the index selected in the page which has viewState.
+static std::optional<std::string> ParseViewState(
+    const Options& opts,
+    const std::string& viewState)
+{
+    if (! viewState.starts_with(kViewStateMark)) {
+        return std::nullopt;
+    }
+
+    size_t end = viewState.find('!', kViewStateMark.size());
+    if (end == std::string::npos) {
+        return std::nullopt;
+    }
+
+    std::string index =
+        viewState.substr(kViewStateMark.size(), end - kViewStateMark.size());
+    if (GetViewState(opts, index) != viewState) {
+        return std::nullopt;
+    }
+
+    return index;
+}
+
+static std::string GetMainPage(
+    const Options& opts,
+    const Pages& pages,
+    std::string_view content)
+{
+    std::pair<std::string_view, std::string> fields[] = {
+        {"__EVENTTARGET", ""},
+        {"__EVENTARGUMENT", ""},
+        {"__LASTFOCUS", ""},
+        {"__VIEWSTATE", GetViewState(opts, pages.selected)},
+        {"__VIEWSTATEGENERATOR", std::string(kViewStateGenerator)},
+        {"__VIEWSTATEENCRYPTED", ""},
+        {"__EVENTVALIDATION", std::string(kEventValidation)},
+    };
+    std::string res =
+        "<!DOCTYPE html>\r\n<html>\r\n<head><title>BVB</title></head>\r\n"
+        "<body>\r\n<form method=\"post\" action=\"./IndicesProfiles\" "
+        "id=\"aspnetForm\">\r\n<div class=\"aspNetHidden\">\r\n";
+
+    for (const auto& [id, value] : fields) {
+        res += "<input type=\"hidden\" name=\"";
+        res += id;
+        res += "\" id=\"";
+        res += id;
+        res += "\" value=\"";
+        res += value;
+        res += "\" />\r\n";
+    }
+
+    res += "</div>\r\n";
+    res += content;
+    res += "</form>\r\n</body>\r\n</html>\r\n";
+
+    return res;
+}
+
+// ASP.NET gives the length of a record in UTF-16 code units, the UTF-8
+// continuation bytes are not counted and the characters of 4 bytes are
+// surrogate pairs.
+static size_t GetUtf16Length(std::string_view content)
+{
+    size_t length = 0;
+    for (unsigned char c : content) {
+        if ((c & 0xC0) != 0x80) {
+            length += c >= 0xF0 ? 2 : 1;
+        }
+    }
+
+    return length;
+}
+
+static void AddDeltaRecord(
+    std::string& delta,
+    std::string_view type,
+    std::string_view id,
+    std::string_view content)
+{
+    delta += std::to_string(GetUtf16Length(content));
+    delta += '|';
+    delta += type;
+    delta += '|';
+    delta += id;
+    delta += '|';
+    delta += content;
+    delta += '|';
+}
+
+// Builds the response of an async postback: the content of the updated panel
+// followed by the new form state.
+static std::string GetDeltaResponse(
+    const Options& opts,
+    const std::string& index,
+    std::string_view panel)
+{
+    std::string res;
+
+    AddDeltaRecord(res, "#", "", "4");
+    AddDeltaRecord(
+        res,
+        "updatePanel",
+        "ctl00_ctl00_body_rightColumnPlaceHolder_TabsControl_upMob",
+        panel);
+    AddDeltaRecord(res, "hiddenField", "__EVENTTARGET", "");
+    AddDeltaRecord(res, "hiddenField", "__EVENTARGUMENT", "");
+    AddDeltaRecord(res, "hiddenField", "__LASTFOCUS", "");
+    AddDeltaRecord(
+        res,
+        "hiddenField",
+        "__VIEWSTATE",
+        GetViewState(opts, index));
+    AddDeltaRecord(
+        res,
+        "hiddenField",
+        "__VIEWSTATEGENERATOR",
+        kViewStateGenerator);
+    AddDeltaRecord(res, "hiddenField", "__VIEWSTATEENCRYPTED", "");
+    AddDeltaRecord(res, "hiddenField", "__EVENTVALIDATION", kEventValidation);
+    AddDeltaRecord(res, "asyncPostBackControlIDs", "", "");
+    AddDeltaRecord(res, "pageTitle", "", "Indices Profiles");
+
+    return res;
+}
+
+static Response HandlePostBack(
+    const Options& opts,
+    const Pages& pages,
+    const Request& req)
+{
+    auto form     = ParseForm(req.body);
+    auto selected = ParseViewState(opts, form["__VIEWSTATE"]);
+    if (! selected || form["__EVENTVALIDATION"] != kEventValidation) {
+        // the form state was not issued by the server
+        return {500, "Invalid postback or callback argument"};
+    }
+
+    const std::string& index  = form[std::string(kSelectIndexTarget)];
+    const std::string& target = form["__EVENTTARGET"];
+    if (std::find(pages.indexes.begin(), pages.indexes.end(), index) ==
+        pages.indexes.end()) {
+        return {500, "Invalid index"};
+    }
+
+    if (target == kSelectIndexTarget) {
+        return {200, GetDeltaResponse(opts, index, pages.constituents)};
+    }
+
+    // the tabs show the index the form state was issued for
+    if (index != *selected) {
+        return {500, "Invalid postback or callback argument"};
+    }
+
+    if (target == kAdjustmentsHistoryTarget) {
+        return {200, GetDeltaResponse(opts, index, pages.adjustmentsHistory)};
+    }
+    if (target == kTradingDataTarget) {
+        return {200, GetDeltaResponse(opts, index, pages.tradingData)};
+    }
+
+    return {500, "Invalid event target"};
+}
+
+static Response HandleRequest(
+    const Options& opts,
+    const Pages& pages,
+    const Request& req)
+{
+    static thread_local std::minstd_rand rng(
+        std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+    if (opts.errorRate > 0 && rng() % 100 < opts.errorRate) {
+        return {503, "Service Unavailable"};
+    }
+
+    std::string_view path = req.path;
+    path                  = path.substr(0, path.find('?'));
+
+    if (req.method == "GET" && path == kInfoDividendPath) {
+        return {200, GetMainPage(opts, pages, pages.dividends), true};
+    }
+
+    if (req.method == "GET" && path == kIndicesProfilesPath) {
+        std::string content = pages.indexesNames + pages.indexesPerformance +
+            pages.selectedConstituents;
+        return {200, GetMainPage(opts, pages, content), true};
+    }
+
+    if (req.method == "POST" && path == kIndicesProfilesPath) {
+        return HandlePostBack(opts, pages, req);
+    }
+
+    return {404, "Not Found"};
+}
+
+static const char* GetReason(int code)
+{
+    switch (code) {
+    case 200:
+        return "OK";
+    case 304:
+        return "Not Modified";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 500:
+        return "Internal Server Error";
+    case 503:
+    default:
+        return "Service Unavailable";
+    }
+}
+
+static bool SendAll(int fd, std::string_view data)
+{
+    while (! data.empty()) {
+        ssize_t sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data.remove_prefix(sent);
+    }
+
+    return true;
+}
+
+// Sends data at no more than the configured bandwidth.
+static bool SendThrottled(const Options& opts, int fd, std::string_view data)
+{
+    if (opts.bandwidth == 0) {
+        return SendAll(fd, data);
+    }
+
+    size_t chunkSize = std::max<size_t>(
+        opts.bandwidth * kSendPeriod.count() / 1000,
+        1);
+    auto next = std::chrono::steady_clock::now();
+
+    while (! data.empty()) {
+        size_t size = std::min(chunkSize, data.size());
+        if (! SendAll(fd, data.substr(0, size))) {
+            return false;
+        }
+        data.remove_prefix(size);
+
+        next += kSendPeriod;
+        std::this_thread::sleep_until(next);
+    }
+
+    return true;
+}
+
+// Reads the next request of the connection into req. Returns false when the
+// connection is closed or the request is invalid.
+static bool ReadRequest(int fd, std::string& buffer, Request& req)
+{
+    char chunk[16 * 1024];
+    size_t headersEnd;
+
+    while ((headersEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t size = recv(fd, chunk, sizeof(chunk), 0);
+        if (size <= 0 || buffer.size() > kMaxRequestSize) {
+            return false;
+        }
+        buffer.append(chunk, size);
+    }
+
+    std::istringstream head(buffer.substr(0, headersEnd));
+    std::string line;
+
+    req = {};
+    if (! std::getline(head, line)) {
+        return false;
+    }
+
+    std::istringstream requestLine(line);
+    requestLine >> req.method >> req.path;
+
+    while (std::getline(head, line)) {
+        if (! line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+
+        size_t valuePos = line.find_first_not_of(' ', colon + 1);
+        req.headers[ToLower(line.substr(0, colon))] =
+            valuePos == std::string::npos ? "" : line.substr(valuePos);
+    }
+
+    size_t contentLength = 0;
+    auto it              = req.headers.find("content-length");
+    if (it != req.headers.end()) {
+        contentLength = std::strtoull(it->second.c_str(), nullptr, 10);
+    }
+    if (contentLength > kMaxRequestSize) {
+        return false;
+    }
+
+    size_t bodyPos = headersEnd + 4;
+    while (buffer.size() < bodyPos + contentLength) {
+        ssize_t size = recv(fd, chunk, sizeof(chunk), 0);
+        if (size <= 0) {
+            return false;
+        }
+        buffer.append(chunk, size);
+    }
+
+    req.body = buffer.substr(bodyPos, contentLength);
+    buffer.erase(0, bodyPos + contentLength);
+
+    return ! req.method.empty() && ! req.path.empty();
+}
+
+static void ServeConnection(const Options& opts, const Pages& pages, int fd)
+{
+    std::string buffer;
+    Request req;
+
+    while (ReadRequest(fd, buffer, req)) {
+        Response rsp = HandleRequest(opts, pages, req);
+        std::string etag;
+
+        if (rsp.cacheable) {
+            char hash[19];
+            std::snprintf(
+                hash,
+                sizeof(hash),
+                "\"%016llx\"",
+                static_cast<unsigned long long>(Hash(rsp.body)));
+            etag = hash;
+
+            auto it = req.headers.find("if-none-match");
+            if (it != req.headers.end() && it->second == etag) {
+                rsp.code = 304;
+                rsp.body.clear();
+            }
+        }
+
+        auto it        = req.headers.find("connection");
+        bool keepAlive = it == req.headers.end() ||
+            ToLower(it->second) != "close";
+
+        std::string head = "HTTP/1.1 " + std::to_string(rsp.code) + " " +
+            GetReason(rsp.code) + "\r\n";
+        head += "Content-Type: text/html; charset=utf-8\r\n";
+        head += "Content-Length: " + std::to_string(rsp.body.size()) + "\r\n";
+        head += "Cache-Control: private\r\n";
+        if (! etag.empty()) {
+            head += "ETag: " + etag + "\r\n";
+        }
+        head += keepAlive ? "Connection: keep-alive\r\n"
+                          : "Connection: close\r\n";
+        head += "\r\n";
+
+        std::this_thread::sleep_for(opts.latency);
+
+        if (! SendAll(fd, head) || ! SendThrottled(opts, fd, rsp.body) ||
+            ! keepAlive) {
+            break;
+        }
+    }
+
+    close(fd);
+}
+
+static void PrintHelp(const char* name)
+{
+    std::cout
+        << "usage: " << name << " [options]\n"
+        << "  --port <port>            listen on 127.0.0.1:<port> (8080)\n"
+        << "  --latency <ms>           delay every response (0)\n"
+        << "  --bandwidth <KiB/s>      limit the bandwidth of every "
+           "connection (unlimited)\n"
+        << "  --error-rate <percent>   answer that many requests with 503 "
+           "(0)\n"
+        << "  --viewstate-size <bytes> size of the ViewState (8192)\n"
+        << "  --data-dir <dir>         directory of the pages (test/data)\n";
+}
+
+static bool ParseOptions(int argc, char* argv[], Options& opts)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0 || i + 1 == argc) {
+            return false;
+        }
+
+        const char* value = argv[++i];
+        char* end         = nullptr;
+        unsigned long long number = std::strtoull(value, &end, 10);
+        bool isNumber = *value != '\0' && *end == '\0';
+
+        if (strcmp(argv[i - 1], "--port") == 0 && isNumber &&
+            number <= UINT16_MAX) {
+            opts.port = static_cast<uint16_t>(number);
+        } else if (strcmp(argv[i - 1], "--latency") == 0 && isNumber) {
+            opts.latency = std::chrono::milliseconds(number);
+        } else if (strcmp(argv[i - 1], "--bandwidth") == 0 && isNumber) {
+            opts.bandwidth = number * 1024;
+        } else if (strcmp(argv[i - 1], "--error-rate") == 0 && isNumber &&
+                   number <= 100) {
+            opts.errorRate = static_cast<unsigned>(number);
+        } else if (strcmp(argv[i - 1], "--viewstate-size") == 0 && isNumber) {
+            opts.viewStateSize = number;
+        } else if (strcmp(argv[i - 1], "--data-dir") == 0) {
+            opts.dataDir = value;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+
+    if (! ParseOptions(argc, argv, opts)) {
+        PrintHelp(argv[0]);
+        return -1;
+    }
+
+    auto pages = LoadPages(opts.dataDir);
+    if (! pages) {
+        return -1;
+    }
+
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::perror("socket");
+        return -1;
+    }
+
+    int enable = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(opts.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(listenFd, SOMAXCONN) < 0) {
+        std::perror("bind");
+        close(listenFd);
+        return -1;
+    }
+
+    std::cout << "serving on http://127.0.0.1:" << opts.port << std::endl;
+
+    // a thread per connection, the scraper opens only a few of them
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+
+        std::thread(ServeConnection, std::cref(opts), std::cref(*pages), fd)
+            .detach();
+    }
+
+    return 0;
+}
@@ -0,0 +1,545 @@
+#include "curl_utils.h"
+
+#include <arpa/inet.h>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <streambuf>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static std::string ReadFile(const char* path)
+{
+    std::ifstream f(path);
+
+    return std::string(
+        (std::istreambuf_iterator<char>(f)),
+        std::istreambuf_iterator<char>());
+}
+
+static HttpRequest FileRequest(const char* path)
+{
+    HttpRequest req;
+
+    req.url = "file://" + std::filesystem::absolute(path).string();
+
+    return req;
+}
+
+// Requests the files one after another and stores the body of every
+// response in bodies.
+static HttpRequestChain FilesChain(
+    std::vector<const char*> paths,
+    std::vector<std::string>& bodies)
+{
+    return [paths, &bodies, next = size_t(0)](HttpResponse* rsp) mutable
+           -> tl::expected<std::optional<HttpRequest>, Error> {
+        if (rsp != nullptr) {
+            bodies.push_back(std::move(rsp->body));
+        }
+
+        if (next == paths.size()) {
+            return std::nullopt;
+        }
+
+        return FileRequest(paths[next++]);
+    };
+}
+
+// Received by RevalidatingServer, the headers of every request are kept so
+// the conditional ones can be checked.
+struct ReceivedRequests
+{
+    std::mutex mutex;
+    std::vector<std::string> heads;
+};
+
+// Listens on an ephemeral port of the loopback interface and stores it in
+// port. Returns -1 on failure.
+static int ListenOnLoopback(uint16_t& port)
+{
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        return -1;
+    }
+
+    sockaddr_in addr{};
+    socklen_t addrLen    = sizeof(addr);
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = 0;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(listenFd, SOMAXCONN) < 0 ||
+        getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLen) <
+            0) {
+        close(listenFd);
+        return -1;
+    }
+
+    port = ntohs(addr.sin_port);
+    return listenFd;
+}
+
+// Serves count connections, one request per connection, giving up when none
+// is opened for a few seconds. Like bvb_test_server, the page has an ETag and
+// a request which carries it gets a 304 without a body.
+static void RevalidatingServer(
+    int listenFd,
+    size_t count,
+    ReceivedRequests& received)
+{
+    const std::string etag = "\"v2\"";
+    const std::string body = "fresh body";
+    pollfd pfd{listenFd, POLLIN, 0};
+
+    for (; count > 0 && poll(&pfd, 1, 5000) > 0; count--) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            break;
+        }
+
+        std::string head;
+        char buf[1024];
+        while (head.find("\r\n\r\n") == std::string::npos) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                break;
+            }
+            head.append(buf, n);
+        }
+
+        bool notModified =
+            head.find("If-None-Match: " + etag + "\r\n") != std::string::npos;
+        {
+            std::lock_guard<std::mutex> lock(received.mutex);
+            received.heads.push_back(head);
+        }
+
+        std::string rsp = notModified ? "HTTP/1.1 304 Not Modified\r\n"
+                                      : "HTTP/1.1 200 OK\r\n";
+        rsp += "ETag: " + etag + "\r\n";
+        rsp += "Content-Length: " +
+            std::to_string(notModified ? 0 : body.size()) + "\r\n";
+        rsp += "Connection: close\r\n\r\n";
+        if (! notModified) {
+            rsp += body;
+        }
+
+        send(fd, rsp.data(), rsp.size(), MSG_NOSIGNAL);
+        close(fd);
+    }
+
+    close(listenFd);
+}
+
+TEST(CurlUtilsTest, PerformChain)
+{
+    const char* firstPath  = "test/data/parse_indexes_names_data.txt";
+    const char* secondPath = "test/data/parse_index_trading_data.txt";
+    std::vector<std::string> bodies;
+    ScopedCurl curl;
+
+    ASSERT_TRUE(curl);
+    ASSERT_EQ(
+        curl.PerformChain(FilesChain({firstPath, secondPath}, bodies)),
+        Error::NoError);
+    ASSERT_EQ(bodies.size(), 2);
+    ASSERT_EQ(bodies[0], ReadFile(firstPath));
+    ASSERT_EQ(bodies[1], ReadFile(secondPath));
+
+    auto failingChain = [](HttpResponse* rsp)
+        -> tl::expected<std::optional<HttpRequest>, Error> {
+        if (rsp == nullptr) {
+            return FileRequest("test/data/parse_indexes_names_data.txt");
+        }
+        return tl::unexpected(Error::InvalidData);
+    };
+    ASSERT_EQ(curl.PerformChain(failingChain), Error::InvalidData);
+}
+
+TEST(CurlUtilsTest, CurlMulti)
+{
+    std::vector<const char*> paths = {
+        "test/data/parse_indexes_names_data.txt",
+        "test/data/parse_index_constituents.txt",
+        "test/data/parse_index_trading_data.txt",
+    };
+    std::vector<std::vector<std::string>> bodies(4);
+
+    for (size_t maxTransfers : {1, 2, 8}) {
+        CurlMulti multi;
+        ASSERT_TRUE(multi);
+
+        for (auto& b : bodies) {
+            b.clear();
+        }
+
+        multi.Add(FilesChain(paths, bodies[0]));
+        multi.Add([](HttpResponse*)
+                      -> tl::expected<std::optional<HttpRequest>, Error> {
+            return tl::unexpected(Error::InvalidArg);
+        });
+        multi.Add(FilesChain({paths[2], paths[0]}, bodies[2]));
+        multi.Add(FilesChain({"test/data/missing_file.txt"}, bodies[3]));
+
+        auto errors = multi.Perform(maxTransfers);
+        ASSERT_EQ(errors.size(), 4);
+        ASSERT_EQ(errors[0], Error::NoError);
+        ASSERT_EQ(errors[1], Error::InvalidArg);
+        ASSERT_EQ(errors[2], Error::NoError);
+        ASSERT_EQ(errors[3], Error::CurlPerformError);
+
+        ASSERT_EQ(bodies[0].size(), paths.size());
+        for (size_t i = 0; i < paths.size(); i++) {
+            ASSERT_EQ(bodies[0][i], ReadFile(paths[i]));
+        }
+        ASSERT_EQ(bodies[2].size(), 2);
+        ASSERT_EQ(bodies[2][0], ReadFile(paths[2]));
+        ASSERT_EQ(bodies[2][1], ReadFile(paths[0]));
+        ASSERT_TRUE(bodies[3].empty());
+    }
+}
+
+TEST(CurlUtilsTest, HttpCache)
+{
+    std::filesystem::path dirPath =
+        std::filesystem::temp_directory_path() / "set_http_cache_test";
+    std::filesystem::remove_all(dirPath);
+
+    HttpCache cache(dirPath);
+    HttpCacheEntry entry;
+
+    ASSERT_FALSE(cache.Load("GET https://bvb.ro/\n").has_value());
+
+    entry.storedAt = std::chrono::system_clock::time_point(
+        std::chrono::seconds(1700000000));
+    entry.code    = 200;
+    entry.headers = "HTTP/1.1 301 Moved Permanently\r\n"
+                    "ETag: \"old\"\r\n"
+                    "\r\n"
+                    "HTTP/1.1 200 OK\r\n"
+                    "etag:  \"abc\" \r\n"
+                    "Last-Modified: Tue, 15 Nov 1994 12:45:26 GMT\r\n"
+                    "\r\n";
+    entry.body = std::string("line 1\nline 2\r\n\0binary", 22);
+    HttpCache::ParseValidators(entry);
+    ASSERT_EQ(entry.etag, "\"abc\"");
+    ASSERT_EQ(entry.lastModified, "Tue, 15 Nov 1994 12:45:26 GMT");
+
+    ASSERT_EQ(cache.Store("GET https://bvb.ro/\n", entry), Error::NoError);
+
+    auto loaded = cache.Load("GET https://bvb.ro/\n");
+    ASSERT_TRUE(loaded.has_value());
+    ASSERT_EQ(loaded->storedAt, entry.storedAt);
+    ASSERT_EQ(loaded->code, entry.code);
+    ASSERT_EQ(loaded->etag, entry.etag);
+    ASSERT_EQ(loaded->lastModified, entry.lastModified);
+    ASSERT_EQ(loaded->headers, entry.headers);
+    ASSERT_EQ(loaded->body, entry.body);
+
+    // the requests differing only by body have different entries
+    ASSERT_FALSE(cache.Load("POST https://bvb.ro/\na=1").has_value());
+
+    std::filesystem::remove_all(dirPath);
+}
+
+TEST(CurlUtilsTest, PerformFromHttpCache)
+{
+    std::filesystem::path dirPath =
+        std::filesystem::temp_directory_path() / "set_http_cache_test";
+    std::filesystem::remove_all(dirPath);
+
+    // the file does not exist, so only a response from cache succeeds
+    HttpRequest req = FileRequest("test/data/missing_file.txt");
+    HttpCache cache(dirPath);
+    HttpCacheEntry entry;
+    ScopedCurl curl;
+
+    entry.storedAt = std::chrono::system_clock::now();
+    entry.code     = 200;
+    entry.body     = "cached body";
+    ASSERT_EQ(cache.Store("GET " + req.url + "\n", entry), Error::NoError);
+
+    curl.SetCache(&cache);
+
+    // no TTL, no cache
+    ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+    ASSERT_FALSE(curl.Perform().has_value());
+
+    req.cacheTtl = std::chrono::minutes(1);
+    ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+    auto rsp = curl.Perform();
+    ASSERT_TRUE(rsp.has_value());
+    ASSERT_EQ(rsp->code, 200);
+    ASSERT_EQ(rsp->body, "cached body");
+
+    std::string body;
+    ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+    rsp = curl.Perform([&body](std::string_view chunk) {
+        body.append(chunk);
+        return Error::NoError;
+    });
+    ASSERT_TRUE(rsp.has_value());
+    ASSERT_TRUE(rsp->body.empty());
+    ASSERT_EQ(body, "cached body");
+
+    std::vector<std::string> bodies;
+    CurlMulti multi;
+    multi.SetCache(&cache);
+    multi.Add([&req, sent = false](HttpResponse*) mutable
+                  -> tl::expected<std::optional<HttpRequest>, Error> {
+        if (sent) {
+            return std::nullopt;
+        }
+        sent = true;
+        return req;
+    });
+    multi.Add(FilesChain({"test/data/missing_file.txt"}, bodies));
+    auto errors = multi.Perform(2);
+    ASSERT_EQ(errors[0], Error::NoError);
+    ASSERT_EQ(errors[1], Error::CurlPerformError);
+
+    // a refresh downloads the response even if the cached one is fresh
+    const char* filePath = "test/data/parse_indexes_names_data.txt";
+    HttpRequest fileReq  = FileRequest(filePath);
+    fileReq.cacheTtl     = std::chrono::minutes(1);
+    ASSERT_EQ(cache.Store("GET " + fileReq.url + "\n", entry), Error::NoError);
+    ASSERT_EQ(curl.SetRequest(fileReq), Error::NoError);
+    rsp = curl.Perform();
+    ASSERT_TRUE(rsp.has_value());
+    ASSERT_EQ(rsp->body, "cached body");
+
+    fileReq.refreshCache = true;
+    ASSERT_EQ(curl.SetRequest(fileReq), Error::NoError);
+    rsp = curl.Perform();
+    ASSERT_TRUE(rsp.has_value());
+    ASSERT_EQ(rsp->body, ReadFile(filePath));
+
+    // a cached response rejected by a chain is removed from the cache
+    std::string key = "GET " + req.url + "\n";
+    auto rejecting  = [&req, sent = false](HttpResponse* rsp) mutable
+        -> tl::expected<std::optional<HttpRequest>, Error> {
+        if (sent) {
+            EXPECT_FALSE(rsp->cacheKey.empty());
+            return tl::unexpected(Error::UnexpectedResponseCode);
+        }
+        sent = true;
+        return req;
+    };
+    ASSERT_EQ(curl.PerformChain(rejecting), Error::UnexpectedResponseCode);
+    ASSERT_FALSE(cache.Load(key).has_value());
+
+    ASSERT_EQ(cache.Store(key, entry), Error::NoError);
+    CurlMulti rejectingMulti;
+    rejectingMulti.SetCache(&cache);
+    rejectingMulti.Add(rejecting);
+    errors = rejectingMulti.Perform(1);
+    ASSERT_EQ(errors[0], Error::UnexpectedResponseCode);
+    ASSERT_FALSE(cache.Load(key).has_value());
+
+    // a stale entry is revalidated, which fails here
+    entry.storedAt -= std::chrono::minutes(2);
+    ASSERT_EQ(cache.Store("GET " + req.url + "\n", entry), Error::NoError);
+    ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+    ASSERT_FALSE(curl.Perform().has_value());
+
+    std::filesystem::remove_all(dirPath);
+}
+
+TEST(CurlUtilsTest, RevalidateHttpCache)
+{
+    std::filesystem::path dirPath =
+        std::filesystem::temp_directory_path() / "set_http_revalidate_test";
+    std::filesystem::remove_all(dirPath);
+
+    uint16_t port = 0;
+    int listenFd  = ListenOnLoopback(port);
+    ASSERT_GE(listenFd, 0);
+
+    ReceivedRequests received;
+    std::jthread server(RevalidatingServer, listenFd, 3, std::ref(received));
+
+    HttpRequest req;
+    req.url      = "http://127.0.0.1:" + std::to_string(port) + "/page";
+    req.cacheTtl = std::chrono::minutes(1);
+
+    std::string key = "GET " + req.url + "\n";
+    HttpCache cache(dirPath);
+    HttpCacheEntry entry;
+    ScopedCurl curl;
+
+    auto storedAt = std::chrono::system_clock::now() - std::chrono::hours(1);
+
+    entry.storedAt     = storedAt;
+    entry.code         = 200;
+    entry.body         = "cached body";
+    entry.etag         = "\"v2\"";
+    entry.lastModified = "Sat, 17 Oct 2026 08:00:00 GMT";
+    ASSERT_EQ(cache.Store(key, entry), Error::NoError);
+
+    curl.SetCache(&cache);
+
+    // the stale entry is revalidated and the 304 is replaced by its body
+    ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+    auto rsp = curl.Perform();
+    ASSERT_TRUE(rsp.has_value());
+    ASSERT_EQ(rsp->code, 200);
+    ASSERT_EQ(rsp->body, "cached body");
+    ASSERT_EQ(rsp->cacheKey, key);
+    {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        ASSERT_EQ(received.heads.size(), 1);
+        ASSERT_NE(
+            received.heads[0].find("If-None-Match: \"v2\"\r\n"),
+            std::string::npos);
+        ASSERT_NE(
+            received.heads[0].find(
+                "If-Modified-Since: Sat, 17 Oct 2026 08:00:00 GMT\r\n"),
+            std::string::npos);
+    }
+
+    // the entry is fresh again, so it is used without a request
+    auto revalidated = cache.Load(key);
+    ASSERT_TRUE(revalidated.has_value());
+    ASSERT_GT(revalidated->storedAt, storedAt);
+    ASSERT_EQ(revalidated->body, "cached body");
+    ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+    rsp = curl.Perform();
+    ASSERT_TRUE(rsp.has_value());
+    ASSERT_EQ(rsp->body, "cached body");
+    {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        ASSERT_EQ(received.heads.size(), 1);
+    }
+
+    // a streamed 304 passes the body of the entry to the callback
+    ASSERT_EQ(cache.Store(key, entry), Error::NoError);
+    std::string body;
+    ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+    rsp = curl.Perform([&body](std::string_view chunk) {
+        body.append(chunk);
+        return Error::NoError;
+    });
+    ASSERT_TRUE(rsp.has_value());
+    ASSERT_EQ(rsp->code, 200);
+    ASSERT_TRUE(rsp->body.empty());
+    ASSERT_EQ(body, "cached body");
+
+    // a refresh sends no validators and stores the page downloaded
+    req.refreshCache = true;
+    ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+    rsp = curl.Perform();
+    ASSERT_TRUE(rsp.has_value());
+    ASSERT_EQ(rsp->body, "fresh body");
+    {
+        std::lock_guard<std::mutex> lock(received.mutex);
+        ASSERT_EQ(received.heads.size(), 3);
+        ASSERT_EQ(received.heads[2].find("If-None-Match"), std::string::npos);
+    }
+    auto refreshed = cache.Load(key);
+    ASSERT_TRUE(refreshed.has_value());
+    ASSERT_EQ(refreshed->body, "fresh body");
+    ASSERT_EQ(refreshed->etag, "\"v2\"");
+
+    std::filesystem::remove_all(dirPath);
+}
+
+TEST(CurlUtilsTest, SessionArchive)
+{
+    std::filesystem::path dirPath =
+        std::filesystem::temp_directory_path() / "set_session_archive_test";
+    std::filesystem::remove_all(dirPath);
+
+    HttpCacheEntry entry;
+    {
+        SessionArchive archive(dirPath, SessionArchive::Mode::Record);
+        ASSERT_EQ(archive.GetMode(), SessionArchive::Mode::Record);
+
+        // every time a request is sent it gets its own key
+        std::string first  = archive.NextKey("GET https://bvb.ro/\n");
+        std::string second = archive.NextKey("GET https://bvb.ro/\n");
+        ASSERT_NE(first, second);
+        ASSERT_NE(first, archive.NextKey("POST https://bvb.ro/\n"));
+
+        entry.body = "first";
+        ASSERT_EQ(archive.Record(first, entry), Error::NoError);
+        entry.body = "second";
+        ASSERT_EQ(archive.Record(second, entry), Error::NoError);
+    }
+
+    SessionArchive archive(dirPath, SessionArchive::Mode::Replay);
+    std::vector<std::string> bodies;
+    for (size_t i = 0; i < 3; i++) {
+        auto replayed =
+            archive.Replay(archive.NextKey("GET https://bvb.ro/\n"));
+        ASSERT_TRUE(replayed.has_value());
+        bodies.push_back(std::move(replayed->body));
+    }
+    ASSERT_EQ(bodies, std::vector<std::string>({"first", "second", "second"}));
+
+    auto replayed = archive.Replay(archive.NextKey("POST https://bvb.ro/\n"));
+    ASSERT_FALSE(replayed.has_value());
+    ASSERT_EQ(replayed.error(), Error::NotRecorded);
+
+    std::filesystem::remove_all(dirPath);
+}
+
+TEST(CurlUtilsTest, PerformFromSessionArchive)
+{
+    std::filesystem::path dirPath =
+        std::filesystem::temp_directory_path() / "set_session_archive_test";
+    std::filesystem::path filePath =
+        std::filesystem::temp_directory_path() / "set_session_archive.txt";
+    std::filesystem::remove_all(dirPath);
+
+    std::ofstream(filePath) << "recorded body";
+    HttpRequest req = FileRequest(filePath.c_str());
+    {
+        SessionArchive archive(dirPath, SessionArchive::Mode::Record);
+        ScopedCurl curl;
+
+        curl.SetArchive(&archive);
+        ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+        auto rsp = curl.Perform();
+        ASSERT_TRUE(rsp.has_value());
+        ASSERT_EQ(rsp->body, "recorded body");
+    }
+
+    // the replay does not read the file anymore
+    std::filesystem::remove(filePath);
+
+    SessionArchive archive(dirPath, SessionArchive::Mode::Replay);
+    ScopedCurl curl;
+
+    curl.SetArchive(&archive);
+    ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+    auto rsp = curl.Perform();
+    ASSERT_TRUE(rsp.has_value());
+    ASSERT_EQ(rsp->body, "recorded body");
+
+    std::string body;
+    ASSERT_EQ(curl.SetRequest(req), Error::NoError);
+    rsp = curl.Perform([&body](std::string_view chunk) {
+        body.append(chunk);
+        return Error::NoError;
+    });
+    ASSERT_TRUE(rsp.has_value());
+    ASSERT_EQ(body, "recorded body");
+
+    std::vector<std::string> bodies;
+    CurlMulti multi;
+    multi.SetArchive(&archive);
+    multi.Add(FilesChain({filePath.c_str()}, bodies));
+    multi.Add(FilesChain({"test/data/parse_indexes_names_data.txt"}, bodies));
+    auto errors = multi.Perform(2);
+    ASSERT_EQ(errors[0], Error::NoError);
+    ASSERT_EQ(errors[1], Error::NotRecorded);
+    ASSERT_EQ(bodies, std::vector<std::string>({"recorded body"}));
+
+    std::filesystem::remove_all(dirPath);
+}
@@ -1,6 +1,100 @@
 #include "html_parser.h"
 
+#include <fstream>
 #include <gtest/gtest.h>
+#include <streambuf>
+
+class HtmlParserTest {
+public:
+    using ScanVariant    = HtmlParser::ScanVariant;
+    using HtmlCharBitmap = HtmlParser::HtmlCharBitmap;
+
+    static bool ScanTagBoundaries(
+        ScanVariant variant,
+        std::string_view data,
+        HtmlCharBitmap& lt,
+        HtmlCharBitmap& gt)
+    {
+        return HtmlParser::ScanTagBoundaries(variant, data, lt, gt);
+    }
+};
+
+static const std::vector<HtmlTag> kAllTags = {
+    HtmlTag::Select,
+    HtmlTag::Option,
+    HtmlTag::Table,
+    HtmlTag::Thead,
+    HtmlTag::Tbody,
+    HtmlTag::Tr,
+    HtmlTag::Th,
+    HtmlTag::Td,
+    HtmlTag::Input,
+    HtmlTag::A,
+    HtmlTag::Div,
+    HtmlTag::Strong,
+};
+
+static void AssertSameLocations(
+    const tl::expected<HtmlElementLocations, Error>& expected,
+    const tl::expected<HtmlElementLocations, Error>& actual)
+{
+    ASSERT_EQ(expected.has_value(), actual.has_value());
+    if (! expected.has_value()) {
+        ASSERT_EQ(expected.error(), actual.error());
+        return;
+    }
+
+    ASSERT_EQ(expected->size(), actual->size());
+    for (size_t i = 0; i < expected->size(); i++) {
+        const auto& e = (*expected)[i];
+        const auto& a = (*actual)[i];
+        ASSERT_EQ(e.beginTag.Lower(), a.beginTag.Lower());
+        ASSERT_EQ(e.beginTag.Upper(), a.beginTag.Upper());
+        ASSERT_EQ(e.data.Lower(), a.data.Lower());
+        ASSERT_EQ(e.data.Upper(), a.data.Upper());
+        ASSERT_EQ(e.endTag.Lower(), a.endTag.Lower());
+        ASSERT_EQ(e.endTag.Upper(), a.endTag.Upper());
+    }
+}
+
+// Runs FindAllElements and FindElement for every tag on the whole page and
+// inside every element found on the page, with and without the tag index.
+static void AssertTagIndexSameResults(const std::string& data)
+{
+    HtmlParser scanParser(data);
+    HtmlParser indexParser(data);
+    std::vector<ClosedInterval> intervals = {{}};
+
+    indexParser.BuildTagIndex();
+
+    for (HtmlTag tag : kAllTags) {
+        auto res = scanParser.FindAllElements(tag);
+        if (res) {
+            for (const auto& loc : *res) {
+                intervals.push_back(loc.data);
+            }
+        }
+    }
+
+    for (const auto& ci : intervals) {
+        for (HtmlTag tag : kAllTags) {
+            AssertSameLocations(
+                scanParser.FindAllElements(tag, ci),
+                indexParser.FindAllElements(tag, ci));
+
+            auto expected = scanParser.FindElement(tag, ci);
+            auto actual   = indexParser.FindElement(tag, ci);
+            ASSERT_EQ(expected.has_value(), actual.has_value());
+            if (! expected.has_value()) {
+                ASSERT_EQ(expected.error(), actual.error());
+                continue;
+            }
+            ASSERT_EQ(expected->beginTag.Lower(), actual->beginTag.Lower());
+            ASSERT_EQ(expected->data.Upper(), actual->data.Upper());
+            ASSERT_EQ(expected->endTag.Upper(), actual->endTag.Upper());
+        }
+    }
+}
 
 TEST(HtmlParserTest, FindElement)
 {
@@ -613,3 +707,176 @@ TEST(HtmlParserTest, FindAllElementsNoEndTag)
     ASSERT_EQ((*result)[0].endTag.Lower(), 28);
     ASSERT_EQ((*result)[0].endTag.Upper(), 27);
 }
+
+TEST(HtmlParserTest, TagIndexSameResults)
+{
+    std::vector<std::string> pages = {
+        "<table>first table</table>\n"
+        "<table id=\"test\"   >blah</table>\n"
+        "<table   >third table</table>",
+        "<table>"
+        "  <table>"
+        "    <table></table>"
+        "    <table></table>"
+        "  </table>"
+        "  <table>"
+        "    <table></table>"
+        "    <table></table>"
+        "  </table>"
+        "</table>",
+        "<input /><input id=\"test\" />",
+        "<thead><tr><th>a</th><th>b</th></tr></thead><tr><td>1</td>",
+        "<td>unclosed<td id=\"x\"></td>",
+    };
+    std::vector<std::string> files = {
+        "test/data/parse_dividend_activities.txt",
+        "test/data/parse_index_adjustments_history.txt",
+        "test/data/parse_index_constituents.txt",
+        "test/data/parse_index_trading_data_with_missing_fields.txt",
+        "test/data/parse_indexes_names_data.txt",
+        "test/data/parse_indexes_performance_data.txt",
+    };
+
+    for (const auto& file : files) {
+        std::ifstream f(file);
+        ASSERT_TRUE(f.is_open());
+
+        pages.emplace_back(
+            (std::istreambuf_iterator<char>(f)),
+            std::istreambuf_iterator<char>());
+    }
+
+    for (const auto& page : pages) {
+        AssertTagIndexSameResults(page);
+    }
+}
+
+TEST(HtmlParserTest, FindElementWithTagIndex)
+{
+    std::string data =
+        "<tbody><tr><td>1</td><td>2</td></tr>"
+        "<tr class=\"odd\"><td><table><tr><td>3</td></tr></table></td></tr>"
+        "</tbody>";
+    HtmlParser htmlParser(data);
+
+    htmlParser.BuildTagIndex();
+
+    auto result = htmlParser.FindAllElements(HtmlTag::Tr);
+    ASSERT_TRUE(result.has_value());
+    ASSERT_EQ(result->size(), 2);
+
+    ASSERT_EQ((*result)[0].beginTag.Lower(), 7);
+    ASSERT_EQ((*result)[0].beginTag.Upper(), 10);
+    ASSERT_EQ((*result)[0].data.Lower(), 11);
+    ASSERT_EQ((*result)[0].data.Upper(), 30);
+    ASSERT_EQ((*result)[0].endTag.Lower(), 31);
+    ASSERT_EQ((*result)[0].endTag.Upper(), 35);
+
+    ASSERT_EQ((*result)[1].beginTag.Lower(), 36);
+    ASSERT_EQ((*result)[1].beginTag.Upper(), 51);
+    ASSERT_EQ((*result)[1].data.Lower(), 52);
+    ASSERT_EQ((*result)[1].data.Upper(), 94);
+    ASSERT_EQ((*result)[1].endTag.Lower(), 95);
+    ASSERT_EQ((*result)[1].endTag.Upper(), 99);
+
+    auto tdResult = htmlParser.FindAllElements(HtmlTag::Td, (*result)[1].data);
+    ASSERT_TRUE(tdResult.has_value());
+    ASSERT_EQ(tdResult->size(), 1);
+    ASSERT_EQ((*tdResult)[0].data.Lower(), 56);
+    ASSERT_EQ((*tdResult)[0].data.Upper(), 89);
+
+    auto trResult = htmlParser.FindElement(
+        HtmlTag::Tr,
+        {},
+        HtmlAttribute::Class,
+        "odd");
+    ASSERT_TRUE(trResult.has_value());
+    ASSERT_EQ(trResult->beginTag.Lower(), 36);
+
+    trResult =
+        htmlParser.FindElement(HtmlTag::Tr, {}, HtmlAttribute::Id, "odd");
+    ASSERT_FALSE(trResult.has_value());
+    ASSERT_EQ(trResult.error(), Error::HtmlElementNotFound);
+}
+
+TEST(HtmlParserTest, FindAllElementsIntoBuffer)
+{
+    std::string data =
+        "<tr><td>1</td><td>2</td><td>3</td></tr>"
+        "<tr><td>4</td></tr>";
+    HtmlParser htmlParser(data);
+    HtmlElementLocations locations;
+
+    htmlParser.BuildTagIndex();
+
+    auto rows = htmlParser.FindAllElements(HtmlTag::Tr);
+    ASSERT_TRUE(rows.has_value());
+    ASSERT_EQ(rows->size(), 2);
+
+    Error err =
+        htmlParser.FindAllElements(locations, HtmlTag::Td, (*rows)[0].data);
+    ASSERT_EQ(err, Error::NoError);
+    ASSERT_EQ(locations.size(), 3);
+    ASSERT_EQ(locations[2].data.Lower(), 28);
+    ASSERT_EQ(locations[2].data.Upper(), 28);
+
+    err = htmlParser.FindAllElements(locations, HtmlTag::Td, (*rows)[1].data);
+    ASSERT_EQ(err, Error::NoError);
+    ASSERT_EQ(locations.size(), 1);
+    ASSERT_EQ(locations[0].data.Lower(), 47);
+    ASSERT_EQ(locations[0].data.Upper(), 47);
+
+    err = htmlParser.FindAllElements(locations, HtmlTag::Th);
+    ASSERT_EQ(err, Error::HtmlElementNotFound);
+    ASSERT_TRUE(locations.empty());
+}
+
+TEST(HtmlParserTest, ScanTagBoundariesVariants)
+{
+    using ScanVariant    = HtmlParserTest::ScanVariant;
+    using HtmlCharBitmap = HtmlParserTest::HtmlCharBitmap;
+
+    // '<' and '>' at both ends of every chunk of 16 and 32 bytes and of the
+    // 64 bytes blocks, between text which is not a tag boundary
+    std::string page;
+    for (size_t i = 0; i < 300; i++) {
+        if (i % 16 == 0 || i % 32 == 31) {
+            page += '<';
+        } else if (i % 16 == 15 || i % 32 == 0) {
+            page += '>';
+        } else {
+            page += static_cast<char>('a' + i % 26);
+        }
+    }
+    page[100] = '<';
+    page[101] = '>';
+
+    // every size, so the parts which are not whole chunks are covered too
+    for (size_t size = 0; size <= page.size(); size++) {
+        std::string_view data(page.data(), size);
+        HtmlCharBitmap expectedLt((size + 63) / 64, 0);
+        HtmlCharBitmap expectedGt((size + 63) / 64, 0);
+        for (size_t i = 0; i < size; i++) {
+            if (data[i] == '<') {
+                expectedLt[i / 64] |= 1ull << (i % 64);
+            } else if (data[i] == '>') {
+                expectedGt[i / 64] |= 1ull << (i % 64);
+            }
+        }
+
+        for (auto variant :
+             {ScanVariant::Scalar, ScanVariant::Sse2, ScanVariant::Avx2}) {
+            HtmlCharBitmap lt = {~0ull};
+            HtmlCharBitmap gt = {~0ull};
+            if (! HtmlParserTest::ScanTagBoundaries(variant, data, lt, gt)) {
+                ASSERT_NE(variant, ScanVariant::Scalar);
+                continue;
+            }
+
+            ASSERT_EQ(lt, expectedLt) << "variant " << int(variant)
+                                      << ", size " << size;
+            ASSERT_EQ(gt, expectedGt) << "variant " << int(variant)
+                                      << ", size " << size;
+        }
+    }
+}
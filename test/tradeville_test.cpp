@@ -0,0 +1,71 @@
+#include "tradeville.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+class TradevilleTest {
+public:
+    static std::string GetMessageKey(std::string_view msg)
+    {
+        return Tradeville::GetMessageKey(msg);
+    }
+};
+
+TEST(TradevilleTest, MessageKey)
+{
+    // a response echoes the command and the parameters of its request
+    std::string rsp2023 =
+        "{\"cmd\": \"Activity\", \"prm\": {\"symbol\": null, "
+        "\"dstart\": \"1jan23\", \"dend\": \"31dec23\"}, "
+        "\"data\": {\"Symbol\": [\"TLV\"], \"Date\": [\"2023-05-02\"]}}";
+    std::string rsp2024 =
+        "{\"cmd\":\"Activity\",\"prm\":{\"symbol\":null,"
+        "\"dstart\":\"1jan24\",\"dend\":\"31dec24\"},\"data\":{}}";
+    std::string rspTlv =
+        "{\"cmd\":\"Activity\",\"prm\":{\"symbol\":\"TLV\","
+        "\"dstart\":\"1jan24\",\"dend\":\"31dec24\"},\"data\":{}}";
+
+    // the requests as GetActivityRequest writes them
+    std::string req2023 =
+        "{\"cmd\":\"Activity\",\"prm\":{\"symbol\":null,"
+        "\"dstart\":\"1jan23\",\"dend\":\"31dec23\"}}";
+    std::string req2024 =
+        "{\"cmd\":\"Activity\",\"prm\":{\"symbol\":null,"
+        "\"dstart\":\"1jan24\",\"dend\":\"31dec24\"}}";
+    std::string reqTlv =
+        "{\"cmd\":\"Activity\",\"prm\":{\"symbol\":\"TLV\","
+        "\"dstart\":\"1jan24\",\"dend\":\"31dec24\"}}";
+
+    ASSERT_EQ(
+        TradevilleTest::GetMessageKey(req2023),
+        TradevilleTest::GetMessageKey(rsp2023));
+    ASSERT_EQ(
+        TradevilleTest::GetMessageKey(req2024),
+        TradevilleTest::GetMessageKey(rsp2024));
+    ASSERT_EQ(
+        TradevilleTest::GetMessageKey(reqTlv),
+        TradevilleTest::GetMessageKey(rspTlv));
+
+    // the activity requests of different years or symbols don't match
+    ASSERT_NE(
+        TradevilleTest::GetMessageKey(rsp2023),
+        TradevilleTest::GetMessageKey(rsp2024));
+    ASSERT_NE(
+        TradevilleTest::GetMessageKey(rsp2024),
+        TradevilleTest::GetMessageKey(rspTlv));
+
+    // the other commands are matched by the command only
+    ASSERT_EQ(
+        TradevilleTest::GetMessageKey(
+            "{\"cmd\":\"Portfolio\",\"prm\":{\"data\":\"null\"}}"),
+        "Portfolio");
+    ASSERT_EQ(
+        TradevilleTest::GetMessageKey(
+            "{\"cmd\":\"login\",\"prm\":{\"coduser\":\"u\",\"parola\":\"p\"}}"),
+        "login");
+    ASSERT_EQ(
+        TradevilleTest::GetMessageKey("{\"cmd\":\"Portfolio\"}"),
+        "Portfolio");
+    ASSERT_EQ(TradevilleTest::GetMessageKey("{\"prm\":{}}"), "");
+    ASSERT_EQ(TradevilleTest::GetMessageKey("{\"cmd\":\"Activ"), "");
+}